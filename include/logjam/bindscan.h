@@ -0,0 +1,60 @@
+/*-
+ * Copyright (c) 2017 Universitetet i Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOGJAM_BINDSCAN_H_INCLUDED
+#define LOGJAM_BINDSCAN_H_INCLUDED
+
+/*
+ * Fields extracted from a BIND query log line, in the order in which
+ * they appear.  Field n corresponds to subexpression n + 2 of
+ * lj_bind_re.
+ */
+enum {
+	LJ_BIND_CLIENT_ADDR,
+	LJ_BIND_CLIENT_PORT,
+	LJ_BIND_DNSNAME,
+	LJ_BIND_CLASS,
+	LJ_BIND_TYPE,
+	LJ_BIND_RECURSE,
+	LJ_BIND_FLAGS,
+	LJ_BIND_SERVER_ADDR,
+	LJ_BIND_NFIELDS
+};
+#define LJ_BIND_RE_NMATCH	(LJ_BIND_NFIELDS + 2)
+
+typedef struct lj_bind_field {
+	size_t		 off;
+	size_t		 len;
+} lj_bind_field;
+
+extern const char lj_bind_re[];
+
+int lj_bind_scan(const char *, lj_bind_field *);
+
+#endif
@@ -0,0 +1,54 @@
+/*-
+ * Copyright (c) 2017 Universitetet i Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOGJAM_CHUNK_H_INCLUDED
+#define LOGJAM_CHUNK_H_INCLUDED
+
+#include <logjam/pool.h>
+
+typedef struct lj_chunk_pool lj_chunk_pool;
+
+/*
+ * A reference-counted, fixed-size buffer.  Chunks come from a pool and
+ * go back to it once the last reference to them is dropped.
+ */
+typedef struct lj_chunk {
+	lj_pool_obj	 po;
+	unsigned long	 refs;
+	size_t		 size;
+	char		 data[];
+} lj_chunk;
+
+lj_chunk_pool *lj_chunk_pool_create(size_t);
+void lj_chunk_pool_destroy(lj_chunk_pool *);
+lj_chunk *lj_chunk_get(lj_chunk_pool *);
+void lj_chunk_ref(lj_chunk *, unsigned long);
+void lj_chunk_unref(lj_chunk *, unsigned long);
+
+#endif
@@ -31,12 +31,24 @@
 #define LOGJAM_CIRQ_H_INCLUDED
 
 typedef struct cirq cirq;
+typedef size_t (*cirq_size_f)(const void *);
+
+#define CIRQ_SPSC		0x0001	/* lock-free, one producer/consumer */
+#define CIRQ_DROP_OLDEST	0x0000	/* when full, displace the oldest */
+#define CIRQ_DROP_NEWEST	0x0010	/* when full, reject the new object */
+#define CIRQ_BLOCK		0x0020	/* when full, wait for room */
+#define CIRQ_OVERFLOW		0x0030	/* overflow policy mask */
 
 cirq *cirq_create(size_t);
+cirq *cirq_create_flags(size_t, unsigned int);
 void cirq_destroy(cirq *);
+int cirq_set_budget(cirq *, size_t, cirq_size_f);
 size_t cirq_len(cirq *);
+size_t cirq_bytes(cirq *);
 void *cirq_put(cirq *, void *);
+size_t cirq_put_batch(cirq *, void * const *, size_t, void **, unsigned int);
 void *cirq_get(cirq *, unsigned int);
+size_t cirq_get_batch(cirq *, void **, size_t, unsigned int);
 void cirq_stat(cirq *, size_t *, size_t *, size_t *, int);
 
 #endif
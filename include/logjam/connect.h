@@ -30,6 +30,9 @@
 #ifndef LOGJAM_CONNECT_H_INCLUDED
 #define LOGJAM_CONNECT_H_INCLUDED
 
+struct addrinfo;
+
 int lj_connect(const char *, int, int);
+int lj_connect_start(const struct addrinfo *);
 
 #endif
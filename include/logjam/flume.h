@@ -30,15 +30,95 @@
 #ifndef LOGJAM_FLUME_H_INCLUDED
 #define LOGJAM_FLUME_H_INCLUDED
 
+#include <pthread.h>
+#include <stdint.h>
+
 #include <logjam/types.h>
+#include <logjam/cirq.h>
+#include <logjam/pool.h>
+#include <logjam/spool.h>
+
+#define LJ_FLUME_QUEUE_SIZE	1024
+
+typedef struct lj_flume_queue {
+	cirq		*cirq;
+	unsigned int	 flags;		/* CIRQ_* overflow policy */
+	size_t		 size;		/* capacity in records */
+	size_t		 budget;	/* capacity in bytes, 0 if unbounded */
+} lj_flume_queue;
+
+#define LJ_FLUME_SPOOL_SEGSIZE	(16 * 1024 * 1024)
+#define LJ_FLUME_SPOOL_MAXSIZE	(1024 * 1024 * 1024)
+
+typedef struct lj_flume_spool {
+	spool		*spool;
+	char		*path;		/* spool directory */
+	size_t		 segsize;	/* segment size in bytes */
+	size_t		 maxsize;	/* total size in bytes */
+	size_t		 highwater;	/* spill past this many queued */
+	size_t		 nspill;
+	size_t		 nreplay;
+	size_t		 ndrop;
+} lj_flume_spool;
+
+/*
+ * The sender thread hands records to the sender in batches.  By default
+ * it sends whatever it finds in the output queue right away, but it can
+ * be told to wait for a fuller batch, trading latency for throughput.
+ * The byte count is approximate, as it is based on in-memory size.
+ */
+#define LJ_FLUME_BATCH_RECORDS	256
+#define LJ_FLUME_MAX_BATCH	4096
+
+typedef struct lj_flume_batching {
+	size_t		 records;	/* max records per batch */
+	size_t		 bytes;		/* max bytes per batch, or 0 */
+	unsigned int	 delay;		/* max wait for a full batch (ms) */
+} lj_flume_batching;
+
+#define LJ_FLUME_MAX_WORKERS	64
+
+typedef struct lj_flume_worker {
+	lj_flume	*flume;
+	lj_parser_ctx	*pctx;		/* each worker has its own */
+	lj_pool		*logobjs;	/* recycled logobjs */
+	pthread_t	 thr;
+} lj_flume_worker;
+
+/*
+ * Parser workers take turns claiming batches from the input queue, and
+ * number them in the order in which they were claimed.  Parsed batches
+ * are deposited in a reorder window, and whichever worker completes the
+ * oldest outstanding batch places it, and any that follow it, on the
+ * output queue.
+ */
+struct lj_flume_batch;
 
 struct lj_flume {
+	lj_flume	*next;
+	unsigned int	 id;
 	lj_reader_ctx	*rctx;
-	lj_parser_ctx	*pctx;
 	lj_sender_ctx	*sctx;
+	lj_flume_worker	*workers;
+	unsigned int	 nworkers;
+	lj_flume_queue	 iq;		/* reader to parser */
+	lj_flume_queue	 oq;		/* parser to sender */
+	lj_flume_spool	 sp;		/* sender overflow, if configured */
+	lj_flume_batching bt;		/* sender batching policy */
+	lj_pool		*slabs;		/* recycled logline slabs */
+	pthread_t	 rthr;
+	pthread_t	 sthr;
+	pthread_mutex_t	 claim;		/* serializes reads from iq */
+	uint64_t	 nclaimed;
+	pthread_mutex_t	 reorder;	/* protects the window */
+	pthread_cond_t	 reordered;
+	struct lj_flume_batch *window;
+	unsigned int	 nwindow;
+	uint64_t	 nplaced;
 };
 
 lj_flume *lj_flume_init(void);
+int lj_flume_set_workers(lj_flume *, unsigned int);
 void lj_flume_fini(lj_flume *);
 
 #endif
@@ -31,6 +31,7 @@
 #define LOGJAM_LOGOBJ_H_INCLUDED
 
 #include <logjam/types.h>
+#include <logjam/pool.h>
 
 #ifndef JANSSON_H
 typedef void json_t;
@@ -38,17 +39,60 @@ typedef void json_t;
 
 struct lj_logline {
 	uint64_t	 when;		/* microseconds since epoch */
-	char		 what[1024];
+	size_t		 len;		/* length of what, excluding NUL */
+	char		*what;
+	struct lj_chunk	*chunk;		/* chunk what points into, if any */
 };
 
+/*
+ * A logobj is a flat list of fields whose values are stored one after
+ * the other in a single buffer.  Keys are interned, so a field is just
+ * a key id and the location and type of its value.  Values are
+ * NUL-terminated, but the terminator is not included in the length.
+ */
+typedef enum lj_logobj_type {
+	LJ_LOGOBJ_STRING,
+	LJ_LOGOBJ_TIME,			/* RFC 3339 timestamp */
+} lj_logobj_type;
+
+typedef struct lj_logobj_field {
+	uint16_t	 key;		/* see lj_logobj_key() */
+	uint16_t	 type;
+	uint32_t	 off;		/* offset of value in buf */
+	uint32_t	 len;		/* length of value */
+} lj_logobj_field;
+
+#define LJ_LOGOBJ_NFIELDS	16
+#define LJ_LOGOBJ_MAXKEYS	1024
+
 struct lj_logobj {
-	json_t		*json;
+	lj_pool_obj	 po;
+	size_t		 size;		/* approximate bytes held */
+	lj_logobj_field	*fields;	/* usually points to ifields */
+	unsigned int	 nfields;
+	unsigned int	 maxfields;
+	char		*buf;
+	size_t		 buflen;
+	size_t		 bufsize;
+	lj_logobj_field	 ifields[LJ_LOGOBJ_NFIELDS];
 };
 
+lj_logline *lj_logline_create(uint64_t, const char *, size_t);
+lj_logline *lj_logline_view(uint64_t, char *, size_t, struct lj_chunk *);
+void lj_logline_destroy(lj_logline *);
+void lj_logline_destroy_batch(lj_logline **, size_t);
+
+lj_pool *lj_logobj_pool_create(void);
+void lj_logobj_bind(lj_pool *);
 lj_logobj *lj_logobj_create(void);
 void lj_logobj_destroy(lj_logobj *);
 int lj_logobj_settime(lj_logobj *, uint64_t);
 int lj_logobj_setstr(lj_logobj *, const char *, const char *);
 int lj_logobj_setstrn(lj_logobj *, const char *, const char *, size_t);
+int lj_logobj_intern(const char *);
+const char *lj_logobj_key(unsigned int);
+json_t *lj_logobj_json(const lj_logobj *);
+char *lj_logobj_serialize(const lj_logobj *, size_t *);
+lj_logobj *lj_logobj_deserialize(const char *, size_t);
 
 #endif
@@ -38,7 +38,16 @@ typedef const char *(*lj_parser_get_f)(lj_parser_ctx *, const char *);
 typedef lj_logobj *(*lj_parser_parse_f)(lj_parser_ctx *, const lj_logline *);
 typedef void (*lj_parser_fini_f)(lj_parser_ctx *);
 
-#define LJ_PARSER_CTX { lj_parser *parser; }
+/*
+ * Every parser context starts with these.  The counters are updated
+ * by the worker which owns the context and read by whoever logs
+ * statistics.
+ */
+#define LJ_PARSER_CTX {							\
+	lj_parser *parser;						\
+	size_t nskip;		/* rejected by the prefilter */		\
+	size_t nmiss;		/* rejected by the parser proper */	\
+}
 struct lj_parser_ctx LJ_PARSER_CTX;
 
 struct lj_parser {
@@ -49,6 +58,23 @@ struct lj_parser {
 	lj_parser_fini_f	 fini;
 };
 
+/*
+ * Count a line rejected by the prefilter or by the parser proper.
+ */
+static inline void
+lj_parser_skip(lj_parser_ctx *pctx)
+{
+
+	__atomic_fetch_add(&pctx->nskip, 1, __ATOMIC_RELAXED);
+}
+
+static inline void
+lj_parser_miss(lj_parser_ctx *pctx)
+{
+
+	__atomic_fetch_add(&pctx->nmiss, 1, __ATOMIC_RELAXED);
+}
+
 static inline void
 lj_parser_fini(lj_parser_ctx *pctx)
 {
@@ -59,4 +85,8 @@ lj_parser_fini(lj_parser_ctx *pctx)
 extern lj_parser lj_bind_parser;
 extern lj_parser lj_sshd_parser;
 
+#if HAVE_LIBPCRE2_8
+extern lj_parser lj_regex_parser;
+#endif
+
 #endif
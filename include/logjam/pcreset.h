@@ -0,0 +1,55 @@
+/*-
+ * Copyright (c) 2017 Universitetet i Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOGJAM_PCRESET_H_INCLUDED
+#define LOGJAM_PCRESET_H_INCLUDED
+
+/*
+ * A list of Perl-compatible regular expressions, tried in order, whose
+ * named subexpressions are reported as fields.
+ */
+#define LJ_PCRESET_MAX_FIELDS	64
+
+typedef struct lj_pcreset lj_pcreset;
+
+typedef struct lj_pcreset_field {
+	const char	*name;
+	size_t		 off;
+	size_t		 len;
+} lj_pcreset_field;
+
+lj_pcreset *lj_pcreset_create(void);
+int lj_pcreset_add(lj_pcreset *, const char *);
+unsigned int lj_pcreset_count(const lj_pcreset *);
+const char *lj_pcreset_pattern(const lj_pcreset *, unsigned int);
+int lj_pcreset_match(lj_pcreset *, const char *, size_t,
+    lj_pcreset_field *, unsigned int *);
+void lj_pcreset_destroy(lj_pcreset *);
+
+#endif
@@ -30,12 +30,15 @@
 #ifndef LOGJAM_READER_H_INCLUDED
 #define LOGJAM_READER_H_INCLUDED
 
+#include <time.h>
+
 #include <logjam/types.h>
 
 typedef lj_reader_ctx *(*lj_reader_init_f)(void);
 typedef int (*lj_reader_set_f)(lj_reader_ctx *, const char *, const char *);
 typedef const char *(*lj_reader_get_f)(lj_reader_ctx *, const char *);
 typedef lj_logline *(*lj_reader_read_f)(lj_reader_ctx *);
+typedef int (*lj_reader_wait_f)(lj_reader_ctx *, unsigned int);
 typedef void (*lj_reader_fini_f)(lj_reader_ctx *);
 
 #define LJ_READER_CTX { lj_reader *reader; }
@@ -46,9 +49,29 @@ struct lj_reader {
 	lj_reader_get_f		 get;
 	lj_reader_set_f		 set;
 	lj_reader_read_f	 read;
+	lj_reader_wait_f	 wait;
 	lj_reader_fini_f	 fini;
 };
 
+/*
+ * Wait up to the specified number of milliseconds for more data to
+ * become available.  Returns 1 if there may be more data, 0 if the wait
+ * timed out and -1 on error.  Readers which have no way of being
+ * notified simply sleep for the full duration.
+ */
+static inline int
+lj_reader_wait(lj_reader_ctx *rctx, unsigned int timeout_ms)
+{
+	struct timespec ts;
+
+	if (rctx->reader->wait != NULL)
+		return (rctx->reader->wait(rctx, timeout_ms));
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+	return (0);
+}
+
 static inline void
 lj_reader_fini(lj_reader_ctx *rctx)
 {
@@ -36,6 +36,10 @@ typedef lj_sender_ctx *(*lj_sender_init_f)(void);
 typedef int (*lj_sender_set_f)(lj_sender_ctx *, const char *, const char *);
 typedef const char *(*lj_sender_get_f)(lj_sender_ctx *, const char *);
 typedef int (*lj_sender_send_f)(lj_sender_ctx *, const lj_logobj *);
+typedef size_t (*lj_sender_send_batch_f)(lj_sender_ctx *,
+    lj_logobj *const *, size_t);
+typedef int (*lj_sender_flush_f)(lj_sender_ctx *);
+typedef size_t (*lj_sender_reclaim_f)(lj_sender_ctx *, lj_logobj **, size_t);
 typedef void (*lj_sender_fini_f)(lj_sender_ctx *);
 
 #define LJ_SENDER_CTX { lj_sender *sender; }
@@ -46,9 +50,61 @@ struct lj_sender {
 	lj_sender_get_f		 get;
 	lj_sender_set_f		 set;
 	lj_sender_send_f	 send;
+	lj_sender_send_batch_f	 send_batch;	/* optional */
+	lj_sender_flush_f	 flush;		/* optional */
+	lj_sender_reclaim_f	 reclaim;	/* optional */
 	lj_sender_fini_f	 fini;
 };
 
+/*
+ * Send a batch of records and return how many were accepted.  If not
+ * all of them were, errno is EAGAIN if the sender can't take any more
+ * right now, e.g. because it has no connection, and anything else if it
+ * can't take the first of the remaining records at all.  Senders which
+ * can't do better than one record at a time need not provide
+ * send_batch.
+ */
+static inline size_t
+lj_sender_send_batch(lj_sender_ctx *sctx, lj_logobj *const *lo, size_t n)
+{
+	size_t i;
+
+	if (sctx->sender->send_batch != NULL)
+		return (sctx->sender->send_batch(sctx, lo, n));
+	for (i = 0; i < n; ++i)
+		if (sctx->sender->send(sctx, lo[i]) != 0)
+			break;
+	return (i);
+}
+
+/*
+ * Push out anything the sender is holding on to.  Called whenever the
+ * sender thread runs out of records to send.
+ */
+static inline int
+lj_sender_flush(lj_sender_ctx *sctx)
+{
+
+	if (sctx->sender->flush == NULL)
+		return (0);
+	return (sctx->sender->flush(sctx));
+}
+
+/*
+ * Take back up to n records which the sender has accepted but not yet
+ * flushed, oldest first, and return how many there were.  The caller
+ * owns the records.  Senders which don't buffer need not provide
+ * reclaim.
+ */
+static inline size_t
+lj_sender_reclaim(lj_sender_ctx *sctx, lj_logobj **lo, size_t n)
+{
+
+	if (sctx->sender->reclaim == NULL)
+		return (0);
+	return (sctx->sender->reclaim(sctx, lo, n));
+}
+
 static inline void
 lj_sender_fini(lj_sender_ctx *sctx)
 {
@@ -37,6 +37,7 @@ int sock_use_tls(lj_socket *);
 int sock_use_cert(lj_socket *, const char *);
 int sock_open(lj_socket *);
 int sock_reopen(lj_socket *);
+int sock_advance(lj_socket *, unsigned int);
 void sock_close(lj_socket *);
 ssize_t sock_write(lj_socket *, const void *, size_t);
 ssize_t sock_read(lj_socket *, void *, size_t);
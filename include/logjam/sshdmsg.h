@@ -0,0 +1,57 @@
+/*-
+ * Copyright (c) 2017 Universitetet i Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOGJAM_SSHDMSG_H_INCLUDED
+#define LOGJAM_SSHDMSG_H_INCLUDED
+
+#include <regex.h>
+
+#include <logjam/multire.h>
+
+/*
+ * An sshd message we recognize.  Each subexpression of the regular
+ * expression which has a name in the field list becomes a field of that
+ * name, and the event name tells the messages apart.
+ */
+#define LJ_SSHD_NMATCH	8
+
+typedef struct lj_sshd_msg {
+	const char	*event;
+	const char	*re;
+	const char	*fields[LJ_SSHD_NMATCH];
+} lj_sshd_msg;
+
+extern const lj_sshd_msg lj_sshd_msgs[];
+extern const unsigned int lj_sshd_nmsgs;
+
+lj_multire *lj_sshd_compile(void);
+const lj_sshd_msg *lj_sshd_match(lj_multire *, const char *, size_t,
+    regmatch_t *, unsigned int *);
+
+#endif
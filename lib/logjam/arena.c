@@ -0,0 +1,227 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <logjam/arena.h>
+#include <logjam/pool.h>
+
+/*
+ * Slab arena for short-lived objects which are allocated by one thread
+ * and freed by another, such as log lines on their way from a reader to
+ * a parser.
+ *
+ * Each thread carves objects out of its own current slab, which is a
+ * block of LJ_ARENA_SLAB bytes aligned on its own size, so the slab an
+ * object belongs to can be found by masking its address.  Objects too
+ * large to share a slab get a block of their own.  Objects are never
+ * freed individually: each slab keeps a count of live objects and is
+ * freed as a whole once it has been retired by its owner and the count
+ * drops to zero.
+ *
+ * The owner does not touch the count while it is allocating from the
+ * slab.  Frees decrement it, so it goes negative.  When the owner
+ * retires the slab, it adds the number of objects it handed out.  The
+ * count can therefore only reach zero once the slab has been retired and
+ * every object in it has been freed, and whoever brings it to zero frees
+ * the slab.
+ *
+ * A thread can bind its arena to a pool of slabs, in which case spent
+ * slabs go back to the pool instead of being freed.
+ */
+
+#define LJ_ARENA_SLAB	(64 * 1024)
+#define LJ_ARENA_ALIGN	8
+
+struct lj_slab {
+	lj_pool_obj	 po;
+	long		 refs;
+};
+
+#define LJ_ARENA_HDR \
+	((sizeof(struct lj_slab) + LJ_ARENA_ALIGN - 1) & ~(LJ_ARENA_ALIGN - 1))
+
+static __thread struct lj_arena {
+	lj_pool		*pool;		/* where to get slabs from */
+	struct lj_slab	*slab;		/* current slab */
+	size_t		 off;		/* first free byte */
+	long		 nalloc;	/* objects handed out */
+} lj_arena;
+
+#define lj_slab_of(p) \
+	((struct lj_slab *)((uintptr_t)(p) & ~(uintptr_t)(LJ_ARENA_SLAB - 1)))
+
+/*
+ * Adjust a slab's reference count and free it if it drops to zero.
+ */
+static void
+lj_slab_unref(struct lj_slab *slab, long n)
+{
+
+	if (__atomic_sub_fetch(&slab->refs, n, __ATOMIC_ACQ_REL) == 0)
+		lj_pool_put(slab);
+}
+
+/*
+ * Allocate a slab of at least the requested size, from the pool if it
+ * is a regular slab and we have one.
+ */
+static struct lj_slab *
+lj_slab_create(size_t size)
+{
+	struct lj_slab *slab;
+	void *p;
+	int ret;
+
+	if (size == LJ_ARENA_SLAB && lj_arena.pool != NULL) {
+		if ((slab = lj_pool_get(lj_arena.pool)) == NULL)
+			return (NULL);
+	} else {
+		size = (size + LJ_ARENA_SLAB - 1) &
+		    ~(size_t)(LJ_ARENA_SLAB - 1);
+		if ((ret = posix_memalign(&p, LJ_ARENA_SLAB, size)) != 0) {
+			errno = ret;
+			return (NULL);
+		}
+		slab = p;
+		slab->po.pool = NULL;
+	}
+	slab->refs = 0;
+	return (slab);
+}
+
+/*
+ * Create a pool of slabs for use with lj_arena_bind().
+ */
+lj_pool *
+lj_arena_pool_create(void)
+{
+
+	return (lj_pool_create(LJ_ARENA_SLAB, LJ_ARENA_SLAB, NULL));
+}
+
+/*
+ * Retire the calling thread's current slab, if it has one.  Threads
+ * which allocate from the arena must call this before they exit.
+ */
+void
+lj_arena_release(void)
+{
+	struct lj_arena *a = &lj_arena;
+
+	if (a->slab != NULL)
+		lj_slab_unref(a->slab, -a->nalloc);
+	a->slab = NULL;
+	a->off = 0;
+	a->nalloc = 0;
+}
+
+/*
+ * Make the calling thread get its slabs from the specified pool, which
+ * it must own, or allocate them directly if it is NULL.
+ */
+void
+lj_arena_bind(lj_pool *pool)
+{
+
+	lj_arena_release();
+	lj_arena.pool = pool;
+}
+
+/*
+ * Allocate an object from the calling thread's current slab, moving on
+ * to a fresh slab if there is not enough room left.
+ */
+void *
+lj_arena_alloc(size_t size)
+{
+	struct lj_arena *a = &lj_arena;
+	struct lj_slab *slab;
+	void *p;
+
+	if (size > SIZE_MAX - LJ_ARENA_SLAB) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+	size = (size + LJ_ARENA_ALIGN - 1) & ~(size_t)(LJ_ARENA_ALIGN - 1);
+	if (size > LJ_ARENA_SLAB - LJ_ARENA_HDR) {
+		/* too large for a slab, give it a block of its own */
+		if ((slab = lj_slab_create(LJ_ARENA_HDR + size)) == NULL)
+			return (NULL);
+		slab->refs = 1;
+		return ((char *)slab + LJ_ARENA_HDR);
+	}
+	if (a->slab == NULL || a->off + size > LJ_ARENA_SLAB) {
+		if ((slab = lj_slab_create(LJ_ARENA_SLAB)) == NULL)
+			return (NULL);
+		lj_arena_release();
+		a->slab = slab;
+		a->off = LJ_ARENA_HDR;
+	}
+	p = (char *)a->slab + a->off;
+	a->off += size;
+	a->nalloc++;
+	return (p);
+}
+
+/*
+ * Free an object.
+ */
+void
+lj_arena_free(void *p)
+{
+
+	if (p != NULL)
+		lj_slab_unref(lj_slab_of(p), 1);
+}
+
+/*
+ * Free an array of objects.  Objects which were allocated consecutively
+ * usually share a slab, so this takes one atomic operation per slab
+ * rather than one per object.
+ */
+void
+lj_arena_free_batch(void **p, size_t n)
+{
+	struct lj_slab *slab;
+	size_t i, j;
+
+	for (i = 0; i < n; i = j) {
+		slab = lj_slab_of(p[i]);
+		for (j = i + 1; j < n && lj_slab_of(p[j]) == slab; ++j)
+			/* nothing */ ;
+		lj_slab_unref(slab, j - i);
+	}
+}
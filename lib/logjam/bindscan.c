@@ -0,0 +1,204 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <logjam/bindscan.h>
+
+/*
+ * The query log line format, as a POSIX extended regular expression.
+ * This is what the BIND parser used before lj_bind_scan() was written,
+ * and is still available as a fallback.
+ */
+const char lj_bind_re[] =
+    "^"
+    "queries:"
+    "( [0-9a-z]+:)?"		/* 1: optional severity */
+    " client "
+    "([0-9A-Fa-f:.]+)"		/* 2: client address */
+    "#"
+    "([0-9]+)"			/* 3: client port */
+    ".*"			/*    optional signer, qname */
+    ": query: "
+    "([0-9A-Za-z._-]+)"		/* 4: queried name */
+    " "
+    "([A-Z]+)"			/* 5: class */
+    " "
+    "([0-9A-Z]+)"		/* 6: type */
+    " "
+    "([+-])"			/* 7: recursion and flags */
+    "([A-Z]*)"			/* 8: recursion and flags */
+    " "
+    "\\(([0-9A-Fa-f:.]+)\\)"	/* 9: server address */
+    "$";
+
+/*
+ * Character classes used in the regular expression above.
+ */
+#define LJ_BC_ADDR	0x01	/* [0-9A-Fa-f:.] */
+#define LJ_BC_DIGIT	0x02	/* [0-9] */
+#define LJ_BC_LOWER	0x04	/* [0-9a-z] */
+#define LJ_BC_NAME	0x08	/* [0-9A-Za-z._-] */
+#define LJ_BC_UPPER	0x10	/* [A-Z] */
+#define LJ_BC_TYPE	0x20	/* [0-9A-Z] */
+
+#define LJ_BC_ISDIGIT(c) ((c) >= '0' && (c) <= '9')
+#define LJ_BC_ISLOWER(c) ((c) >= 'a' && (c) <= 'z')
+#define LJ_BC_ISUPPER(c) ((c) >= 'A' && (c) <= 'Z')
+#define LJ_BC_ISXALPHA(c) \
+	(((c) >= 'A' && (c) <= 'F') || ((c) >= 'a' && (c) <= 'f'))
+#define LJ_BC(c) (							\
+	(LJ_BC_ISDIGIT(c) || LJ_BC_ISXALPHA(c) || (c) == ':' ||		\
+	    (c) == '.' ? LJ_BC_ADDR : 0) |				\
+	(LJ_BC_ISDIGIT(c) ? LJ_BC_DIGIT : 0) |				\
+	(LJ_BC_ISDIGIT(c) || LJ_BC_ISLOWER(c) ? LJ_BC_LOWER : 0) |	\
+	(LJ_BC_ISDIGIT(c) || LJ_BC_ISLOWER(c) || LJ_BC_ISUPPER(c) ||	\
+	    (c) == '.' || (c) == '_' || (c) == '-' ? LJ_BC_NAME : 0) |	\
+	(LJ_BC_ISUPPER(c) ? LJ_BC_UPPER : 0) |				\
+	(LJ_BC_ISDIGIT(c) || LJ_BC_ISUPPER(c) ? LJ_BC_TYPE : 0))
+#define LJ_BC4(c)  LJ_BC(c), LJ_BC(c + 1), LJ_BC(c + 2), LJ_BC(c + 3)
+#define LJ_BC16(c) LJ_BC4(c), LJ_BC4(c + 4), LJ_BC4(c + 8), LJ_BC4(c + 12)
+#define LJ_BC64(c) LJ_BC16(c), LJ_BC16(c + 16), LJ_BC16(c + 32), \
+	LJ_BC16(c + 48)
+
+static const uint8_t lj_bind_cc[256] = {
+	LJ_BC64(0), LJ_BC64(64), LJ_BC64(128), LJ_BC64(192)
+};
+
+/*
+ * Return the start of the longest run of characters of the specified
+ * class which ends at e and starts no earlier than lo.
+ */
+static inline size_t
+lj_bind_span(const unsigned char *s, size_t lo, size_t e, unsigned int cc)
+{
+
+	while (e > lo && (lj_bind_cc[s[e - 1]] & cc))
+		--e;
+	return (e);
+}
+
+/*
+ * Scan a BIND query log line and store the offset and length of each
+ * field in the specified array.  Returns 0 if the line matches
+ * lj_bind_re, in which case the fields are exactly what regexec() would
+ * have reported for the corresponding subexpressions, and -1 if it does
+ * not.
+ *
+ * None of the fixed parts of the expression can be confused with the
+ * variable parts around them, so the head of the line can be scanned
+ * forward up to the client port.  The tail can't contain ": query: ",
+ * so the greedy ".*" must end at the last occurrence of it, which we
+ * find by scanning the tail backward from the end of the line.
+ */
+int
+lj_bind_scan(const char *str, lj_bind_field *f)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	size_t b, e, head;
+
+	/* "queries:" [" " severity ":"] " client " */
+	if (strncmp(str, "queries: ", 9) != 0)
+		return (-1);
+	if (strncmp(str + 9, "client ", 7) == 0) {
+		b = 9 + 7;
+	} else {
+		for (b = 9; lj_bind_cc[s[b]] & LJ_BC_LOWER; ++b)
+			/* nothing */ ;
+		if (b == 9 || strncmp(str + b, ": client ", 9) != 0)
+			return (-1);
+		b += 9;
+	}
+
+	/* client address "#" client port */
+	for (e = b; lj_bind_cc[s[e]] & LJ_BC_ADDR; ++e)
+		/* nothing */ ;
+	if (e == b || s[e] != '#')
+		return (-1);
+	f[LJ_BIND_CLIENT_ADDR].off = b;
+	f[LJ_BIND_CLIENT_ADDR].len = e - b;
+	for (b = e = e + 1; lj_bind_cc[s[e]] & LJ_BC_DIGIT; ++e)
+		/* nothing */ ;
+	if (e == b)
+		return (-1);
+	f[LJ_BIND_CLIENT_PORT].off = b;
+	f[LJ_BIND_CLIENT_PORT].len = e - b;
+	head = e;
+
+	/* " (" server address ")" */
+	e = head + strlen(str + head);
+	if (e <= head || s[--e] != ')')
+		return (-1);
+	b = lj_bind_span(s, head, e, LJ_BC_ADDR);
+	if (b == e || b < head + 2 || s[b - 1] != '(' || s[b - 2] != ' ')
+		return (-1);
+	f[LJ_BIND_SERVER_ADDR].off = b;
+	f[LJ_BIND_SERVER_ADDR].len = e - b;
+	e = b - 2;
+
+	/* " " recursion flags */
+	b = lj_bind_span(s, head, e, LJ_BC_UPPER);
+	if (b < head + 2 || (s[b - 1] != '+' && s[b - 1] != '-') ||
+	    s[b - 2] != ' ')
+		return (-1);
+	f[LJ_BIND_FLAGS].off = b;
+	f[LJ_BIND_FLAGS].len = e - b;
+	f[LJ_BIND_RECURSE].off = b - 1;
+	f[LJ_BIND_RECURSE].len = 1;
+	e = b - 2;
+
+	/* " " type */
+	b = lj_bind_span(s, head, e, LJ_BC_TYPE);
+	if (b == e || b < head + 1 || s[b - 1] != ' ')
+		return (-1);
+	f[LJ_BIND_TYPE].off = b;
+	f[LJ_BIND_TYPE].len = e - b;
+	e = b - 1;
+
+	/* " " class */
+	b = lj_bind_span(s, head, e, LJ_BC_UPPER);
+	if (b == e || b < head + 1 || s[b - 1] != ' ')
+		return (-1);
+	f[LJ_BIND_CLASS].off = b;
+	f[LJ_BIND_CLASS].len = e - b;
+	e = b - 1;
+
+	/* ": query: " name */
+	b = lj_bind_span(s, head, e, LJ_BC_NAME);
+	if (b == e || b < head + 9 || memcmp(s + b - 9, ": query: ", 9) != 0)
+		return (-1);
+	f[LJ_BIND_DNSNAME].off = b;
+	f[LJ_BIND_DNSNAME].len = e - b;
+	return (0);
+}
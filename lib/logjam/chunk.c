@@ -0,0 +1,122 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <logjam/chunk.h>
+
+/*
+ * Chunks are pooled objects with a reference count, so they go back to
+ * their pool from whichever thread releases the last reference.
+ */
+struct lj_chunk_pool {
+	lj_pool		*pool;
+	size_t		 size;
+};
+
+/*
+ * Create a pool of chunks of the specified size.
+ */
+lj_chunk_pool *
+lj_chunk_pool_create(size_t size)
+{
+	lj_chunk_pool *cp;
+
+	if (size == 0 || size > SIZE_MAX - sizeof(lj_chunk)) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	if ((cp = calloc(1, sizeof *cp)) == NULL)
+		return (NULL);
+	if ((cp->pool = lj_pool_create(sizeof(lj_chunk) + size, 0,
+	    NULL)) == NULL) {
+		free(cp);
+		return (NULL);
+	}
+	cp->size = size;
+	return (cp);
+}
+
+/*
+ * Give up ownership of a pool.  Chunks which are still referenced will
+ * be freed when they are released.
+ */
+void
+lj_chunk_pool_destroy(lj_chunk_pool *cp)
+{
+
+	if (cp == NULL)
+		return;
+	lj_pool_destroy(cp->pool);
+	free(cp);
+}
+
+/*
+ * Get a chunk from the pool.  The caller holds the only reference to the
+ * chunk.  Must only be called by the pool's owner.
+ */
+lj_chunk *
+lj_chunk_get(lj_chunk_pool *cp)
+{
+	lj_chunk *chunk;
+
+	if ((chunk = lj_pool_get(cp->pool)) == NULL)
+		return (NULL);
+	chunk->size = cp->size;
+	chunk->refs = 1;
+	return (chunk);
+}
+
+/*
+ * Add references to a chunk.
+ */
+void
+lj_chunk_ref(lj_chunk *chunk, unsigned long n)
+{
+
+	__atomic_add_fetch(&chunk->refs, n, __ATOMIC_RELAXED);
+}
+
+/*
+ * Drop references to a chunk, and return it to its pool if there are
+ * none left.
+ */
+void
+lj_chunk_unref(lj_chunk *chunk, unsigned long n)
+{
+
+	if (__atomic_sub_fetch(&chunk->refs, n, __ATOMIC_ACQ_REL) == 0)
+		lj_pool_put(chunk);
+}
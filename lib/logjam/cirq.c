@@ -35,47 +35,115 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
+#include <time.h>
 
 #include <logjam/cirq.h>
 
+#define CIRQ_CACHE_LINE 64
+#define CIRQ_ALIGNED __attribute__((__aligned__(CIRQ_CACHE_LINE)))
+
 struct cirq {
 	pthread_mutex_t	 mutex;
 	pthread_cond_t	 cond;
+	pthread_cond_t	 space;
 	size_t		 size;
+	unsigned int	 flags;
+	size_t		 budget;
+	cirq_size_f	 sizef;
+	/* locked variant */
 	unsigned int	 ridx;
 	unsigned int	 widx;
 	size_t		 nput;
 	size_t		 nget;
 	size_t		 ndrop;
-	void		*obj[];
+	/* lock-free variant */
+	size_t		 mask;
+	int		 parked;
+	int		 wparked;
+	struct {
+		uint64_t	 idx;
+		size_t		 nget;
+	} r CIRQ_ALIGNED;
+	struct {
+		uint64_t	 idx;
+		size_t		 nput;
+		size_t		 ndrop;
+	} w CIRQ_ALIGNED;
+	size_t		 bytes CIRQ_ALIGNED;
+	void		*obj[] CIRQ_ALIGNED;
 };
 
+#define spsc_load(p, mo)	__atomic_load_n((p), __ATOMIC_##mo)
+#define spsc_store(p, v, mo)	__atomic_store_n((p), (v), __ATOMIC_##mo)
+#define spsc_add(p, n)		__atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#define spsc_sub(p, n)		__atomic_fetch_sub((p), (n), __ATOMIC_SEQ_CST)
+#define spsc_take(p)		__atomic_exchange_n((p), 0, __ATOMIC_RELAXED)
+
 /*
  * Create a cirq with room for the specified number of objects.
  *
  * The cirq has a mutex for protection, a condition variable to signal
- * waiting readers, a size, an array of pointers to objects, and read and
- * write indices.  There are two cases where these can point to the same
- * location: if the cirq is empty and if it is full.  The difference is
- * that in the first case, the value stored at that location is NULL.
+ * waiting readers, another to signal blocked writers, a size, an array
+ * of pointers to objects, and read and write indices.  There are two
+ * cases where these can point to the same location: if the cirq is
+ * empty and if it is full.  The difference is that in the first case,
+ * the value stored at that location is NULL.
  */
 cirq *
 cirq_create(size_t nobj)
 {
+
+	return (cirq_create_flags(nobj, 0));
+}
+
+/*
+ * Create a cirq with the specified flags.
+ *
+ * If CIRQ_SPSC is set, the cirq is lock-free and may only be used by a
+ * single producer and a single consumer at any one time.  Its read and
+ * write indices increase monotonically and are kept in separate cache
+ * lines, and the object array is rounded up to a power of two so the
+ * slot can be found with a mask.  The mutex and condition variable are
+ * only used when the consumer has found the cirq empty and needs to
+ * sleep, which it advertises through the parked flag, and when a
+ * blocking producer has found it full, which it advertises through the
+ * wparked flag.
+ *
+ * The overflow policy determines what happens when an object is placed
+ * on a full cirq: CIRQ_DROP_OLDEST (the default) displaces the oldest
+ * object, CIRQ_DROP_NEWEST rejects the new one, and CIRQ_BLOCK makes the
+ * producer wait for the consumer to make room.
+ */
+cirq *
+cirq_create_flags(size_t nobj, unsigned int flags)
+{
+	size_t nslot;
 	cirq *c;
 
-	if (nobj < 2) {
+	if (nobj < 2 || (flags & ~(CIRQ_SPSC|CIRQ_OVERFLOW)) != 0 ||
+	    (flags & CIRQ_OVERFLOW) == CIRQ_OVERFLOW) {
 		errno = EINVAL;
 		return (NULL);
 	}
-	if ((c = calloc(1, sizeof *c + nobj * sizeof *c->obj)) == NULL)
+	nslot = nobj;
+	if (flags & CIRQ_SPSC)
+		for (nslot = 2; nslot < nobj; nslot *= 2)
+			/* nothing */ ;
+	if (posix_memalign((void **)&c, CIRQ_CACHE_LINE,
+	    sizeof *c + nslot * sizeof *c->obj) != 0)
 		return (NULL);
+	memset(c, 0, sizeof *c + nslot * sizeof *c->obj);
 	c->size = nobj;
+	c->flags = flags;
+	c->mask = nslot - 1;
 	if (pthread_mutex_init(&c->mutex, NULL) != 0)
 		goto fail;
 	if (pthread_cond_init(&c->cond, NULL) != 0)
 		goto fail;
+	if (pthread_cond_init(&c->space, NULL) != 0)
+		goto fail;
 	return (c);
 fail:
 	cirq_destroy(c);
@@ -90,103 +158,610 @@ cirq_destroy(cirq *c)
 {
 
 	if (c != NULL) {
+		pthread_cond_destroy(&c->space);
 		pthread_cond_destroy(&c->cond);
 		pthread_mutex_destroy(&c->mutex);
 		free(c);
 	}
 }
 
+/*
+ * Set a memory budget for the cirq.  The size function is used to
+ * compute the number of bytes held by each object, and the cirq is
+ * considered full when placing another object would take the total past
+ * the budget, or if it would exceed the number of objects specified at
+ * creation time, whichever comes first.  A single object larger than
+ * the entire budget is accepted if the cirq is empty.  A budget of zero
+ * means that bytes are only counted, not bounded.
+ *
+ * This must be done before the cirq is put to use.
+ */
+int
+cirq_set_budget(cirq *c, size_t budget, cirq_size_f sizef)
+{
+
+	assert(c != NULL);
+	if (budget > 0 && sizef == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+	c->budget = budget;
+	c->sizef = sizef;
+	return (0);
+}
+
+/*
+ * Compute an absolute deadline the specified number of microseconds
+ * into the future.
+ */
+static void
+cirq_deadline(struct timespec *ts, unsigned int timeout)
+{
+
+	clock_gettime(CLOCK_REALTIME, ts);
+	ts->tv_sec += timeout / 1000000;
+	ts->tv_nsec += (timeout % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/*
+ * Return the number of objects in a locked cirq.  The caller must hold
+ * the mutex.
+ */
+static size_t
+cirq_locked_len(cirq *c)
+{
+
+	assert(c->ridx < c->size);
+	assert(c->widx < c->size);
+	if (c->widx == c->ridx)
+		return (c->obj[c->ridx] == NULL ? 0 : c->size);
+	return ((c->widx + c->size - c->ridx) % c->size);
+}
+
 /*
  * Return the number of objects in the cirq.
  */
 size_t
 cirq_len(cirq *c)
 {
+	uint64_t ridx;
 	size_t len;
 
 	assert(c != NULL);
-	pthread_mutex_lock(&c->mutex);
-	assert(c->ridx < c->size);
-	assert(c->widx < c->size);
-	if (c->widx == c->ridx) {
-		len = c->obj[c->ridx] == NULL ? 0 : c->size;
-	} else {
-		len = (c->widx + c->size - c->ridx) % c->size;
+	if (c->flags & CIRQ_SPSC) {
+		ridx = spsc_load(&c->r.idx, ACQUIRE);
+		return (spsc_load(&c->w.idx, ACQUIRE) - ridx);
 	}
+	pthread_mutex_lock(&c->mutex);
+	len = cirq_locked_len(c);
 	pthread_mutex_unlock(&c->mutex);
 	return (len);
 }
 
 /*
- * Place an object onto the cirq.  If the cirq is full, the new object
- * will displace the oldest one.
+ * Return the number of bytes held by the objects in the cirq.
  */
-void *
-cirq_put(cirq *c, void *obj)
+size_t
+cirq_bytes(cirq *c)
 {
-	unsigned int idx;
-	void *old;
+	size_t bytes;
 
 	assert(c != NULL);
-	assert(obj != NULL);
+	if (c->flags & CIRQ_SPSC)
+		return (spsc_load(&c->bytes, RELAXED));
 	pthread_mutex_lock(&c->mutex);
+	bytes = c->bytes;
+	pthread_mutex_unlock(&c->mutex);
+	return (bytes);
+}
+
+/*
+ * Return the number of bytes held by an object.
+ */
+static inline size_t
+cirq_objsize(cirq *c, const void *obj)
+{
+
+	return (c->sizef != NULL ? c->sizef(obj) : 0);
+}
+
+/*
+ * Check whether an object of the given size would fit within the budget
+ * if the cirq currently holds the given number of bytes.
+ */
+static inline int
+cirq_within_budget(cirq *c, size_t bytes, size_t sz)
+{
+
+	return (c->budget == 0 || bytes == 0 || bytes + sz <= c->budget);
+}
+
+/*
+ * Count how many of the given objects there is room for in a lock-free
+ * cirq, and how many bytes they hold.
+ */
+static size_t
+cirq_spsc_room(cirq *c, void * const *obj, size_t n, size_t *nbytes)
+{
+	size_t bytes, i, room, sz;
+
+	room = c->size - (c->w.idx - spsc_load(&c->r.idx, SEQ_CST));
+	if (room > n)
+		room = n;
+	*nbytes = 0;
+	if (c->sizef == NULL)
+		return (room);
+	bytes = spsc_load(&c->bytes, SEQ_CST);
+	for (i = 0; i < room; ++i) {
+		sz = c->sizef(obj[i]);
+		if (!cirq_within_budget(c, bytes, sz))
+			break;
+		bytes += sz;
+		*nbytes += sz;
+	}
+	return (i);
+}
+
+/*
+ * Place objects in free slots of a lock-free cirq and wake the consumer
+ * if it has parked.  The bytes are accounted for before the objects are
+ * published, so the consumer never subtracts more than has been added.
+ */
+static void
+cirq_spsc_push(cirq *c, void * const *obj, size_t n, size_t nbytes)
+{
+	uint64_t widx;
+	size_t i;
+
+	if (n == 0)
+		return;
+	widx = c->w.idx;
+	for (i = 0; i < n; ++i)
+		spsc_store(&c->obj[(widx + i) & c->mask], obj[i], RELAXED);
+	if (nbytes > 0)
+		spsc_add(&c->bytes, nbytes);
+	spsc_store(&c->w.idx, widx + n, SEQ_CST);
+	spsc_add(&c->w.nput, n);
+	if (spsc_load(&c->parked, SEQ_CST)) {
+		pthread_mutex_lock(&c->mutex);
+		pthread_cond_signal(&c->cond);
+		pthread_mutex_unlock(&c->mutex);
+	}
+}
+
+/*
+ * Count how many of the oldest objects in a lock-free cirq, starting at
+ * the given read index, would have to be displaced to make room for the
+ * given object.
+ */
+static size_t
+cirq_spsc_excess(cirq *c, uint64_t ridx, size_t len, const void *obj)
+{
+	size_t bytes, k, sz;
+
+	bytes = spsc_load(&c->bytes, ACQUIRE);
+	sz = cirq_objsize(c, obj);
+	for (k = 0; k < len; ++k) {
+		if (len - k < c->size && cirq_within_budget(c, bytes, sz))
+			break;
+		bytes -= cirq_objsize(c,
+		    spsc_load(&c->obj[(ridx + k) & c->mask], RELAXED));
+	}
+	return (k);
+}
+
+/*
+ * Try to displace the specified number of objects from the head of a
+ * lock-free cirq, racing the consumer for them.  On success, the
+ * displaced objects are stored in the array pointed to by the last
+ * argument and the number of bytes they held is returned.  If the
+ * consumer got there first, (size_t)-1 is returned.
+ */
+static size_t
+cirq_spsc_evict(cirq *c, uint64_t ridx, size_t n, void **old)
+{
+	size_t i, nbytes;
+
+	if (n == 0)
+		return (0);
+	for (i = 0, nbytes = 0; i < n; ++i) {
+		old[i] = spsc_load(&c->obj[(ridx + i) & c->mask], RELAXED);
+		nbytes += cirq_objsize(c, old[i]);
+	}
+	if (!__atomic_compare_exchange_n(&c->r.idx, &ridx, ridx + n, 0,
+	    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return ((size_t)-1);
+	if (nbytes > 0)
+		spsc_sub(&c->bytes, nbytes);
+	spsc_add(&c->w.ndrop, n);
+	return (nbytes);
+}
+
+/*
+ * Lock-free variant of cirq_put_batch().  If the cirq is full and the
+ * policy is to drop the oldest objects, the producer races the consumer
+ * for them; whichever of them advances the read index owns them.  A
+ * blocking producer publishes what fits, then parks until the consumer
+ * has made room.
+ */
+static size_t
+cirq_spsc_put(cirq *c, void * const *obj, size_t n, void **old,
+    unsigned int timeout)
+{
+	struct timespec ts;
+	uint64_t ridx;
+	size_t evict, i, len, nbytes, nold, norig, room, want;
+	int r;
+
+	norig = n;
+	room = cirq_spsc_room(c, obj, n, &nbytes);
+	cirq_spsc_push(c, obj, room, nbytes);
+	obj += room;
+	n -= room;
+	nold = 0;
+	if (n == 0)
+		return (0);
+	switch (c->flags & CIRQ_OVERFLOW) {
+	case CIRQ_DROP_NEWEST:
+		for (i = 0; i < n; ++i)
+			old[nold++] = obj[i];
+		spsc_add(&c->w.nput, nold);
+		spsc_add(&c->w.ndrop, nold);
+		return (nold);
+	case CIRQ_BLOCK:
+		cirq_deadline(&ts, timeout);
+		for (;;) {
+			/* park until the consumer signals or we time out */
+			pthread_mutex_lock(&c->mutex);
+			spsc_store(&c->wparked, 1, SEQ_CST);
+			r = 0;
+			while (r == 0 &&
+			    cirq_spsc_room(c, obj, 1, &nbytes) == 0)
+				r = pthread_cond_timedwait(&c->space,
+				    &c->mutex, &ts);
+			spsc_store(&c->wparked, 0, RELAXED);
+			pthread_mutex_unlock(&c->mutex);
+			if ((room = cirq_spsc_room(c, obj, n, &nbytes)) == 0) {
+				/* hand back whatever we could not place */
+				for (i = 0; i < n; ++i)
+					old[i] = obj[i];
+				errno = r;
+				return (n);
+			}
+			cirq_spsc_push(c, obj, room, nbytes);
+			obj += room;
+			n -= room;
+			if (n == 0)
+				return (0);
+		}
+	default:
+		break;
+	}
+	while (n > 0) {
+		ridx = spsc_load(&c->r.idx, ACQUIRE);
+		len = c->w.idx - ridx;
+		if (c->budget == 0) {
+			/* evict enough to make room for the rest */
+			want = n < c->size ? n : c->size;
+			evict = want > c->size - len ?
+			    want - (c->size - len) : 0;
+			if (cirq_spsc_evict(c, ridx, evict, old + nold) !=
+			    (size_t)-1)
+				nold += evict;
+		} else if (len > 0) {
+			/*
+			 * Evict enough to make room for the next object, but
+			 * if that would displace more objects than the caller
+			 * has room for, reject it instead.
+			 */
+			evict = cirq_spsc_excess(c, ridx, len, obj[0]);
+			if (nold + evict + n - 1 > norig) {
+				old[nold++] = *obj++;
+				n--;
+				spsc_add(&c->w.nput, 1);
+				spsc_add(&c->w.ndrop, 1);
+				continue;
+			}
+			if (cirq_spsc_evict(c, ridx, evict, old + nold) !=
+			    (size_t)-1)
+				nold += evict;
+		}
+		room = cirq_spsc_room(c, obj, n, &nbytes);
+		cirq_spsc_push(c, obj, room, nbytes);
+		obj += room;
+		n -= room;
+	}
+	return (nold);
+}
+
+/*
+ * Check whether there is room for an object of the given size in a
+ * locked cirq.  The caller must hold the mutex.
+ */
+static inline int
+cirq_locked_room(cirq *c, size_t sz)
+{
+
+	return (c->obj[c->widx] == NULL &&
+	    cirq_within_budget(c, c->bytes, sz));
+}
+
+/*
+ * Count how many of the oldest objects in a locked cirq would have to be
+ * displaced to make room for an object of the given size.  The caller
+ * must hold the mutex.
+ */
+static size_t
+cirq_locked_excess(cirq *c, size_t sz)
+{
+	size_t bytes, k, len;
+
+	len = cirq_locked_len(c);
+	bytes = c->bytes;
+	for (k = 0; k < len; ++k) {
+		if (len - k < c->size && cirq_within_budget(c, bytes, sz))
+			break;
+		bytes -= cirq_objsize(c, c->obj[(c->ridx + k) % c->size]);
+	}
+	return (k);
+}
+
+/*
+ * Place a single object of the given size onto a locked cirq.  The
+ * caller must hold the mutex and must have checked that there is room.
+ */
+static void
+cirq_locked_put(cirq *c, void *obj, size_t sz)
+{
+
+	assert(obj != NULL);
 	assert(c->ridx < c->size);
 	assert(c->widx < c->size);
-	idx = c->widx;
-	c->widx = (idx + 1) % c->size;
-	/* if the cirq is full, advance the read index */
-	if ((old = c->obj[idx]) != NULL) {
-		assert(c->ridx == idx);
-		c->ridx = c->widx;
-		c->ndrop++;
-	}
-	c->obj[idx] = obj;
+	assert(c->obj[c->widx] == NULL);
+	c->obj[c->widx] = obj;
+	c->widx = (c->widx + 1) % c->size;
+	c->bytes += sz;
 	c->nput++;
-	pthread_cond_signal(&c->cond);
+}
+
+/*
+ * Remove and return the oldest object in a locked cirq, or NULL if it
+ * is empty.  The caller must hold the mutex.
+ */
+static void *
+cirq_locked_take(cirq *c)
+{
+	void *obj;
+
+	assert(c->ridx < c->size);
+	assert(c->widx < c->size);
+	if ((obj = c->obj[c->ridx]) != NULL) {
+		c->obj[c->ridx] = NULL;
+		c->ridx = (c->ridx + 1) % c->size;
+		c->bytes -= cirq_objsize(c, obj);
+	}
+	return (obj);
+}
+
+/*
+ * Place multiple objects onto the cirq in a single operation.  What
+ * happens if the cirq is full depends on its overflow policy: the new
+ * objects either displace the oldest ones, are rejected, or wait for up
+ * to the specified amount of time (in microseconds) for room to become
+ * available.  Objects which were displaced, rejected, or could not be
+ * placed before the deadline are stored in the array pointed to by the
+ * fourth argument, which must have room for as many objects as are being
+ * placed, and their number is returned.  In the last case, errno is set
+ * to ETIMEDOUT, and the objects are stored in their original order so
+ * the caller can try again later.  If the cirq has a memory budget and
+ * making room for a new object would displace more objects than there
+ * is room for in that array, the new object is rejected instead.
+ */
+size_t
+cirq_put_batch(cirq *c, void * const *obj, size_t n, void **old,
+    unsigned int timeout)
+{
+	struct timespec ts;
+	size_t i, nold, sz;
+	int r;
+
+	assert(c != NULL);
+	assert(obj != NULL);
+	assert(old != NULL);
+	if (n == 0)
+		return (0);
+	if (c->flags & CIRQ_SPSC)
+		return (cirq_spsc_put(c, obj, n, old, timeout));
+	if (c->flags & CIRQ_BLOCK)
+		cirq_deadline(&ts, timeout);
+	pthread_mutex_lock(&c->mutex);
+	for (i = nold = 0; i < n; ++i) {
+		sz = cirq_objsize(c, obj[i]);
+		if (!cirq_locked_room(c, sz)) {
+			if (c->flags & CIRQ_DROP_NEWEST) {
+				old[nold++] = obj[i];
+				c->nput++;
+				c->ndrop++;
+				continue;
+			}
+			if (c->flags & CIRQ_BLOCK) {
+				pthread_cond_broadcast(&c->cond);
+				do {
+					r = pthread_cond_timedwait(&c->space,
+					    &c->mutex, &ts);
+				} while (r == 0 && !cirq_locked_room(c, sz));
+				if (!cirq_locked_room(c, sz)) {
+					/* hand back what we could not place */
+					while (i < n)
+						old[nold++] = obj[i++];
+					errno = r;
+					break;
+				}
+			}
+			/*
+			 * Displace as many of the oldest as necessary, unless
+			 * that is more than the caller has room for, in which
+			 * case we reject the new one instead.
+			 */
+			if (nold + cirq_locked_excess(c, sz) + n - i - 1 > n) {
+				old[nold++] = obj[i];
+				c->nput++;
+				c->ndrop++;
+				continue;
+			}
+			while (!cirq_locked_room(c, sz)) {
+				old[nold++] = cirq_locked_take(c);
+				c->ndrop++;
+			}
+		}
+		cirq_locked_put(c, obj[i], sz);
+	}
+	pthread_cond_broadcast(&c->cond);
 	pthread_mutex_unlock(&c->mutex);
-	return (old);
+	return (nold);
 }
 
 /*
- * Retrieve and return the oldest object in the cirq.  If the cirq is
- * empty, wait for the specified amount of time (in microseconds) for data
- * to arrive.  Returns NULL if the cirq is still empty after the
- * deadline or if an error occurs; errno will be ETIMEDOUT in the former
- * case and another non-zero value in the latter.
+ * Place an object onto the cirq.  If the cirq is full, the new object
+ * will displace the oldest one, be rejected, or wait for room, depending
+ * on the overflow policy.  Returns the displaced or rejected object, if
+ * any.
  */
 void *
-cirq_get(cirq *c, unsigned int timeout)
+cirq_put(cirq *c, void *obj)
+{
+	void *old;
+
+	assert(obj != NULL);
+	if (c->flags & CIRQ_BLOCK) {
+		while (cirq_put_batch(c, &obj, 1, &old, 1000000) > 0)
+			/* nothing */ ;
+		return (NULL);
+	}
+	return (cirq_put_batch(c, &obj, 1, &old, 0) > 0 ? old : NULL);
+}
+
+/*
+ * Lock-free variant of cirq_get_batch().  Losing the race for the read
+ * index means the producer displaced some of the objects we were about
+ * to take, so we simply try again with the ones that are left.
+ */
+static size_t
+cirq_spsc_get(cirq *c, void **obj, size_t max, unsigned int timeout)
 {
 	struct timespec ts;
-	void *obj;
+	uint64_t ridx;
+	size_t i, n, nbytes;
+	int r;
+
+	for (;;) {
+		ridx = spsc_load(&c->r.idx, ACQUIRE);
+		if ((n = spsc_load(&c->w.idx, ACQUIRE) - ridx) > 0) {
+			if (n > max)
+				n = max;
+			for (i = 0; i < n; ++i)
+				obj[i] = spsc_load(
+				    &c->obj[(ridx + i) & c->mask], RELAXED);
+			if (__atomic_compare_exchange_n(&c->r.idx, &ridx,
+			    ridx + n, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+				if (c->sizef != NULL) {
+					for (i = 0, nbytes = 0; i < n; ++i)
+						nbytes += c->sizef(obj[i]);
+					spsc_sub(&c->bytes, nbytes);
+				}
+				spsc_add(&c->r.nget, n);
+				if (spsc_load(&c->wparked, SEQ_CST)) {
+					pthread_mutex_lock(&c->mutex);
+					pthread_cond_signal(&c->space);
+					pthread_mutex_unlock(&c->mutex);
+				}
+				errno = 0;
+				return (n);
+			}
+			continue;
+		}
+		if (timeout == 0) {
+			errno = ETIMEDOUT;
+			return (0);
+		}
+		/* park until the producer signals or we time out */
+		cirq_deadline(&ts, timeout);
+		timeout = 0;
+		pthread_mutex_lock(&c->mutex);
+		spsc_store(&c->parked, 1, SEQ_CST);
+		r = 0;
+		while (r == 0 && spsc_load(&c->w.idx, SEQ_CST) ==
+		    spsc_load(&c->r.idx, RELAXED))
+			r = pthread_cond_timedwait(&c->cond, &c->mutex, &ts);
+		spsc_store(&c->parked, 0, RELAXED);
+		pthread_mutex_unlock(&c->mutex);
+		if (r != 0 && r != ETIMEDOUT) {
+			errno = r;
+			return (0);
+		}
+	}
+}
+
+/*
+ * Retrieve up to the specified number of objects from the cirq, oldest
+ * first, in a single operation.  If the cirq is empty, wait for the
+ * specified amount of time (in microseconds) for data to arrive.
+ * Returns the number of objects retrieved, which is zero if the cirq is
+ * still empty after the deadline or if an error occurs; errno will be
+ * ETIMEDOUT in the former case and another non-zero value in the latter.
+ */
+size_t
+cirq_get_batch(cirq *c, void **obj, size_t max, unsigned int timeout)
+{
+	struct timespec ts;
+	size_t n;
 	int r;
 
 	assert(c != NULL);
+	assert(obj != NULL);
+	assert(max > 0);
+	if (c->flags & CIRQ_SPSC)
+		return (cirq_spsc_get(c, obj, max, timeout));
 	pthread_mutex_lock(&c->mutex);
-	assert(c->ridx < c->size);
-	assert(c->widx < c->size);
 	r = 0;
 	if (c->obj[c->ridx] == NULL) {
 		assert(c->widx == c->ridx);
 		/* compute deadline */
-		clock_gettime(CLOCK_REALTIME, &ts);
-		ts.tv_sec += timeout / 1000000;
-		ts.tv_nsec += (timeout % 1000000) * 1000;
-		ts.tv_nsec %= 1000000000;
+		cirq_deadline(&ts, timeout);
 		/* loop until data appears or we time out */
 		do {
 			r = pthread_cond_timedwait(&c->cond, &c->mutex, &ts);
 		} while (r == 0 && c->obj[c->ridx] == NULL);
 	}
-	errno = r;
 	/* if data appeared, remove it and advance the read pointer */
-	if ((obj = c->obj[c->ridx]) != NULL) {
-		c->obj[c->ridx] = NULL;
-		c->ridx = (c->ridx + 1) % c->size;
-		c->nget++;
-	}
+	for (n = 0; n < max; ++n)
+		if ((obj[n] = cirq_locked_take(c)) == NULL)
+			break;
+	c->nget += n;
+	if (n > 0 && (c->flags & CIRQ_BLOCK))
+		pthread_cond_broadcast(&c->space);
 	pthread_mutex_unlock(&c->mutex);
-	return (obj);
+	errno = n > 0 ? 0 : r;
+	return (n);
+}
+
+/*
+ * Retrieve and return the oldest object in the cirq.  If the cirq is
+ * empty, wait for the specified amount of time (in microseconds) for data
+ * to arrive.  Returns NULL if the cirq is still empty after the
+ * deadline or if an error occurs; errno will be ETIMEDOUT in the former
+ * case and another non-zero value in the latter.
+ */
+void *
+cirq_get(cirq *c, unsigned int timeout)
+{
+	void *obj;
+
+	return (cirq_get_batch(c, &obj, 1, timeout) > 0 ? obj : NULL);
 }
 
 /*
@@ -197,6 +772,18 @@ cirq_stat(cirq *c, size_t *nput, size_t *nget, size_t *ndrop,
     int clear)
 {
 
+	if (c->flags & CIRQ_SPSC) {
+		if (clear) {
+			*nput = spsc_take(&c->w.nput);
+			*nget = spsc_take(&c->r.nget);
+			*ndrop = spsc_take(&c->w.ndrop);
+		} else {
+			*nput = spsc_load(&c->w.nput, RELAXED);
+			*nget = spsc_load(&c->r.nget, RELAXED);
+			*ndrop = spsc_load(&c->w.ndrop, RELAXED);
+		}
+		return;
+	}
 	pthread_mutex_lock(&c->mutex);
 	*nput = c->nput;
 	*nget = c->nget;
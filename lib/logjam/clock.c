@@ -0,0 +1,119 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <logjam/clock.h>
+
+/*
+ * Lines which do not carry a timestamp of their own are stamped with
+ * the time at which we read them.  Reading the clock for every line is
+ * not free, so depending on how precise the result needs to be, we can
+ * instead use the coarse clock, which is cheaper but only as precise as
+ * the kernel's tick, or read the clock once per batch of lines and
+ * stamp the entire batch with the same time.
+ */
+lj_clock_mode_t lj_clock_mode = LJ_CLOCK_PRECISE;
+
+#ifndef CLOCK_REALTIME_COARSE
+#define CLOCK_REALTIME_COARSE CLOCK_REALTIME
+#endif
+
+/*
+ * Time of the calling thread's current batch, or zero.
+ */
+static __thread uint64_t lj_clock_batch;
+
+static inline uint64_t
+lj_clock_read(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*
+ * Select a mode by name.
+ */
+int
+lj_clock_set_mode(const char *mode)
+{
+
+	if (strcmp(mode, "precise") == 0)
+		lj_clock_mode = LJ_CLOCK_PRECISE;
+	else if (strcmp(mode, "coarse") == 0)
+		lj_clock_mode = LJ_CLOCK_COARSE;
+	else if (strcmp(mode, "batch") == 0)
+		lj_clock_mode = LJ_CLOCK_BATCH;
+	else {
+		errno = EINVAL;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Start a new batch.  Readers call this before reading each batch of
+ * lines; it does nothing unless we are in batch mode.
+ */
+void
+lj_clock_tick(void)
+{
+
+	if (lj_clock_mode == LJ_CLOCK_BATCH)
+		lj_clock_batch = lj_clock_read(CLOCK_REALTIME);
+}
+
+/*
+ * Return the current time in microseconds since the epoch, as precisely
+ * as the mode calls for.
+ */
+uint64_t
+lj_clock_now(void)
+{
+
+	switch (lj_clock_mode) {
+	case LJ_CLOCK_BATCH:
+		if (lj_clock_batch == 0)
+			lj_clock_batch = lj_clock_read(CLOCK_REALTIME);
+		return (lj_clock_batch);
+	case LJ_CLOCK_COARSE:
+		return (lj_clock_read(CLOCK_REALTIME_COARSE));
+	default:
+		return (lj_clock_read(CLOCK_REALTIME));
+	}
+}
@@ -31,6 +31,8 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <string.h>
 #include <unistd.h>
@@ -59,3 +61,26 @@ lj_connect(const char *host, int port, int af)
 	freeaddrinfo(ais);
 	return (sd);
 }
+
+/*
+ * Start establishing a TCP connection to the specified address, without
+ * waiting for it to complete.  The socket is non-blocking; the caller
+ * should wait for it to become writable, then check SO_ERROR to find
+ * out whether the connection succeeded.
+ */
+int
+lj_connect_start(const struct addrinfo *ai)
+{
+	int err, sd;
+
+	if ((sd = socket(ai->ai_family, SOCK_STREAM, 0)) < 0)
+		return (-1);
+	if (fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK) == 0 &&
+	    (connect(sd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+	    errno == EINPROGRESS))
+		return (sd);
+	err = errno;
+	close(sd);
+	errno = err;
+	return (-1);
+}
@@ -0,0 +1,206 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LJ_EOL_SSE2 1
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LJ_EOL_AVX2 1
+#endif
+
+#include <logjam/eol.h>
+
+/*
+ * Line splitting: find the offsets of up to max newline characters in a
+ * buffer in a single pass, so a reader which has just filled its buffer
+ * can hand out the lines it contains without looking at each byte
+ * again.  The vector implementations compare a full register's worth of
+ * bytes against '\n' at a time and turn the result into a bit mask,
+ * which is then walked one set bit at a time.  The best implementation
+ * the CPU supports is selected the first time lj_eol_scan() is called.
+ */
+
+typedef size_t (*lj_eol_scan_f)(const char *, size_t, size_t, size_t *,
+    size_t);
+
+/*
+ * Scalar implementation, also used for the tail end of the buffer by
+ * the vector implementations.
+ */
+static size_t
+lj_eol_scalar(const char *buf, size_t i, size_t len, size_t *eol,
+    size_t max)
+{
+	const char *p;
+	size_t n;
+
+	for (n = 0; i < len && n < max; i = eol[n++] + 1) {
+		if ((p = memchr(buf + i, '\n', len - i)) == NULL)
+			break;
+		eol[n] = p - buf;
+	}
+	return (n);
+}
+
+#if LJ_EOL_SSE2
+static size_t
+lj_eol_sse2(const char *buf, size_t i, size_t len, size_t *eol,
+    size_t max)
+{
+	const __m128i nl = _mm_set1_epi8('\n');
+	unsigned int mask;
+	size_t n;
+
+	for (n = 0; i + 16 <= len && n < max; i += 16) {
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(nl,
+		    _mm_loadu_si128((const __m128i *)(buf + i))));
+		for (; mask != 0 && n < max; mask &= mask - 1)
+			eol[n++] = i + __builtin_ctz(mask);
+		if (mask != 0)
+			return (n);
+	}
+	return (n + lj_eol_scalar(buf, i, len, eol + n, max - n));
+}
+#endif
+
+#if LJ_EOL_AVX2
+__attribute__((__target__("avx2")))
+static size_t
+lj_eol_avx2(const char *buf, size_t i, size_t len, size_t *eol,
+    size_t max)
+{
+	const __m256i nl = _mm256_set1_epi8('\n');
+	unsigned int mask;
+	size_t n;
+
+	for (n = 0; i + 32 <= len && n < max; i += 32) {
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(nl,
+		    _mm256_loadu_si256((const __m256i *)(buf + i))));
+		for (; mask != 0 && n < max; mask &= mask - 1)
+			eol[n++] = i + __builtin_ctz(mask);
+		if (mask != 0)
+			return (n);
+	}
+	return (n + lj_eol_scalar(buf, i, len, eol + n, max - n));
+}
+
+static int
+lj_eol_have_avx2(void)
+{
+
+	__builtin_cpu_init();
+	return (__builtin_cpu_supports("avx2"));
+}
+#endif
+
+static const struct lj_eol_impl {
+	const char	*name;
+	lj_eol_scan_f	 scan;
+	int		(*supported)(void);
+} lj_eol_impls[] = {
+	/* in order of preference */
+#if LJ_EOL_AVX2
+	{ "avx2",	lj_eol_avx2,	lj_eol_have_avx2 },
+#endif
+#if LJ_EOL_SSE2
+	{ "sse2",	lj_eol_sse2,	NULL },
+#endif
+	{ "scalar",	lj_eol_scalar,	NULL },
+};
+
+#define LJ_EOL_NIMPL (sizeof lj_eol_impls / sizeof lj_eol_impls[0])
+
+static const struct lj_eol_impl *lj_eol_cur;
+
+/*
+ * Select the named implementation, or the best supported one if name is
+ * NULL.
+ */
+int
+lj_eol_select(const char *name)
+{
+	const struct lj_eol_impl *impl;
+
+	for (impl = lj_eol_impls; impl < lj_eol_impls + LJ_EOL_NIMPL; ++impl) {
+		if (name != NULL && strcmp(name, impl->name) != 0)
+			continue;
+		if (impl->supported != NULL && !impl->supported()) {
+			if (name == NULL)
+				continue;
+			errno = ENOTSUP;
+			return (-1);
+		}
+		__atomic_store_n(&lj_eol_cur, impl, __ATOMIC_RELAXED);
+		return (0);
+	}
+	errno = ENOENT;
+	return (-1);
+}
+
+/*
+ * Return the name of the selected implementation.
+ */
+const char *
+lj_eol_impl(void)
+{
+	const struct lj_eol_impl *impl;
+
+	if ((impl = __atomic_load_n(&lj_eol_cur, __ATOMIC_RELAXED)) == NULL) {
+		lj_eol_select(NULL);
+		impl = __atomic_load_n(&lj_eol_cur, __ATOMIC_RELAXED);
+	}
+	return (impl->name);
+}
+
+/*
+ * Store the offsets of up to max newlines between off and len in buf in
+ * eol, and return the number found.
+ */
+size_t
+lj_eol_scan(const char *buf, size_t off, size_t len, size_t *eol,
+    size_t max)
+{
+	const struct lj_eol_impl *impl;
+
+	if ((impl = __atomic_load_n(&lj_eol_cur, __ATOMIC_RELAXED)) == NULL) {
+		lj_eol_select(NULL);
+		impl = __atomic_load_n(&lj_eol_cur, __ATOMIC_RELAXED);
+	}
+	return (impl->scan(buf, off, len, eol, max));
+}
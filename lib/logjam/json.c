@@ -0,0 +1,155 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <logjam/json.h>
+
+/*
+ * Bytes which can't be copied straight into a JSON string: control
+ * characters, which must be escaped, the quote and backslash, and
+ * anything outside ASCII, which must be checked for valid UTF-8.
+ */
+#define LJ_JSON_SPECIAL(c)						\
+	((c) < 0x20 || (c) >= 0x80 || (c) == '"' || (c) == '\\')
+
+static const char lj_json_hex[] = "0123456789ABCDEF";
+
+/*
+ * Return the length of the well-formed UTF-8 sequence at the start of
+ * the buffer, or 0 if there isn't one.
+ */
+static size_t
+lj_json_utf8len(const uint8_t *s, size_t len)
+{
+	size_t n;
+
+	if (s[0] >= 0xc2 && s[0] <= 0xdf)
+		n = 2;
+	else if (s[0] >= 0xe0 && s[0] <= 0xef)
+		n = 3;
+	else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+		n = 4;
+	else
+		return (0);
+	if (n > len || (s[1] & 0xc0) != 0x80 ||
+	    (n > 2 && (s[2] & 0xc0) != 0x80) ||
+	    (n > 3 && (s[3] & 0xc0) != 0x80))
+		return (0);
+	/* overlong forms, surrogates, and code points above U+10FFFF */
+	if ((s[0] == 0xe0 && s[1] < 0xa0) ||
+	    (s[0] == 0xed && s[1] > 0x9f) ||
+	    (s[0] == 0xf0 && s[1] < 0x90) ||
+	    (s[0] == 0xf4 && s[1] > 0x8f))
+		return (0);
+	return (n);
+}
+
+/*
+ * Write a string as a quoted JSON string, escaping it the same way
+ * Jansson does, and return the number of bytes written, which is at
+ * most LJ_JSON_QUOTE_MAX(len).  The output is not NUL-terminated.
+ * Bytes which are not part of a valid UTF-8 sequence are replaced with
+ * U+FFFD rather than rejected, since log messages are not always well
+ * behaved and we would rather send something than nothing.
+ */
+size_t
+lj_json_quote(char *dst, const char *src, size_t len)
+{
+	const uint8_t *s = (const uint8_t *)src;
+	size_t i, j, n;
+	char *d = dst;
+
+	*d++ = '"';
+	for (i = 0; i < len; i += n) {
+		/* copy the longest run which needs no attention */
+		for (j = i; j < len && !LJ_JSON_SPECIAL(s[j]); ++j)
+			/* nothing */ ;
+		if (j > i) {
+			memcpy(d, s + i, j - i);
+			d += j - i;
+			if ((i = j) == len)
+				break;
+		}
+		n = 1;
+		switch (s[i]) {
+		case '"':
+		case '\\':
+			*d++ = '\\';
+			*d++ = s[i];
+			break;
+		case '\b':
+			*d++ = '\\';
+			*d++ = 'b';
+			break;
+		case '\f':
+			*d++ = '\\';
+			*d++ = 'f';
+			break;
+		case '\n':
+			*d++ = '\\';
+			*d++ = 'n';
+			break;
+		case '\r':
+			*d++ = '\\';
+			*d++ = 'r';
+			break;
+		case '\t':
+			*d++ = '\\';
+			*d++ = 't';
+			break;
+		default:
+			if (s[i] < 0x20) {
+				*d++ = '\\';
+				*d++ = 'u';
+				*d++ = '0';
+				*d++ = '0';
+				*d++ = lj_json_hex[s[i] >> 4];
+				*d++ = lj_json_hex[s[i] & 0xf];
+			} else if ((n = lj_json_utf8len(s + i, len - i)) > 0) {
+				memcpy(d, s + i, n);
+				d += n;
+			} else {
+				/* U+FFFD REPLACEMENT CHARACTER */
+				*d++ = (char)0xef;
+				*d++ = (char)0xbf;
+				*d++ = (char)0xbd;
+				n = 1;
+			}
+		}
+	}
+	*d++ = '"';
+	return (d - dst);
+}
@@ -0,0 +1,404 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <logjam/multire.h>
+#include <logjam/prefilter.h>
+
+/*
+ * A multire is a set of POSIX extended regular expressions which are
+ * matched against a line together, the first one to match winning.
+ *
+ * Trying each expression in turn gets slower with every expression
+ * added, so instead we extract the literals each expression requires
+ * (see lj_prefilter_compile()) and combine them all into a single
+ * Aho-Corasick automaton.  One pass over the line finds every literal
+ * it contains, and each literal found counts towards the expressions
+ * which require it.  Only the expressions which have all their
+ * literals, and those which have none, are candidates, and only
+ * candidates are handed to regexec().  With a catalogue of messages
+ * which mostly differ in their fixed text, there is usually exactly one
+ * candidate, however many expressions there are.
+ *
+ * Matching uses scratch space in the multire, so each thread needs its
+ * own.
+ */
+
+#define LJ_MULTIRE_NONE		UINT32_MAX
+
+typedef struct lj_multire_kw {
+	char		*str;
+	size_t		 len;
+	bool		 anchored;	/* must start the line */
+	uint32_t	 next;		/* next keyword ending in same state */
+	uint32_t	*pats;		/* expressions which require it */
+	unsigned int	 npats;
+	uint32_t	 seen;		/* generation in which it was seen */
+} lj_multire_kw;
+
+typedef struct lj_multire_pat {
+	regex_t		 re;
+	unsigned int	 nkws;		/* number of literals required */
+	unsigned int	 hits;		/* ...of which seen so far */
+	uint32_t	 gen;		/* generation hits belongs to */
+} lj_multire_pat;
+
+struct lj_multire {
+	lj_multire_pat	*pats;
+	unsigned int	 npats;
+	lj_multire_kw	*kws;
+	unsigned int	 nkws;
+	uint32_t	*always;	/* expressions with no literals */
+	unsigned int	 nalways;
+
+	/* automaton */
+	uint8_t		 cls[256];	/* byte to character class */
+	unsigned int	 ncls;
+	uint32_t	*delta;		/* state * ncls + class to state */
+	uint32_t	*out;		/* first keyword ending in state */
+	uint32_t	*dict;		/* nearest suffix state with output */
+	unsigned int	 nstates;
+
+	/* scratch */
+	uint32_t	 gen;
+	uint32_t	*cand;
+};
+
+lj_multire *
+lj_multire_create(void)
+{
+
+	return (calloc(1, sizeof(lj_multire)));
+}
+
+/*
+ * Find or add a keyword and note that the specified expression requires
+ * it.
+ */
+static int
+lj_multire_addkw(lj_multire *mr, const char *str, bool anchored,
+    uint32_t pat)
+{
+	lj_multire_kw *kw, *kws;
+	uint32_t *pats;
+	unsigned int i;
+
+	for (i = 0, kw = NULL; i < mr->nkws; ++i) {
+		if (mr->kws[i].anchored == anchored &&
+		    strcmp(mr->kws[i].str, str) == 0) {
+			kw = &mr->kws[i];
+			break;
+		}
+	}
+	if (kw == NULL) {
+		if ((kws = realloc(mr->kws,
+		    (mr->nkws + 1) * sizeof *kws)) == NULL)
+			return (-1);
+		mr->kws = kws;
+		kw = &kws[mr->nkws];
+		memset(kw, 0, sizeof *kw);
+		if ((kw->str = strdup(str)) == NULL)
+			return (-1);
+		kw->len = strlen(str);
+		kw->anchored = anchored;
+		mr->nkws++;
+	}
+	if ((pats = realloc(kw->pats, (kw->npats + 1) * sizeof *pats)) == NULL)
+		return (-1);
+	kw->pats = pats;
+	kw->pats[kw->npats++] = pat;
+	mr->pats[pat].nkws++;
+	return (0);
+}
+
+/*
+ * Add an expression, returning its index, or -1 if it could not be
+ * compiled.  Expressions are tried in the order in which they were
+ * added.
+ */
+int
+lj_multire_add(lj_multire *mr, const char *src)
+{
+	lj_multire_pat *pats;
+	lj_prefilter *pf;
+	const char *lit;
+	uint32_t *always;
+	unsigned int i;
+	int ret;
+
+	if (mr->delta != NULL) {
+		errno = EBUSY;
+		return (-1);
+	}
+	if ((pats = realloc(mr->pats, (mr->npats + 1) * sizeof *pats)) == NULL)
+		return (-1);
+	mr->pats = pats;
+	memset(&pats[mr->npats], 0, sizeof *pats);
+	if (regcomp(&pats[mr->npats].re, src, REG_EXTENDED) != 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if ((pf = lj_prefilter_compile(src)) == NULL)
+		goto fail;
+	ret = 0;
+	if ((lit = lj_prefilter_prefix(pf)) != NULL)
+		ret = lj_multire_addkw(mr, lit, true, mr->npats);
+	for (i = 0; ret == 0 && (lit = lj_prefilter_literal(pf, i)) != NULL;
+	     ++i)
+		ret = lj_multire_addkw(mr, lit, false, mr->npats);
+	lj_prefilter_destroy(pf);
+	if (ret != 0)
+		goto fail;
+	if (pats[mr->npats].nkws == 0) {
+		if ((always = realloc(mr->always,
+		    (mr->nalways + 1) * sizeof *always)) == NULL)
+			goto fail;
+		mr->always = always;
+		mr->always[mr->nalways++] = mr->npats;
+	}
+	return (mr->npats++);
+fail:
+	/* the next expression gets this slot, so forget about this one */
+	for (i = 0; i < mr->nkws; ++i)
+		while (mr->kws[i].npats > 0 &&
+		    mr->kws[i].pats[mr->kws[i].npats - 1] == mr->npats)
+			mr->kws[i].npats--;
+	regfree(&pats[mr->npats].re);
+	return (-1);
+}
+
+/*
+ * Build the automaton, once every expression has been added and before
+ * the first match.  Only bytes which occur in some keyword get a
+ * character class of their own, which keeps the transition table
+ * small.  Every state has a transition for every class, so matching
+ * never has to follow failure links.
+ */
+int
+lj_multire_compile(lj_multire *mr)
+{
+	uint32_t *delta, *out, *dict, *fail, *queue;
+	unsigned int i, c, maxstates, nstates, qh, qt;
+	const unsigned char *p;
+	uint32_t s, t;
+
+	/* character classes; class 0 is everything else */
+	memset(mr->cls, 0, sizeof mr->cls);
+	mr->ncls = 1;
+	for (i = 0, maxstates = 1; i < mr->nkws; ++i) {
+		for (p = (const unsigned char *)mr->kws[i].str; *p; ++p)
+			if (mr->cls[*p] == 0)
+				mr->cls[*p] = mr->ncls++;
+		maxstates += mr->kws[i].len;
+	}
+	delta = malloc(maxstates * mr->ncls * sizeof *delta);
+	out = malloc(maxstates * sizeof *out);
+	dict = malloc(maxstates * sizeof *dict);
+	fail = malloc(maxstates * sizeof *fail);
+	queue = malloc(maxstates * sizeof *queue);
+	mr->cand = malloc((mr->npats + 1) * sizeof *mr->cand);
+	if (delta == NULL || out == NULL || dict == NULL || fail == NULL ||
+	    queue == NULL || mr->cand == NULL)
+		goto fail;
+	memset(delta, 0xff, maxstates * mr->ncls * sizeof *delta);
+
+	/* trie */
+	out[0] = LJ_MULTIRE_NONE;
+	nstates = 1;
+	for (i = 0; i < mr->nkws; ++i) {
+		s = 0;
+		for (p = (const unsigned char *)mr->kws[i].str; *p; ++p) {
+			t = delta[s * mr->ncls + mr->cls[*p]];
+			if (t == LJ_MULTIRE_NONE) {
+				t = nstates++;
+				out[t] = LJ_MULTIRE_NONE;
+				delta[s * mr->ncls + mr->cls[*p]] = t;
+			}
+			s = t;
+		}
+		mr->kws[i].next = out[s];
+		out[s] = i;
+	}
+
+	/* failure links, breadth first, turned into transitions */
+	qh = qt = 0;
+	dict[0] = LJ_MULTIRE_NONE;
+	for (c = 0; c < mr->ncls; ++c) {
+		if ((t = delta[c]) == LJ_MULTIRE_NONE) {
+			delta[c] = 0;
+		} else {
+			fail[t] = 0;
+			dict[t] = LJ_MULTIRE_NONE;
+			queue[qt++] = t;
+		}
+	}
+	while (qh < qt) {
+		s = queue[qh++];
+		for (c = 0; c < mr->ncls; ++c) {
+			t = delta[s * mr->ncls + c];
+			if (t == LJ_MULTIRE_NONE) {
+				delta[s * mr->ncls + c] =
+				    delta[fail[s] * mr->ncls + c];
+				continue;
+			}
+			fail[t] = delta[fail[s] * mr->ncls + c];
+			dict[t] = out[fail[t]] != LJ_MULTIRE_NONE ?
+			    fail[t] : dict[fail[t]];
+			queue[qt++] = t;
+		}
+	}
+	free(queue);
+	free(fail);
+	mr->delta = delta;
+	mr->out = out;
+	mr->dict = dict;
+	mr->nstates = nstates;
+	return (0);
+fail:
+	free(queue);
+	free(fail);
+	free(dict);
+	free(out);
+	free(delta);
+	free(mr->cand);
+	mr->cand = NULL;
+	return (-1);
+}
+
+/*
+ * Note that a keyword was seen, and add any expression for which it was
+ * the last missing piece to the candidates.
+ */
+static inline void
+lj_multire_hit(lj_multire *mr, lj_multire_kw *kw, unsigned int *ncand)
+{
+	lj_multire_pat *pat;
+	unsigned int i;
+
+	if (kw->seen == mr->gen)
+		return;
+	kw->seen = mr->gen;
+	for (i = 0; i < kw->npats; ++i) {
+		pat = &mr->pats[kw->pats[i]];
+		if (pat->gen != mr->gen) {
+			pat->gen = mr->gen;
+			pat->hits = 0;
+		}
+		if (++pat->hits == pat->nkws)
+			mr->cand[(*ncand)++] = kw->pats[i];
+	}
+}
+
+/*
+ * Match a line against every expression, and return the index of the
+ * first which matches, with its subexpressions in pmatch as regexec()
+ * would report them, or -1 if none does.  If ncand is not NULL, the
+ * number of candidates tried is stored there; zero means the line was
+ * rejected without running a single regexec().
+ */
+int
+lj_multire_match(lj_multire *mr, const char *str, size_t len,
+    size_t nmatch, regmatch_t *pmatch, unsigned int *ncand)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	unsigned int i, j, n;
+	lj_multire_kw *kw;
+	uint32_t k, s, t;
+
+	if (++mr->gen == 0) {
+		/* wrapped around, start over */
+		for (i = 0; i < mr->nkws; ++i)
+			mr->kws[i].seen = 0;
+		for (i = 0; i < mr->npats; ++i)
+			mr->pats[i].gen = 0;
+		mr->gen = 1;
+	}
+	n = 0;
+	for (i = 0, s = 0; i < len; ++i) {
+		s = mr->delta[s * mr->ncls + mr->cls[p[i]]];
+		t = mr->out[s] != LJ_MULTIRE_NONE ? s : mr->dict[s];
+		for (; t != LJ_MULTIRE_NONE; t = mr->dict[t]) {
+			for (k = mr->out[t]; k != LJ_MULTIRE_NONE;
+			     k = kw->next) {
+				kw = &mr->kws[k];
+				if (!kw->anchored || i + 1 == kw->len)
+					lj_multire_hit(mr, kw, &n);
+			}
+		}
+	}
+	/* try the candidates, and those we can't filter, in order */
+	for (i = 0; i < mr->nalways; ++i)
+		mr->cand[n++] = mr->always[i];
+	for (i = 1; i < n; ++i)
+		for (j = i; j > 0 && mr->cand[j - 1] > mr->cand[j]; --j) {
+			k = mr->cand[j];
+			mr->cand[j] = mr->cand[j - 1];
+			mr->cand[j - 1] = k;
+		}
+	if (ncand != NULL)
+		*ncand = n;
+	for (i = 0; i < n; ++i)
+		if (regexec(&mr->pats[mr->cand[i]].re, str, nmatch, pmatch,
+		    0) == 0)
+			return (mr->cand[i]);
+	return (-1);
+}
+
+void
+lj_multire_destroy(lj_multire *mr)
+{
+	unsigned int i;
+
+	if (mr == NULL)
+		return;
+	for (i = 0; i < mr->npats; ++i)
+		regfree(&mr->pats[i].re);
+	for (i = 0; i < mr->nkws; ++i) {
+		free(mr->kws[i].pats);
+		free(mr->kws[i].str);
+	}
+	free(mr->pats);
+	free(mr->kws);
+	free(mr->always);
+	free(mr->delta);
+	free(mr->out);
+	free(mr->dict);
+	free(mr->cand);
+	free(mr);
+}
@@ -0,0 +1,232 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+#include <logjam/log.h>
+#include <logjam/pcreset.h>
+
+typedef struct lj_pcreset_group {
+	const char	*name;		/* points into the name table */
+	uint32_t	 group;
+} lj_pcreset_group;
+
+typedef struct lj_pcreset_pat {
+	char		*src;
+	pcre2_code	*code;
+	pcre2_match_data *md;
+	bool		 jit;
+	lj_pcreset_group *groups;
+	unsigned int	 ngroups;
+} lj_pcreset_pat;
+
+struct lj_pcreset {
+	lj_pcreset_pat	*pats;
+	unsigned int	 npats;
+};
+
+lj_pcreset *
+lj_pcreset_create(void)
+{
+
+	return (calloc(1, sizeof(lj_pcreset)));
+}
+
+static void
+lj_pcreset_pat_free(lj_pcreset_pat *pat)
+{
+
+	free(pat->groups);
+	if (pat->md != NULL)
+		pcre2_match_data_free(pat->md);
+	if (pat->code != NULL)
+		pcre2_code_free(pat->code);
+	free(pat->src);
+}
+
+/*
+ * Compile a pattern, JIT-compile it if possible, and map its named
+ * subexpressions to fields.
+ */
+static int
+lj_pcreset_pat_init(lj_pcreset_pat *pat, const char *src)
+{
+	PCRE2_UCHAR msg[128];
+	PCRE2_SIZE erroff;
+	PCRE2_SPTR table;
+	uint32_t i, n, size;
+	int errcode;
+
+	memset(pat, 0, sizeof *pat);
+	if ((pat->src = strdup(src)) == NULL)
+		goto fail;
+	if ((pat->code = pcre2_compile((PCRE2_SPTR)src, PCRE2_ZERO_TERMINATED,
+	    0, &errcode, &erroff, NULL)) == NULL) {
+		pcre2_get_error_message(errcode, msg, sizeof msg);
+		lj_error("regex: %s at offset %zu in %s", (char *)msg,
+		    (size_t)erroff, src);
+		goto fail;
+	}
+	pat->jit = pcre2_jit_compile(pat->code, PCRE2_JIT_COMPLETE) == 0;
+	if ((pat->md = pcre2_match_data_create_from_pattern(pat->code,
+	    NULL)) == NULL)
+		goto fail;
+	/* each name table entry is a big-endian group number and a name */
+	if (pcre2_pattern_info(pat->code, PCRE2_INFO_NAMECOUNT, &n) != 0 ||
+	    pcre2_pattern_info(pat->code, PCRE2_INFO_NAMEENTRYSIZE,
+	    &size) != 0 ||
+	    pcre2_pattern_info(pat->code, PCRE2_INFO_NAMETABLE, &table) != 0)
+		goto fail;
+	if (n == 0) {
+		lj_error("regex: no named subexpressions in %s", src);
+		goto fail;
+	}
+	if (n > LJ_PCRESET_MAX_FIELDS) {
+		lj_error("regex: more than %d named subexpressions in %s",
+		    LJ_PCRESET_MAX_FIELDS, src);
+		goto fail;
+	}
+	if ((pat->groups = calloc(n, sizeof *pat->groups)) == NULL)
+		goto fail;
+	for (i = 0; i < n; ++i, table += size) {
+		pat->groups[i].group = table[0] << 8 | table[1];
+		pat->groups[i].name = (const char *)table + 2;
+		if (strcmp(pat->groups[i].name, "timestamp") == 0) {
+			lj_error("regex: timestamp is a reserved name");
+			goto fail;
+		}
+	}
+	pat->ngroups = n;
+	return (0);
+fail:
+	lj_pcreset_pat_free(pat);
+	return (-1);
+}
+
+/*
+ * Add a pattern to the end of the list.  Returns its index, or -1 if it
+ * could not be compiled or has no named subexpressions.
+ */
+int
+lj_pcreset_add(lj_pcreset *ps, const char *src)
+{
+	lj_pcreset_pat *pats;
+
+	if ((pats = realloc(ps->pats, (ps->npats + 1) * sizeof *pats)) == NULL)
+		return (-1);
+	ps->pats = pats;
+	if (lj_pcreset_pat_init(&pats[ps->npats], src) != 0)
+		return (-1);
+	return (ps->npats++);
+}
+
+unsigned int
+lj_pcreset_count(const lj_pcreset *ps)
+{
+
+	return (ps->npats);
+}
+
+/*
+ * Return the source of the specified pattern.
+ */
+const char *
+lj_pcreset_pattern(const lj_pcreset *ps, unsigned int i)
+{
+
+	return (i < ps->npats ? ps->pats[i].src : NULL);
+}
+
+/*
+ * Try each pattern in turn against a string.  If one matches, return its
+ * index, and fill in the fields array, which must have room for
+ * LJ_PCRESET_MAX_FIELDS elements, and the number of fields.  Named
+ * subexpressions which did not participate in the match are left out.
+ * Returns -1 if no pattern matches.
+ */
+int
+lj_pcreset_match(lj_pcreset *ps, const char *str, size_t len,
+    lj_pcreset_field *fields, unsigned int *nfields)
+{
+	lj_pcreset_pat *pat;
+	PCRE2_SIZE *ov;
+	unsigned int i, n;
+	uint32_t g;
+	int ret;
+
+	for (i = 0, ret = PCRE2_ERROR_NOMATCH; i < ps->npats; ++i) {
+		pat = &ps->pats[i];
+		if (pat->jit)
+			ret = pcre2_jit_match(pat->code, (PCRE2_SPTR)str, len,
+			    0, 0, pat->md, NULL);
+		else
+			ret = pcre2_match(pat->code, (PCRE2_SPTR)str, len,
+			    0, 0, pat->md, NULL);
+		if (ret > 0)
+			break;
+	}
+	if (ret <= 0)
+		return (-1);
+	ov = pcre2_get_ovector_pointer(pat->md);
+	for (i = n = 0; i < pat->ngroups; ++i) {
+		/* skip subexpressions which did not participate */
+		g = pat->groups[i].group;
+		if (g >= (uint32_t)ret || ov[2 * g] == PCRE2_UNSET)
+			continue;
+		fields[n].name = pat->groups[i].name;
+		fields[n].off = ov[2 * g];
+		fields[n].len = ov[2 * g + 1] - ov[2 * g];
+		n++;
+	}
+	*nfields = n;
+	return (pat - ps->pats);
+}
+
+void
+lj_pcreset_destroy(lj_pcreset *ps)
+{
+	unsigned int i;
+
+	if (ps == NULL)
+		return;
+	for (i = 0; i < ps->npats; ++i)
+		lj_pcreset_pat_free(&ps->pats[i]);
+	free(ps->pats);
+	free(ps);
+}
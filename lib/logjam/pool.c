@@ -0,0 +1,220 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <logjam/pool.h>
+
+/*
+ * An object pool hands out fixed-size objects to a single owner thread,
+ * which passes them down the pipeline.  Objects are returned to their
+ * home pool by whichever thread is done with them, so returned objects
+ * are pushed onto a lock-free stack.  Only the owner pops from it, and
+ * it takes the entire stack at once, so there is no ABA problem.
+ *
+ * The pool itself is reference counted: the owner holds one reference
+ * and every object which is out of the pool holds another, so the pool
+ * outlives its owner until every object has come back.
+ *
+ * New objects are zero-filled, but objects are not cleared when they are
+ * recycled.  Users may keep state in them across trips through the pool,
+ * and supply a function to tear it down when the pool finally frees
+ * them.
+ */
+struct lj_pool {
+	lj_pool_obj	*returned;	/* shared */
+	lj_pool_obj	*free;		/* owner only */
+	unsigned long	 refs;
+	size_t		 size;
+	size_t		 align;
+	lj_pool_fini_f	 fini;
+	size_t		 nget;		/* objects handed out */
+	size_t		 nalloc;	/* ...of which newly allocated */
+	size_t		 nput;		/* objects returned */
+};
+
+/*
+ * Free every object on a list.
+ */
+static void
+lj_pool_free_list(lj_pool *pool, lj_pool_obj *obj)
+{
+	lj_pool_obj *next;
+
+	for (; obj != NULL; obj = next) {
+		next = obj->next;
+		if (pool->fini != NULL)
+			pool->fini(obj);
+		free(obj);
+	}
+}
+
+/*
+ * Drop a reference to a pool, and free it and all the objects in it if
+ * that was the last one.
+ */
+static void
+lj_pool_unref(lj_pool *pool)
+{
+
+	if (__atomic_sub_fetch(&pool->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+	lj_pool_free_list(pool, pool->free);
+	lj_pool_free_list(pool, __atomic_exchange_n(&pool->returned, NULL,
+	    __ATOMIC_ACQUIRE));
+	free(pool);
+}
+
+/*
+ * Create a pool of objects of the specified size and alignment (zero
+ * for the default), with an optional function to call on each object
+ * before it is freed.
+ */
+lj_pool *
+lj_pool_create(size_t size, size_t align, lj_pool_fini_f fini)
+{
+	lj_pool *pool;
+
+	if (size < sizeof(lj_pool_obj) ||
+	    (align & (align - 1)) != 0 || align % sizeof(void *) != 0) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	if ((pool = calloc(1, sizeof *pool)) == NULL)
+		return (NULL);
+	pool->refs = 1;
+	pool->size = size;
+	pool->align = align;
+	pool->fini = fini;
+	return (pool);
+}
+
+/*
+ * Give up ownership of a pool.  Objects which are still out will be
+ * freed when they are returned.
+ */
+void
+lj_pool_destroy(lj_pool *pool)
+{
+
+	if (pool == NULL)
+		return;
+	lj_pool_free_list(pool, pool->free);
+	pool->free = NULL;
+	lj_pool_unref(pool);
+}
+
+/*
+ * Get an object from the pool, or allocate a new one if none are free.
+ * Must only be called by the pool's owner.
+ */
+void *
+lj_pool_get(lj_pool *pool)
+{
+	lj_pool_obj *obj;
+	void *p;
+	int ret;
+
+	if (pool->free == NULL)
+		pool->free = __atomic_exchange_n(&pool->returned, NULL,
+		    __ATOMIC_ACQUIRE);
+	if ((obj = pool->free) != NULL) {
+		pool->free = obj->next;
+	} else {
+		if (pool->align == 0) {
+			if ((p = calloc(1, pool->size)) == NULL)
+				return (NULL);
+		} else {
+			if ((ret = posix_memalign(&p, pool->align,
+			    pool->size)) != 0) {
+				errno = ret;
+				return (NULL);
+			}
+			memset(p, 0, pool->size);
+		}
+		obj = p;
+		obj->pool = pool;
+		__atomic_add_fetch(&pool->nalloc, 1, __ATOMIC_RELAXED);
+	}
+	obj->next = NULL;
+	__atomic_add_fetch(&pool->nget, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&pool->refs, 1, __ATOMIC_RELAXED);
+	return (obj);
+}
+
+/*
+ * Return an object to its home pool.  May be called by any thread.
+ * Objects which do not belong to a pool are simply freed.
+ */
+void
+lj_pool_put(void *p)
+{
+	lj_pool_obj *obj = p;
+	lj_pool *pool;
+
+	if ((pool = obj->pool) == NULL) {
+		free(obj);
+		return;
+	}
+	__atomic_add_fetch(&pool->nput, 1, __ATOMIC_RELAXED);
+	obj->next = __atomic_load_n(&pool->returned, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&pool->returned, &obj->next,
+	    obj, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		/* nothing */ ;
+	lj_pool_unref(pool);
+}
+
+/*
+ * Report how many objects have been handed out, how many of those had
+ * to be allocated, and how many have been returned, and optionally
+ * reset the counters.
+ */
+void
+lj_pool_stat(lj_pool *pool, size_t *nget, size_t *nalloc, size_t *nput,
+    int clear)
+{
+
+	if (clear) {
+		*nget = __atomic_exchange_n(&pool->nget, 0, __ATOMIC_RELAXED);
+		*nalloc = __atomic_exchange_n(&pool->nalloc, 0,
+		    __ATOMIC_RELAXED);
+		*nput = __atomic_exchange_n(&pool->nput, 0, __ATOMIC_RELAXED);
+	} else {
+		*nget = __atomic_load_n(&pool->nget, __ATOMIC_RELAXED);
+		*nalloc = __atomic_load_n(&pool->nalloc, __ATOMIC_RELAXED);
+		*nput = __atomic_load_n(&pool->nput, __ATOMIC_RELAXED);
+	}
+}
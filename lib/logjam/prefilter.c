@@ -0,0 +1,324 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <logjam/prefilter.h>
+
+#define LJ_PREFILTER_MAXLIT	8
+
+typedef struct lj_prefilter_lit {
+	char		*str;
+	size_t		 len;
+	size_t		 key;		/* offset of the rarest character */
+} lj_prefilter_lit;
+
+struct lj_prefilter {
+	lj_prefilter_lit prefix;
+	lj_prefilter_lit lit[LJ_PREFILTER_MAXLIT];
+	unsigned int	 nlit;
+};
+
+/*
+ * Skip a bracket expression, returning a pointer to the closing bracket,
+ * or NULL if there is none.
+ */
+static const char *
+lj_prefilter_bracket(const char *p)
+{
+	char end[3];
+
+	/* skip the opening bracket, a negation and a leading bracket */
+	if (*++p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	for (; *p != '\0' && *p != ']'; ++p) {
+		/* [:class:], [=equiv=] and [.coll.] may contain ']' */
+		if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+			end[0] = p[1];
+			end[1] = ']';
+			end[2] = '\0';
+			if ((p = strstr(p + 2, end)) == NULL)
+				return (NULL);
+			p++;
+		}
+	}
+	return (*p == ']' ? p : NULL);
+}
+
+/*
+ * Pick the character in a literal which is least likely to occur in a
+ * log line, so we can look for it with memchr() and get few false hits.
+ */
+static size_t
+lj_prefilter_key(const char *str, size_t len)
+{
+	size_t i, key;
+	int best, rank;
+
+	for (i = key = 0, best = -1; i < len; ++i) {
+		if (str[i] == ' ')
+			rank = 0;
+		else if (strchr("etaoinshr", str[i]) != NULL)
+			rank = 1;
+		else if (str[i] >= 'a' && str[i] <= 'z')
+			rank = 2;
+		else if (str[i] >= '0' && str[i] <= '9')
+			rank = 3;
+		else
+			rank = 4;
+		if (rank > best) {
+			best = rank;
+			key = i;
+		}
+	}
+	return (key);
+}
+
+/*
+ * Look for a literal in a line.
+ */
+static int
+lj_prefilter_find(const lj_prefilter_lit *lit, const char *str, size_t len)
+{
+	const char *p, *end;
+
+	if (len < lit->len)
+		return (-1);
+	end = str + len - (lit->len - lit->key - 1);
+	for (p = str + lit->key; p < end; ++p) {
+		if ((p = memchr(p, lit->str[lit->key], end - p)) == NULL)
+			return (-1);
+		if (memcmp(p - lit->key, lit->str, lit->len) == 0)
+			return (0);
+	}
+	return (-1);
+}
+
+/*
+ * Record a run of literal characters, either as the prefix or as one of
+ * the literals which must appear somewhere after it.
+ */
+static int
+lj_prefilter_add(lj_prefilter *pf, const char *run, size_t len, int prefix)
+{
+	lj_prefilter_lit *lit;
+	unsigned int i;
+
+	if (prefix) {
+		lit = &pf->prefix;
+	} else {
+		/* single characters don't buy us much */
+		if (len < 2)
+			return (0);
+		for (i = 0; i < pf->nlit; ++i)
+			if (pf->lit[i].len == len &&
+			    memcmp(pf->lit[i].str, run, len) == 0)
+				return (0);
+		/* keep the longest, which are likely the most selective */
+		if (pf->nlit == LJ_PREFILTER_MAXLIT) {
+			if (pf->lit[pf->nlit - 1].len >= len)
+				return (0);
+			free(pf->lit[--pf->nlit].str);
+		}
+		for (i = pf->nlit; i > 0 && pf->lit[i - 1].len < len; --i)
+			pf->lit[i] = pf->lit[i - 1];
+		lit = &pf->lit[i];
+		pf->nlit++;
+	}
+	if ((lit->str = malloc(len + 1)) == NULL) {
+		lit->len = 0;
+		return (-1);
+	}
+	memcpy(lit->str, run, len);
+	lit->str[len] = '\0';
+	lit->len = len;
+	lit->key = lj_prefilter_key(run, len);
+	return (0);
+}
+
+/*
+ * Extract from a POSIX extended regular expression the literal strings
+ * which any line it matches must contain: the text which immediately
+ * follows a leading "^", if any, and any other run of literals outside
+ * parenthesized subexpressions and bracket expressions.
+ *
+ * This is deliberately conservative.  An expression which contains
+ * top-level alternation yields a prefilter which accepts everything,
+ * and so does one we don't understand.  The expression is assumed to be
+ * compiled without REG_ICASE.
+ */
+lj_prefilter *
+lj_prefilter_compile(const char *re)
+{
+	lj_prefilter *pf;
+	const char *p, *q;
+	char *run;
+	size_t len;
+	int depth, prefix;
+
+	if ((pf = calloc(1, sizeof *pf)) == NULL)
+		return (NULL);
+	if ((run = malloc(strlen(re) + 1)) == NULL)
+		goto fail;
+	len = 0;
+	depth = 0;
+	if ((prefix = (*re == '^')))
+		re++;
+#define FLUSH() do {							\
+		if (len > 0 && lj_prefilter_add(pf, run, len, prefix) != 0) \
+			goto fail;					\
+		len = prefix = 0;					\
+	} while (0)
+	for (p = re; *p != '\0'; ++p) {
+		if (*p == '[') {
+			FLUSH();
+			if ((p = lj_prefilter_bracket(p)) == NULL)
+				goto accept;
+			continue;
+		}
+		if (*p == '\\') {
+			if (p[1] == '\0')
+				goto accept;
+			if (depth == 0)
+				run[len++] = p[1];
+			p++;
+			continue;
+		}
+		if (*p == '(') {
+			FLUSH();
+			depth++;
+			continue;
+		}
+		if (depth > 0) {
+			if (*p == ')')
+				depth--;
+			continue;
+		}
+		switch (*p) {
+		case '|':
+			goto accept;
+		case '*':
+		case '?':
+		case '{':
+			/* the preceding character is optional */
+			if (len > 0)
+				len--;
+			FLUSH();
+			if (*p == '{' && (q = strchr(p, '}')) != NULL)
+				p = q;
+			break;
+		case '+':
+			/* the preceding character is required but may repeat */
+			FLUSH();
+			break;
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+			FLUSH();
+			break;
+		default:
+			run[len++] = *p;
+		}
+	}
+	FLUSH();
+#undef FLUSH
+	free(run);
+	return (pf);
+accept:
+	/* we don't know what to look for */
+	free(run);
+	lj_prefilter_destroy(pf);
+	return (calloc(1, sizeof *pf));
+fail:
+	free(run);
+	lj_prefilter_destroy(pf);
+	return (NULL);
+}
+
+void
+lj_prefilter_destroy(lj_prefilter *pf)
+{
+	unsigned int i;
+
+	if (pf == NULL)
+		return;
+	free(pf->prefix.str);
+	for (i = 0; i < pf->nlit; ++i)
+		free(pf->lit[i].str);
+	free(pf);
+}
+
+/*
+ * The literal a line must start with, or NULL if there is none.
+ */
+const char *
+lj_prefilter_prefix(const lj_prefilter *pf)
+{
+
+	return (pf->prefix.str);
+}
+
+/*
+ * The nth literal a line must contain after the prefix, or NULL if there
+ * are fewer than n + 1 of them.  They are sorted by decreasing length.
+ */
+const char *
+lj_prefilter_literal(const lj_prefilter *pf, unsigned int n)
+{
+
+	return (n < pf->nlit ? pf->lit[n].str : NULL);
+}
+
+/*
+ * Check whether a line could match the expression the prefilter was
+ * compiled from.  Returns 0 if it could and -1 if it definitely does
+ * not.
+ */
+int
+lj_prefilter_match(const lj_prefilter *pf, const char *str, size_t len)
+{
+	unsigned int i;
+	size_t plen;
+
+	plen = pf->prefix.len;
+	if (plen > 0 && (len < plen || memcmp(str, pf->prefix.str, plen) != 0))
+		return (-1);
+	for (i = 0; i < pf->nlit; ++i)
+		if (lj_prefilter_find(&pf->lit[i], str + plen, len - plen) != 0)
+			return (-1);
+	return (0);
+}
@@ -0,0 +1,136 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <logjam/ring.h>
+
+/*
+ * Create an anonymous file to back the ring.
+ */
+static int
+lj_ring_file(size_t size)
+{
+	char fn[PATH_MAX];
+	const char *tmpdir;
+	int fd, serrno;
+
+#if HAVE_MEMFD_CREATE
+	if ((fd = memfd_create("logjam-ring", MFD_CLOEXEC)) >= 0)
+		goto done;
+#endif
+	if ((tmpdir = getenv("TMPDIR")) == NULL || *tmpdir == '\0')
+		tmpdir = "/tmp";
+	if (snprintf(fn, sizeof fn, "%s/logjam-ring.XXXXXX", tmpdir) >=
+	    (int)sizeof fn) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	if ((fd = mkstemp(fn)) < 0)
+		return (-1);
+	unlink(fn);
+#if HAVE_MEMFD_CREATE
+done:
+#endif
+	if (ftruncate(fd, size) != 0) {
+		serrno = errno;
+		close(fd);
+		errno = serrno;
+		return (-1);
+	}
+	return (fd);
+}
+
+/*
+ * Set up a ring of at least the requested size, rounded up to a multiple
+ * of the page size.
+ *
+ * We first reserve an address range twice the size of the ring, then map
+ * the same file into both halves of it.
+ */
+int
+lj_ring_init(lj_ring *ring, size_t size)
+{
+	size_t pgsz;
+	char *base;
+	int fd, serrno;
+
+	pgsz = sysconf(_SC_PAGESIZE);
+	if (size == 0 || size > SIZE_MAX / 2 - pgsz) {
+		errno = EINVAL;
+		return (-1);
+	}
+	size = (size + pgsz - 1) / pgsz * pgsz;
+	if ((fd = lj_ring_file(size)) < 0)
+		return (-1);
+	base = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (base == MAP_FAILED)
+		goto fail;
+	if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+	    fd, 0) == MAP_FAILED ||
+	    mmap(base + size, size, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		serrno = errno;
+		munmap(base, size * 2);
+		errno = serrno;
+		goto fail;
+	}
+	close(fd);
+	ring->base = base;
+	ring->size = size;
+	return (0);
+fail:
+	serrno = errno;
+	close(fd);
+	errno = serrno;
+	return (-1);
+}
+
+/*
+ * Release a ring.
+ */
+void
+lj_ring_fini(lj_ring *ring)
+{
+
+	if (ring->base != NULL)
+		munmap(ring->base, ring->size * 2);
+	ring->base = NULL;
+	ring->size = 0;
+}
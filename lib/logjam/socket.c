@@ -31,11 +31,17 @@
 #include "config.h"
 #endif
 
+#include <sys/socket.h>
+
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #if HAVE_GNUTLS
@@ -43,13 +49,44 @@
 #endif
 
 #include <logjam/connect.h>
+#include <logjam/resolve.h>
 #include <logjam/socket.h>
 #include <logjam/strlcpy.h>
 
+/*
+ * Connections are established in the background: sock_advance() starts
+ * a non-blocking connect, then drives the TLS handshake, waiting only
+ * as long as the caller allows each time.  Each stage has a timeout.
+ * If connecting to one of the target's addresses fails, we move on to
+ * the next; once we run out of addresses, or the handshake fails, the
+ * next attempt is preceded by an exponentially increasing, randomized
+ * delay, which is only reset once we have successfully written to the
+ * connection.  Once the connection is up, the socket is switched back
+ * to blocking mode.
+ */
+#define LJ_SOCK_CONNECT_TIMEOUT		10000	/* ms */
+#define LJ_SOCK_HANDSHAKE_TIMEOUT	10000	/* ms */
+#define LJ_SOCK_BACKOFF_MIN		500	/* ms */
+#define LJ_SOCK_BACKOFF_MAX		60000	/* ms */
+
+typedef enum {
+	LJ_SOCK_CLOSED,
+	LJ_SOCK_CONNECTING,
+	LJ_SOCK_HANDSHAKING,
+	LJ_SOCK_READY,
+} lj_sock_state;
+
 struct lj_socket {
 	char	 target[256];
 	int	 sd;
 	int	 lasterr;
+	lj_sock_state state;
+	struct addrinfo *ais;	/* addresses for the current attempt */
+	struct addrinfo *ai;	/* the one we are trying */
+	uint64_t deadline;	/* when the current stage times out */
+	uint64_t retry;		/* when we may try to connect again */
+	unsigned int backoff;	/* current backoff (ms) */
+	unsigned int seed;	/* for jitter */
 #if HAVE_GNUTLS
 	struct {
 		enum { failed = -1, disabled = 0, enabled, connected } state;
@@ -72,9 +109,22 @@ sock_create(const char *target)
 		return (NULL);
 	}
 	s->sd = -1;
+	s->seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)s;
 	return (s);
 }
 
+/*
+ * Milliseconds on the monotonic clock.
+ */
+static uint64_t
+sock_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
 int
 sock_use_tls(lj_socket *s)
 {
@@ -114,58 +164,218 @@ sock_use_cert(lj_socket *s, const char *certfile)
 #endif
 }
 
-int
-sock_open(lj_socket *s)
+/*
+ * Tear down a failed connection attempt and schedule the next one.
+ */
+static int
+sock_fail(lj_socket *s, int err)
 {
-	int ret;
 
-	if (s->sd >= 0)
-		return (-1);
+	sock_close(s);
+	s->lasterr = err;
+	if (s->backoff < LJ_SOCK_BACKOFF_MIN)
+		s->backoff = LJ_SOCK_BACKOFF_MIN;
+	else if ((s->backoff *= 2) > LJ_SOCK_BACKOFF_MAX)
+		s->backoff = LJ_SOCK_BACKOFF_MAX;
+	/* anywhere between half and all of the backoff */
+	s->retry = sock_now() + s->backoff / 2 +
+	    rand_r(&s->seed) % (s->backoff / 2 + 1);
+	errno = err;
+	return (-1);
+}
+
+/*
+ * The connection is up.
+ */
+static int
+sock_ready(lj_socket *s)
+{
+
+	if (fcntl(s->sd, F_SETFL, fcntl(s->sd, F_GETFL) & ~O_NONBLOCK) != 0)
+		return (sock_fail(s, errno));
+	s->state = LJ_SOCK_READY;
+	s->lasterr = 0;
+	return (0);
+}
 
-	/* resolve and connect */
-	if ((s->sd = lj_connect(s->target, 0, 0)) < 0) {
-		warn("failed to connect to %s", s->target);
-		s->lasterr = errno;
-		goto fail;
+/*
+ * Start connecting to the current address, or if we have none, resolve
+ * the target and start with the first address.  Addresses we can't
+ * even start connecting to are skipped.
+ */
+static int
+sock_start(lj_socket *s)
+{
+
+	if (s->ais == NULL) {
+		if ((s->ais = lj_resolve(s->target, 0, 0)) == NULL) {
+			warn("failed to resolve %s", s->target);
+			return (sock_fail(s, errno));
+		}
+		s->ai = s->ais;
 	}
+	while ((s->sd = lj_connect_start(s->ai)) < 0) {
+		if ((s->ai = s->ai->ai_next) == NULL) {
+			warn("failed to connect to %s", s->target);
+			return (sock_fail(s, errno));
+		}
+	}
+	s->state = LJ_SOCK_CONNECTING;
+	s->deadline = sock_now() + LJ_SOCK_CONNECT_TIMEOUT;
+	return (0);
+}
+
+/*
+ * Connecting to the current address failed; try the next one, if there
+ * is one.
+ */
+static int
+sock_next(lj_socket *s, int err)
+{
+
+	if (s->ai->ai_next == NULL)
+		return (sock_fail(s, err));
+	close(s->sd);
+	s->sd = -1;
+	s->ai = s->ai->ai_next;
+	return (sock_start(s));
+}
 
+/*
+ * The TCP connection is up; start the TLS handshake, if needed.
+ */
+static int
+sock_handshake_start(lj_socket *s)
+{
 #if HAVE_GNUTLS
-	/* establish TLS */
+	int ret;
+
 	if (s->tls.state == enabled) {
-		s->lasterr = EPROTO;
-		s->tls.state = failed;
 		if ((ret = gnutls_init(&s->tls.session, GNUTLS_CLIENT)) != 0 ||
 		    (ret = gnutls_set_default_priority(s->tls.session)) != 0 ||
-		    (ret = gnutls_credentials_set(s->tls.session, GNUTLS_CRD_CERTIFICATE, s->tls.cred)) != 0) {
-			warnx("TLS initialization for %s failed: %s", s->target, gnutls_strerror(ret));
-			goto fail;
+		    (ret = gnutls_credentials_set(s->tls.session,
+		    GNUTLS_CRD_CERTIFICATE, s->tls.cred)) != 0) {
+			warnx("TLS initialization for %s failed: %s",
+			    s->target, gnutls_strerror(ret));
+			return (sock_fail(s, EPROTO));
 		}
 		/* SNI? */
 		gnutls_transport_set_int(s->tls.session, s->sd);
-		gnutls_handshake_set_timeout(s->tls.session, GNUTLS_DEFAULT_HANDSHAKE_TIMEOUT);
-		while ((ret = gnutls_handshake(s->tls.session)) != 0) {
-			warnx("TLS handshake with %s failed: %s", s->target, gnutls_strerror(ret));
-			if (gnutls_error_is_fatal(ret))
-				goto fail;
-		}
-		s->tls.state = connected;
+		s->state = LJ_SOCK_HANDSHAKING;
+		s->deadline = sock_now() + LJ_SOCK_HANDSHAKE_TIMEOUT;
+		return (0);
 	}
 #endif
-	s->lasterr = 0;
-	return (0);
-fail:
-#if HAVE_GNUTLS
-	if (s->tls.session != NULL) {
-		gnutls_credentials_clear(s->tls.session);
-		gnutls_deinit(s->tls.session);
-		s->tls.session = NULL;
+	return (sock_ready(s));
+}
+
+/*
+ * Make as much progress as possible towards a working connection,
+ * waiting at most the specified number of milliseconds.  Returns 0 if
+ * the connection is up.  Otherwise, returns -1 and sets errno to
+ * EAGAIN if an attempt is under way or we are waiting to make another,
+ * or to the reason why the attempt failed.
+ */
+int
+sock_advance(lj_socket *s, unsigned int wait)
+{
+	struct pollfd pfd;
+	uint64_t end, now, until;
+	socklen_t len;
+	int err, ret;
+
+	now = sock_now();
+	end = now + wait;
+	if (s->state == LJ_SOCK_READY) {
+		if (s->lasterr == 0)
+			return (0);
+		/* the connection broke, back off before trying again */
+		return (sock_fail(s, s->lasterr));
+	}
+	if (s->state == LJ_SOCK_CLOSED) {
+		if (now < s->retry) {
+			until = s->retry < end ? s->retry : end;
+			if (until > now)
+				poll(NULL, 0, until - now);
+			errno = EAGAIN;
+			return (-1);
+		}
+		if (sock_start(s) != 0)
+			return (-1);
 	}
+	for (;;) {
+		pfd.fd = s->sd;
+		pfd.events = POLLOUT;
+#if HAVE_GNUTLS
+		if (s->state == LJ_SOCK_HANDSHAKING) {
+			ret = gnutls_handshake(s->tls.session);
+			if (ret == 0) {
+				s->tls.state = connected;
+				return (sock_ready(s));
+			}
+			if (ret != GNUTLS_E_AGAIN &&
+			    ret != GNUTLS_E_INTERRUPTED &&
+			    gnutls_error_is_fatal(ret)) {
+				warnx("TLS handshake with %s failed: %s",
+				    s->target, gnutls_strerror(ret));
+				return (sock_fail(s, EPROTO));
+			}
+			if (gnutls_record_get_direction(s->tls.session) == 0)
+				pfd.events = POLLIN;
+		}
 #endif
-	if (s->sd >= 0) {
-		close(s->sd);
-		s->sd = -1;
+		now = sock_now();
+		if (now >= s->deadline && s->state == LJ_SOCK_CONNECTING) {
+			warnx("connection to %s timed out", s->target);
+			if (sock_next(s, ETIMEDOUT) != 0)
+				return (-1);
+			continue;
+		}
+		if (now >= s->deadline) {
+			warnx("TLS handshake with %s timed out", s->target);
+			return (sock_fail(s, ETIMEDOUT));
+		}
+		if (now >= end) {
+			errno = EAGAIN;
+			return (-1);
+		}
+		until = s->deadline < end ? s->deadline : end;
+		if ((ret = poll(&pfd, 1, until - now)) < 0 && errno != EINTR)
+			return (sock_fail(s, errno));
+		if (ret <= 0 || s->state != LJ_SOCK_CONNECTING)
+			continue;
+		len = sizeof err;
+		if (getsockopt(s->sd, SOL_SOCKET, SO_ERROR, &err, &len) != 0)
+			err = errno;
+		if (err != 0) {
+			errno = err;
+			warn("failed to connect to %s", s->target);
+			if (sock_next(s, err) != 0)
+				return (-1);
+			continue;
+		}
+		if (sock_handshake_start(s) != 0)
+			return (-1);
+		if (s->state == LJ_SOCK_READY)
+			return (0);
 	}
-	return (-1);
+}
+
+/*
+ * Connect, waiting for as long as it takes for this attempt to succeed
+ * or fail.
+ */
+int
+sock_open(lj_socket *s)
+{
+
+	if (s->state != LJ_SOCK_CLOSED)
+		return (-1);
+	s->retry = 0;
+	while (sock_advance(s, 1000) != 0)
+		if (errno != EAGAIN || s->state == LJ_SOCK_CLOSED)
+			return (-1);
+	return (0);
 }
 
 int
@@ -197,6 +407,11 @@ sock_close(lj_socket *s)
 		close(s->sd);
 		s->sd = -1;
 	}
+	if (s->ais != NULL) {
+		freeaddrinfo(s->ais);
+		s->ais = s->ai = NULL;
+	}
+	s->state = LJ_SOCK_CLOSED;
 	s->lasterr = 0;
 }
 
@@ -214,6 +429,7 @@ sock_write(lj_socket *s, const void *buf, size_t len)
 			    buf + sent, len - sent);
 			if (ret >= 0) {
 				sent += ret;
+				s->backoff = 0;
 			} else if (ret == GNUTLS_E_INTERRUPTED ||
 			    ret == GNUTLS_E_AGAIN) {
 				/* retry */
@@ -226,10 +442,11 @@ sock_write(lj_socket *s, const void *buf, size_t len)
 			}
 			continue;
 		}
-#else
+#endif
 		ret = write(s->sd, buf + sent, len - sent);
 		if (ret >= 0) {
 			sent += ret;
+			s->backoff = 0;
 		} else if (errno == EINTR ||
 		    errno == EAGAIN) {
 			/* retry */
@@ -238,7 +455,6 @@ sock_write(lj_socket *s, const void *buf, size_t len)
 			warn("write to %s failed", s->target);
 			return (-1);
 		}
-#endif
 	}
 	return (sent);
 }
@@ -266,11 +482,5 @@ int
 sock_connected(lj_socket *s)
 {
 
-	if (s->sd < 0 || s->lasterr != 0)
-		return (0);
-#if HAVE_GNUTLS
-	if (s->tls.state != disabled && s->tls.state != connected)
-		return (0);
-#endif
-	return (1);
+	return (s->state == LJ_SOCK_READY && s->lasterr == 0);
 }
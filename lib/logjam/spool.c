@@ -0,0 +1,509 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <logjam/spool.h>
+
+/*
+ * A spool is an on-disk FIFO of opaque records, stored in a sequence of
+ * fixed-size segment files in a single directory.  Records are appended
+ * to the newest segment and read from the oldest.  A segment is deleted
+ * once every record in it has been consumed.  Each segment starts with a
+ * header holding the offset of the first unconsumed record, so a spool
+ * can be reopened after a restart without replaying records twice.
+ *
+ * Records are stored as a 32-bit length followed by the data, padded to
+ * a multiple of eight bytes.  The length is written last, and a length
+ * of zero marks the end of the data in a segment.
+ *
+ * Records can also be read ahead of the oldest one with
+ * spool_peek_next(), and consumed only once the caller is done with
+ * them with spool_commit(), so a consumer which hands records on in
+ * batches doesn't lose any if it crashes before the batch is through.
+ *
+ * A spool is not thread-safe.
+ */
+
+#define SPOOL_MAGIC	UINT64_C(0x6c6a73706f6f6c31)	/* ljspool1 */
+#define SPOOL_SUFFIX	".spool"
+#define SPOOL_ALIGN	8
+#define SPOOL_RECLEN(len)						\
+	(((len) + sizeof(uint32_t) + SPOOL_ALIGN - 1) &			\
+	    ~(size_t)(SPOOL_ALIGN - 1))
+
+struct spool_hdr {
+	uint64_t	 magic;
+	uint64_t	 roff;		/* offset of first unconsumed record */
+};
+
+struct spool_seg {
+	uint64_t	 seq;
+	char		*base;
+	size_t		 off;
+};
+
+struct spool {
+	char		 path[PATH_MAX];
+	size_t		 segsize;
+	size_t		 maxsize;
+	size_t		 nrec;
+	struct spool_seg r;		/* oldest segment */
+	struct spool_seg w;		/* newest segment */
+	struct spool_seg p;		/* read-ahead, if base != NULL */
+};
+
+/*
+ * Construct the name of the segment with the given sequence number.
+ */
+static int
+spool_segpath(spool *sp, uint64_t seq, char *fn, size_t size)
+{
+	int len;
+
+	len = snprintf(fn, size, "%s/%016llx" SPOOL_SUFFIX, sp->path,
+	    (unsigned long long)seq);
+	if (len < 0 || (size_t)len >= size) {
+		errno = ENAMETOOLONG;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Map the segment with the given sequence number, optionally creating
+ * it.  The read offset is set from the segment header.
+ */
+static int
+spool_map(spool *sp, uint64_t seq, int create, struct spool_seg *seg)
+{
+	struct spool_hdr *hdr;
+	char fn[PATH_MAX];
+	void *base;
+	int fd, serrno;
+
+	if (spool_segpath(sp, seq, fn, sizeof fn) != 0)
+		return (-1);
+	if ((fd = open(fn, create ? O_RDWR|O_CREAT|O_EXCL : O_RDWR, 0600)) < 0)
+		return (-1);
+	if (create && ftruncate(fd, sp->segsize) != 0)
+		goto fail;
+	base = mmap(NULL, sp->segsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+		goto fail;
+	close(fd);
+	hdr = base;
+	if (create) {
+		hdr->magic = SPOOL_MAGIC;
+		hdr->roff = sizeof *hdr;
+	} else if (hdr->magic != SPOOL_MAGIC || hdr->roff < sizeof *hdr ||
+	    hdr->roff > sp->segsize) {
+		munmap(base, sp->segsize);
+		errno = EINVAL;
+		return (-1);
+	}
+	seg->seq = seq;
+	seg->base = base;
+	seg->off = hdr->roff;
+	return (0);
+fail:
+	serrno = errno;
+	if (create)
+		unlink(fn);
+	close(fd);
+	errno = serrno;
+	return (-1);
+}
+
+/*
+ * Unmap a segment.
+ */
+static void
+spool_unmap(spool *sp, struct spool_seg *seg)
+{
+
+	if (seg->base != NULL)
+		munmap(seg->base, sp->segsize);
+	seg->base = NULL;
+}
+
+/*
+ * Delete the segment with the given sequence number.
+ */
+static void
+spool_unlink(spool *sp, uint64_t seq)
+{
+	char fn[PATH_MAX];
+
+	if (spool_segpath(sp, seq, fn, sizeof fn) == 0)
+		unlink(fn);
+}
+
+/*
+ * Return the length of the record at the given offset in a segment, or
+ * zero if there is none.
+ */
+static size_t
+spool_reclen(spool *sp, const struct spool_seg *seg, size_t off)
+{
+	uint32_t len;
+
+	if (off + sizeof len > sp->segsize)
+		return (0);
+	memcpy(&len, seg->base + off, sizeof len);
+	if (len == 0 || SPOOL_RECLEN((size_t)len) > sp->segsize - off)
+		return (0);
+	return (len);
+}
+
+/*
+ * Walk the records in a segment, starting at its current offset, and
+ * advance the offset past the last one.  Returns the number of records.
+ */
+static size_t
+spool_walk(spool *sp, struct spool_seg *seg)
+{
+	size_t len, n;
+
+	for (n = 0; (len = spool_reclen(sp, seg, seg->off)) > 0; ++n)
+		seg->off += SPOOL_RECLEN(len);
+	return (n);
+}
+
+/*
+ * Scan the spool directory for the oldest and newest existing segments.
+ * Returns 0 if there are none, 1 if there are, and -1 on error.
+ */
+static int
+spool_scan(spool *sp, uint64_t *first, uint64_t *last)
+{
+	struct dirent *ent;
+	unsigned long long seq;
+	char *end;
+	DIR *dir;
+	int found;
+
+	if ((dir = opendir(sp->path)) == NULL)
+		return (-1);
+	found = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		seq = strtoull(ent->d_name, &end, 16);
+		if (end != ent->d_name + 16 || strcmp(end, SPOOL_SUFFIX) != 0)
+			continue;
+		if (!found || seq < *first)
+			*first = seq;
+		if (!found || seq > *last)
+			*last = seq;
+		found = 1;
+	}
+	closedir(dir);
+	return (found);
+}
+
+/*
+ * Open the spool in the given directory, which must exist, with the
+ * given segment size and total size.  Segments left over from a previous
+ * run are picked up where they were left off.
+ */
+spool *
+spool_open(const char *path, size_t segsize, size_t maxsize)
+{
+	struct spool_seg seg;
+	uint64_t first, last, seq;
+	spool *sp;
+	int serrno;
+
+	if (segsize < sizeof(struct spool_hdr) + SPOOL_RECLEN(1) ||
+	    maxsize < segsize) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	if ((sp = calloc(1, sizeof *sp)) == NULL)
+		return (NULL);
+	if (snprintf(sp->path, sizeof sp->path, "%s", path) >=
+	    (int)sizeof sp->path) {
+		errno = ENAMETOOLONG;
+		goto fail;
+	}
+	sp->segsize = segsize;
+	sp->maxsize = maxsize;
+	switch (spool_scan(sp, &first, &last)) {
+	case -1:
+		goto fail;
+	case 0:
+		if (spool_map(sp, 0, 1, &sp->r) != 0 ||
+		    spool_map(sp, 0, 0, &sp->w) != 0)
+			goto fail;
+		break;
+	default:
+		/* count the records that are left, skipping any gaps */
+		for (seq = first; seq <= last; ++seq) {
+			if (spool_map(sp, seq, 0, &seg) != 0) {
+				if (errno == ENOENT)
+					continue;
+				goto fail;
+			}
+			if (sp->r.base == NULL)
+				sp->r = seg;
+			sp->nrec += spool_walk(sp, &seg);
+			if (seq == last)
+				sp->w = seg;
+			else if (seg.base != sp->r.base)
+				spool_unmap(sp, &seg);
+		}
+		if (sp->r.base == NULL || sp->w.base == NULL) {
+			errno = EINVAL;
+			goto fail;
+		}
+		/* don't share a mapping between the reader and writer */
+		if (sp->r.base == sp->w.base &&
+		    spool_map(sp, last, 0, &sp->r) != 0)
+			goto fail;
+		break;
+	}
+	return (sp);
+fail:
+	serrno = errno;
+	spool_close(sp);
+	errno = serrno;
+	return (NULL);
+}
+
+/*
+ * Close a spool.  The segments are left in place.
+ */
+void
+spool_close(spool *sp)
+{
+
+	if (sp != NULL) {
+		spool_unmap(sp, &sp->r);
+		spool_unmap(sp, &sp->w);
+		spool_unmap(sp, &sp->p);
+		free(sp);
+	}
+}
+
+/*
+ * Append a record to the spool, starting a new segment if the current
+ * one is full.  Fails with ENOSPC if that would take the spool past its
+ * maximum size, and with EMSGSIZE if the record is too large to fit in
+ * a segment.
+ */
+int
+spool_append(spool *sp, const void *buf, size_t len)
+{
+	struct spool_seg seg;
+	uint32_t len32;
+	size_t need;
+
+	need = SPOOL_RECLEN(len);
+	if (len == 0 || len > UINT32_MAX ||
+	    need > sp->segsize - sizeof(struct spool_hdr)) {
+		errno = EMSGSIZE;
+		return (-1);
+	}
+	if (need > sp->segsize - sp->w.off) {
+		if (spool_size(sp) + sp->segsize > sp->maxsize) {
+			errno = ENOSPC;
+			return (-1);
+		}
+		if (spool_map(sp, sp->w.seq + 1, 1, &seg) != 0)
+			return (-1);
+		spool_unmap(sp, &sp->w);
+		sp->w = seg;
+	}
+	len32 = len;
+	memcpy(sp->w.base + sp->w.off + sizeof len32, buf, len);
+	memcpy(sp->w.base + sp->w.off, &len32, sizeof len32);
+	sp->w.off += need;
+	sp->nrec++;
+	return (0);
+}
+
+/*
+ * Look at the oldest record in the spool without consuming it.  Stores
+ * a pointer to the record in the location pointed to by the second
+ * argument and returns its length, which is zero if the spool is empty.
+ * The pointer remains valid until the next call to spool_consume().
+ */
+ssize_t
+spool_peek(spool *sp, const void **buf)
+{
+	struct spool_seg seg;
+	size_t len;
+
+	for (;;) {
+		if ((len = spool_reclen(sp, &sp->r, sp->r.off)) > 0) {
+			*buf = sp->r.base + sp->r.off + sizeof(uint32_t);
+			return (len);
+		}
+		if (sp->r.seq == sp->w.seq)
+			return (0);
+		/* this segment is exhausted, move on to the next one */
+		seg.base = NULL;
+		for (seg.seq = sp->r.seq + 1; seg.seq <= sp->w.seq; ++seg.seq)
+			if (spool_map(sp, seg.seq, 0, &seg) == 0 ||
+			    errno != ENOENT)
+				break;
+		if (seg.seq > sp->w.seq) {
+			errno = ENOENT;
+			return (-1);
+		}
+		if (seg.base == NULL)
+			return (-1);
+		spool_unmap(sp, &sp->r);
+		spool_unlink(sp, sp->r.seq);
+		sp->r = seg;
+	}
+}
+
+/*
+ * Consume the oldest record in the spool, which must have been looked at
+ * with spool_peek().
+ */
+void
+spool_consume(spool *sp)
+{
+	struct spool_hdr *hdr;
+	size_t len;
+
+	if ((len = spool_reclen(sp, &sp->r, sp->r.off)) == 0)
+		return;
+	sp->r.off += SPOOL_RECLEN(len);
+	hdr = (struct spool_hdr *)sp->r.base;
+	hdr->roff = sp->r.off;
+	sp->nrec--;
+}
+
+/*
+ * Look at the record following the last one returned by this function
+ * since the last call to spool_rewind(), or at the oldest record if
+ * there was none, without consuming it.  Stores a pointer to the record
+ * in the location pointed to by the second argument and returns its
+ * length, which is zero if there are no more records.  The pointer
+ * remains valid until the next call to any spool function.
+ */
+ssize_t
+spool_peek_next(spool *sp, const void **buf)
+{
+	struct spool_seg seg;
+	size_t len;
+
+	if (sp->p.base == NULL) {
+		if (spool_map(sp, sp->r.seq, 0, &sp->p) != 0)
+			return (-1);
+		sp->p.off = sp->r.off;
+	}
+	for (;;) {
+		if ((len = spool_reclen(sp, &sp->p, sp->p.off)) > 0) {
+			*buf = sp->p.base + sp->p.off + sizeof(uint32_t);
+			sp->p.off += SPOOL_RECLEN(len);
+			return (len);
+		}
+		if (sp->p.seq == sp->w.seq)
+			return (0);
+		/* this segment is exhausted, move on to the next one */
+		seg.base = NULL;
+		for (seg.seq = sp->p.seq + 1; seg.seq <= sp->w.seq; ++seg.seq)
+			if (spool_map(sp, seg.seq, 0, &seg) == 0 ||
+			    errno != ENOENT)
+				break;
+		if (seg.seq > sp->w.seq) {
+			errno = ENOENT;
+			return (-1);
+		}
+		if (seg.base == NULL)
+			return (-1);
+		spool_unmap(sp, &sp->p);
+		sp->p = seg;
+	}
+}
+
+/*
+ * Consume the specified number of records, which must have been looked
+ * at with spool_peek_next().  The read-ahead position is unaffected.
+ */
+void
+spool_commit(spool *sp, size_t n)
+{
+	const void *buf;
+
+	while (n-- > 0 && spool_peek(sp, &buf) > 0)
+		spool_consume(sp);
+}
+
+/*
+ * Forget about any records looked at with spool_peek_next() but not
+ * consumed, so the next call to spool_peek_next() starts over with the
+ * oldest record.
+ */
+void
+spool_rewind(spool *sp)
+{
+
+	spool_unmap(sp, &sp->p);
+}
+
+/*
+ * Return the number of records in the spool.
+ */
+size_t
+spool_len(spool *sp)
+{
+
+	return (sp->nrec);
+}
+
+/*
+ * Return the amount of disk space used by the spool.
+ */
+size_t
+spool_size(spool *sp)
+{
+
+	return ((sp->w.seq - sp->r.seq + 1) * sp->segsize);
+}
@@ -0,0 +1,169 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <regex.h>
+#include <stddef.h>
+
+#include <logjam/multire.h>
+#include <logjam/sshdmsg.h>
+
+#define ADDR	"([0-9A-Fa-f:.]+)"
+#define PORT	"([0-9]+)"
+#define USER	"((invalid |authenticating |)user ([^ ]*) |)"
+#define PREAUTH	"( \\[preauth\\])?"
+
+/*
+ * Free text followed by PREAUTH.  POSIX gives the leftmost subexpression
+ * the longest possible match, so plain (.*) would swallow the suffix.
+ */
+#define REASON	"(.*[^]]|)"
+
+/*
+ * The field lists are indexed by subexpression number, so every
+ * subexpression, named or not, takes up a slot; t_sshdmsg checks that
+ * they line up.
+ */
+const lj_sshd_msg lj_sshd_msgs[] = {
+	{ "failed",
+	  "^Failed ([a-z-]+) for (invalid user |)([0-9a-z-]+) from " ADDR
+	  " port " PORT " ssh([0-9.]+)$",
+	  { NULL, "method", NULL, "login", "client_addr", "client_port",
+	    "protocol" } },
+	{ "accepted",
+	  "^Accepted ([a-z-]+) for ([^ ]+) from " ADDR " port " PORT
+	  " ssh([0-9.]+)(: .*)?$",
+	  { NULL, "method", "login", "client_addr", "client_port",
+	    "protocol" } },
+	{ "invalid_user",
+	  "^Invalid user ([^ ]*) from " ADDR "( port " PORT ")?$",
+	  { NULL, "login", "client_addr", NULL, "client_port" } },
+	{ "max_auth_tries",
+	  "^error: maximum authentication attempts exceeded for "
+	  "(invalid user |)([^ ]*) from " ADDR " port " PORT
+	  " ssh([0-9.]+)" PREAUTH "$",
+	  { NULL, NULL, "login", "client_addr", "client_port",
+	    "protocol" } },
+	{ "disconnected",
+	  "^Disconnected from " USER ADDR " port " PORT PREAUTH "$",
+	  { NULL, NULL, NULL, "login", "client_addr", "client_port" } },
+	{ "received_disconnect",
+	  "^Received disconnect from " ADDR " port " PORT ":([0-9]+): "
+	  REASON PREAUTH "$",
+	  { NULL, "client_addr", "client_port", "code", "reason" } },
+	{ "connection_closed",
+	  "^Connection closed by " USER ADDR " port " PORT PREAUTH "$",
+	  { NULL, NULL, NULL, "login", "client_addr", "client_port" } },
+	{ "connection_reset",
+	  "^Connection reset by " USER ADDR " port " PORT PREAUTH "$",
+	  { NULL, NULL, NULL, "login", "client_addr", "client_port" } },
+	{ "connection",
+	  "^Connection from " ADDR " port " PORT " on " ADDR " port " PORT
+	  "( rdomain .*)?$",
+	  { NULL, "client_addr", "client_port", "server_addr",
+	    "server_port" } },
+	{ "no_identification",
+	  "^Did not receive identification string from " ADDR
+	  "( port " PORT ")?$",
+	  { NULL, "client_addr", NULL, "client_port" } },
+	{ "timeout",
+	  "^Timeout before authentication for " ADDR "( port " PORT ")?$",
+	  { NULL, "client_addr", NULL, "client_port" } },
+	{ "negotiation_failed",
+	  "^Unable to negotiate with " ADDR " port " PORT ": " REASON
+	  PREAUTH "$",
+	  { NULL, "client_addr", "client_port", "reason" } },
+	{ "bad_banner",
+	  "^banner exchange: Connection from " ADDR " port " PORT ": (.*)$",
+	  { NULL, "client_addr", "client_port", "reason" } },
+	{ "not_allowed",
+	  "^User ([^ ]+) from ([^ ]+) not allowed because (.*)$",
+	  { NULL, "login", "client_addr", "reason" } },
+	{ "session_opened",
+	  "^pam_unix\\(sshd:session\\): session opened for user ([^ (]+)"
+	  "(\\(uid=[0-9]+\\))? by ",
+	  { NULL, "login" } },
+	{ "session_closed",
+	  "^pam_unix\\(sshd:session\\): session closed for user ([^ ]+)$",
+	  { NULL, "login" } },
+	{ "auth_failure",
+	  "^pam_unix\\(sshd:auth\\): authentication failure; .*rhost=([^ ]*)"
+	  "( +user=([^ ]*))?$",
+	  { NULL, "client_addr", NULL, "login" } },
+	{ "auth_failures",
+	  "^PAM ([0-9]+) more authentication failures?; .*rhost=([^ ]*)"
+	  "( +user=([^ ]*))?$",
+	  { NULL, "count", "client_addr", NULL, "login" } },
+};
+const unsigned int lj_sshd_nmsgs = sizeof lj_sshd_msgs / sizeof *lj_sshd_msgs;
+
+/*
+ * Compile all the messages into a single matcher, in which each
+ * message's index is its index in lj_sshd_msgs.
+ */
+lj_multire *
+lj_sshd_compile(void)
+{
+	lj_multire *mr;
+	unsigned int i;
+
+	if ((mr = lj_multire_create()) == NULL)
+		return (NULL);
+	for (i = 0; i < lj_sshd_nmsgs; ++i)
+		if (lj_multire_add(mr, lj_sshd_msgs[i].re) != (int)i)
+			goto fail;
+	if (lj_multire_compile(mr) != 0)
+		goto fail;
+	return (mr);
+fail:
+	lj_multire_destroy(mr);
+	return (NULL);
+}
+
+/*
+ * Match a message against a matcher created by lj_sshd_compile().  On
+ * success, returns the message which matched, and pmatch, which must
+ * have room for LJ_SSHD_NMATCH elements, holds its subexpressions.
+ * Otherwise, returns NULL and stores in ncand the number of candidate
+ * expressions which were tried, as lj_multire_match() does.
+ */
+const lj_sshd_msg *
+lj_sshd_match(lj_multire *mr, const char *str, size_t len,
+    regmatch_t *pmatch, unsigned int *ncand)
+{
+	int m;
+
+	if ((m = lj_multire_match(mr, str, len, LJ_SSHD_NMATCH, pmatch,
+	    ncand)) < 0)
+		return (NULL);
+	return (&lj_sshd_msgs[m]);
+}
@@ -384,7 +384,7 @@ label:
 				ptr++;
 				buf++;
 				len = 3;
-				for (i = 0; len && *buf != 0 &&
+				for (; len && *buf != 0 &&
 					 isdigit((unsigned char)*buf); buf++) {
 					/* ignore for now */
 					len--;
@@ -555,7 +555,7 @@ label:
 				i += *buf - '0';
 				len--;
 			}
-			if (i > 31)
+			if (i < 1 || i > 31)
 				return (NULL);
 
 			tm->tm_mday = i;
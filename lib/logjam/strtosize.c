@@ -0,0 +1,90 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <logjam/strtosize.h>
+
+/*
+ * Parse a size, which is a decimal number optionally followed by k, M or
+ * G (case-insensitive) for kilo-, mega- or gigabytes (powers of 1024).
+ *
+ * Returns 0 on success and -1 if the string is not a valid size or the
+ * size does not fit in a size_t.
+ */
+
+int
+lj_strtosize(const char *str, size_t *size)
+{
+	unsigned long long ull;
+	unsigned int shift;
+	char *end;
+
+	/* strtoull() would skip whitespace and accept a sign */
+	if (*str < '0' || *str > '9')
+		return (-1);
+	errno = 0;
+	ull = strtoull(str, &end, 10);
+	if (errno == ERANGE || ull > SIZE_MAX)
+		return (-1);
+	switch (*end) {
+	case 'g':
+	case 'G':
+		shift = 3;
+		end++;
+		break;
+	case 'm':
+	case 'M':
+		shift = 2;
+		end++;
+		break;
+	case 'k':
+	case 'K':
+		shift = 1;
+		end++;
+		break;
+	default:
+		shift = 0;
+	}
+	if (*end != '\0')
+		return (-1);
+	while (shift-- > 0) {
+		if (ull > SIZE_MAX / 1024)
+			return (-1);
+		ull *= 1024;
+	}
+	*size = ull;
+	return (0);
+}
@@ -0,0 +1,582 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <logjam/strlcpy.h>
+#include <logjam/time.h>
+#include <logjam/timefmt.h>
+
+/*
+ * A timestamp format is compiled into a short program for a simple
+ * matcher which understands the conversions commonly found in log files:
+ * month names and numbers, day of month, two- and four-digit years,
+ * hours, minutes and seconds, plus the %F, %R and %T shorthands.  It
+ * accepts exactly what lj_strptime() would accept.  Formats which use
+ * anything else are handed to lj_strptime() instead.
+ *
+ * Unlike lj_strptime(), we keep fractional seconds.  They can be given
+ * either as %f, which is up to six digits, or as a decimal point right
+ * after %S, which is followed by up to three digits.
+ *
+ * Either way, converting the result to a time_t is expensive, as
+ * mktime() consults the time zone rules every time.  We therefore
+ * remember the start of the last minute we converted, and only call
+ * mktime() again when the date, hour or minute changes.  On top of that,
+ * we remember the text of the last timestamp we parsed, and when the
+ * next line starts with the same text, we reuse the result outright.
+ */
+
+#define LJ_TIMEFMT_MAXOPS	LJ_TIMEFMT_MAXLEN
+
+enum lj_timefmt_op {
+	LJ_TF_END,
+	LJ_TF_CHAR,		/* literal character */
+	LJ_TF_SPACE,		/* any amount of whitespace */
+	LJ_TF_MONTH,		/* month name, full or abbreviated */
+	LJ_TF_MON,		/* month number */
+	LJ_TF_MDAY,		/* day of month */
+	LJ_TF_MDAY_SP,		/* ...optionally preceded by a space */
+	LJ_TF_YEAR,		/* four-digit year */
+	LJ_TF_YEAR2,		/* two-digit year */
+	LJ_TF_HOUR,
+	LJ_TF_MIN,
+	LJ_TF_SEC,
+	LJ_TF_FRAC,		/* decimal point and up to three digits */
+	LJ_TF_USEC,		/* up to six digits of fractional seconds */
+};
+
+struct lj_timefmt {
+	char		 fmt[LJ_TIMEFMT_MAXLEN];
+	int		 compiled;
+	struct {
+		uint8_t	 op;
+		char	 ch;
+	}		 ops[LJ_TIMEFMT_MAXOPS];
+
+	/* start of the last minute we converted */
+	int		 key[5];
+	time_t		 base;
+	int		 havebase;
+
+	/* text and value of the last timestamp we parsed */
+	char		 last[LJ_TIMEFMT_MAXLEN + 1];
+	size_t		 lastlen;
+	int		 havelast;
+	uint64_t	 lastwhen;
+};
+
+static const char *lj_timefmt_month[12] = {
+	"January", "February", "March", "April", "May", "June",
+	"July", "August", "September", "October", "November", "December",
+};
+
+/*
+ * Append a conversion or character to a compiled format.
+ */
+static int
+lj_timefmt_emit(lj_timefmt *tf, unsigned int *n, int op, char ch)
+{
+
+	if (*n >= LJ_TIMEFMT_MAXOPS - 1)
+		return (-1);
+	tf->ops[*n].op = op;
+	tf->ops[*n].ch = ch;
+	++*n;
+	return (0);
+}
+
+/*
+ * Translate a format string into a program for lj_timefmt_match().
+ * Returns -1 if the format contains anything we do not handle.
+ */
+static int
+lj_timefmt_translate(lj_timefmt *tf, const char *fmt, unsigned int *n)
+{
+	const char *sub;
+	int op;
+
+	for (; *fmt != '\0'; fmt++) {
+		if (isspace((unsigned char)*fmt)) {
+			if (lj_timefmt_emit(tf, n, LJ_TF_SPACE, '\0') != 0)
+				return (-1);
+			continue;
+		}
+		if (*fmt != '%' || fmt[1] == '%') {
+			if (*fmt == '%')
+				fmt++;
+			if (lj_timefmt_emit(tf, n, LJ_TF_CHAR, *fmt) != 0)
+				return (-1);
+			continue;
+		}
+		sub = NULL;
+		switch (*++fmt) {
+		case 'F':
+			sub = "%Y-%m-%d";
+			break;
+		case 'R':
+			sub = "%H:%M";
+			break;
+		case 'T':
+			sub = "%H:%M:%S";
+			break;
+		case 'B':
+		case 'b':
+		case 'h':
+			op = LJ_TF_MONTH;
+			break;
+		case 'm':
+			op = LJ_TF_MON;
+			break;
+		case 'd':
+			op = LJ_TF_MDAY;
+			break;
+		case 'e':
+			op = LJ_TF_MDAY_SP;
+			break;
+		case 'Y':
+			op = LJ_TF_YEAR;
+			break;
+		case 'y':
+			op = LJ_TF_YEAR2;
+			break;
+		case 'H':
+		case 'k':
+			op = LJ_TF_HOUR;
+			break;
+		case 'M':
+			op = LJ_TF_MIN;
+			break;
+		case 'S':
+			op = LJ_TF_SEC;
+			break;
+		case 'f':
+			op = LJ_TF_USEC;
+			break;
+		case 'n':
+		case 't':
+			op = LJ_TF_SPACE;
+			break;
+		default:
+			return (-1);
+		}
+		if (sub != NULL) {
+			if (lj_timefmt_translate(tf, sub, n) != 0)
+				return (-1);
+			continue;
+		}
+		if (lj_timefmt_emit(tf, n, op, '\0') != 0)
+			return (-1);
+		/* lj_strptime() skips a fraction after minutes or seconds */
+		if ((op == LJ_TF_MIN || op == LJ_TF_SEC) && fmt[1] == '.' &&
+		    strncmp(fmt + 2, "%f", 2) != 0) {
+			if (lj_timefmt_emit(tf, n, LJ_TF_FRAC,
+			    op == LJ_TF_SEC) != 0)
+				return (-1);
+			fmt++;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Compile a timestamp format.  Formats which use %f must be compiled,
+ * since lj_strptime() does not understand it.
+ */
+lj_timefmt *
+lj_timefmt_compile(const char *fmt)
+{
+	lj_timefmt *tf;
+	unsigned int n;
+
+	if (strlen(fmt) >= LJ_TIMEFMT_MAXLEN) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+	if ((tf = calloc(1, sizeof *tf)) == NULL)
+		return (NULL);
+	strlcpy(tf->fmt, fmt, sizeof tf->fmt);
+	n = 0;
+	if (lj_timefmt_translate(tf, fmt, &n) == 0) {
+		tf->ops[n].op = LJ_TF_END;
+		tf->compiled = 1;
+	} else if (strstr(fmt, "%f") != NULL) {
+		free(tf);
+		errno = EINVAL;
+		return (NULL);
+	}
+	return (tf);
+}
+
+void
+lj_timefmt_destroy(lj_timefmt *tf)
+{
+
+	free(tf);
+}
+
+/*
+ * Returns non-zero if the format was compiled and zero if it will be
+ * interpreted by lj_strptime().
+ */
+int
+lj_timefmt_compiled(const lj_timefmt *tf)
+{
+
+	return (tf->compiled);
+}
+
+/*
+ * Parse a number of up to the specified number of digits.  The first
+ * character must be a digit.
+ */
+static inline const char *
+lj_timefmt_num(const char *p, unsigned int max, int *val)
+{
+	int i;
+
+	if (*p < '0' || *p > '9')
+		return (NULL);
+	for (i = 0; max > 0 && *p >= '0' && *p <= '9'; --max, ++p)
+		i = i * 10 + *p - '0';
+	*val = i;
+	return (p);
+}
+
+/*
+ * Look up a three-letter month abbreviation, ignoring case.  This is
+ * the hottest part of parsing a syslog timestamp, so rather than call
+ * strncasecmp() up to twelve times, we fold the three letters into a
+ * single integer and compare that.
+ */
+static inline int
+lj_timefmt_mon(const char *p)
+{
+	static const uint32_t mon[12] = {
+		'j' << 16 | 'a' << 8 | 'n', 'f' << 16 | 'e' << 8 | 'b',
+		'm' << 16 | 'a' << 8 | 'r', 'a' << 16 | 'p' << 8 | 'r',
+		'm' << 16 | 'a' << 8 | 'y', 'j' << 16 | 'u' << 8 | 'n',
+		'j' << 16 | 'u' << 8 | 'l', 'a' << 16 | 'u' << 8 | 'g',
+		's' << 16 | 'e' << 8 | 'p', 'o' << 16 | 'c' << 8 | 't',
+		'n' << 16 | 'o' << 8 | 'v', 'd' << 16 | 'e' << 8 | 'c',
+	};
+	uint32_t key;
+	unsigned int i;
+	int ch;
+
+	for (key = 0, i = 0; i < 3; ++i) {
+		if ((ch = (unsigned char)p[i]) == '\0')
+			return (-1);
+		if (ch >= 'A' && ch <= 'Z')
+			ch += 'a' - 'A';
+		key = key << 8 | ch;
+	}
+	for (i = 0; i < 12; ++i)
+		if (mon[i] == key)
+			return (i);
+	return (-1);
+}
+
+/*
+ * Run a compiled format against a string.  Fields which are not present
+ * in the format are left alone.
+ */
+static const char *
+lj_timefmt_match(const lj_timefmt *tf, const char *p, struct tm *tm,
+    long *usec)
+{
+	unsigned int i, len;
+	int op, val;
+	long frac;
+
+	for (i = 0; (op = tf->ops[i].op) != LJ_TF_END; ++i) {
+		switch (op) {
+		case LJ_TF_CHAR:
+			if (*p++ != tf->ops[i].ch)
+				return (NULL);
+			break;
+		case LJ_TF_SPACE:
+			while (*p != '\0' && isspace((unsigned char)*p))
+				p++;
+			break;
+		case LJ_TF_MONTH:
+			/* abbreviations are unique and prefixes of names */
+			if ((val = lj_timefmt_mon(p)) < 0)
+				return (NULL);
+			len = strlen(lj_timefmt_month[val]);
+			if (len == 3 ||
+			    strncasecmp(p, lj_timefmt_month[val], len) != 0)
+				len = 3;
+			p += len;
+			tm->tm_mon = val;
+			break;
+		case LJ_TF_MON:
+			if ((p = lj_timefmt_num(p, 2, &val)) == NULL ||
+			    val < 1 || val > 12)
+				return (NULL);
+			tm->tm_mon = val - 1;
+			break;
+		case LJ_TF_MDAY_SP:
+			if (*p != '\0' && isspace((unsigned char)*p))
+				p++;
+			/* fall through */
+		case LJ_TF_MDAY:
+			if ((p = lj_timefmt_num(p, 2, &val)) == NULL ||
+			    val < 1 || val > 31)
+				return (NULL);
+			tm->tm_mday = val;
+			break;
+		case LJ_TF_YEAR:
+		case LJ_TF_YEAR2:
+			if (*p == '\0' || isspace((unsigned char)*p))
+				break;
+			if (op == LJ_TF_YEAR) {
+				if ((p = lj_timefmt_num(p, 4, &val)) == NULL ||
+				    val < 1900)
+					return (NULL);
+				val -= 1900;
+			} else {
+				if ((p = lj_timefmt_num(p, 2, &val)) == NULL)
+					return (NULL);
+				if (val < 69)
+					val += 100;
+			}
+			tm->tm_year = val;
+			break;
+		case LJ_TF_HOUR:
+			if ((p = lj_timefmt_num(p, 2, &val)) == NULL ||
+			    val > 23)
+				return (NULL);
+			tm->tm_hour = val;
+			break;
+		case LJ_TF_MIN:
+		case LJ_TF_SEC:
+			if (*p == '\0' || isspace((unsigned char)*p)) {
+				/* the fraction, if any, is not skipped */
+				if (tf->ops[i + 1].op == LJ_TF_FRAC)
+					return (NULL);
+				break;
+			}
+			if ((p = lj_timefmt_num(p, 2, &val)) == NULL ||
+			    val > (op == LJ_TF_MIN ? 59 : 60))
+				return (NULL);
+			if (op == LJ_TF_MIN)
+				tm->tm_min = val;
+			else
+				tm->tm_sec = val;
+			break;
+		case LJ_TF_FRAC:
+			if (*p++ != '.')
+				return (NULL);
+			/* fall through */
+		case LJ_TF_USEC:
+			len = op == LJ_TF_FRAC ? 3 : 6;
+			for (frac = 0; len > 0 && *p >= '0' && *p <= '9'; --len)
+				frac = frac * 10 + *p++ - '0';
+			if (op == LJ_TF_USEC && len == 6)
+				return (NULL);
+			while (len-- > 0)
+				frac *= 10;
+			if (op == LJ_TF_FRAC) {
+				frac *= 1000;
+				if (!tf->ops[i].ch)
+					break;
+			}
+			*usec = frac;
+			break;
+		}
+	}
+	return (p);
+}
+
+/*
+ * Fill in the year of a timestamp which does not include one.  We
+ * assume that it is the current year, unless that would place it more
+ * than six months in the future or the past.
+ */
+static void
+lj_timefmt_year(struct tm *tm)
+{
+	struct tm now;
+	time_t t;
+
+	t = time(NULL);
+	localtime_r(&t, &now);
+	tm->tm_year = now.tm_year;
+	if (tm->tm_mon - now.tm_mon > 6)
+		tm->tm_year--;
+	else if (now.tm_mon - tm->tm_mon > 6)
+		tm->tm_year++;
+}
+
+/*
+ * Convert broken-down local time to microseconds since the epoch,
+ * calling mktime() only when the minute changes.  If the year is
+ * missing, we work it out only when we call mktime().
+ */
+static int
+lj_timefmt_convert(lj_timefmt *tf, const struct tm *tm, long usec,
+    uint64_t *when)
+{
+	struct tm t;
+	time_t base;
+
+	if (!tf->havebase || tm->tm_min != tf->key[0] ||
+	    tm->tm_hour != tf->key[1] || tm->tm_mday != tf->key[2] ||
+	    tm->tm_mon != tf->key[3] || tm->tm_year != tf->key[4]) {
+		memset(&t, 0, sizeof t);
+		t.tm_year = tm->tm_year;
+		t.tm_mon = tm->tm_mon;
+		t.tm_mday = tm->tm_mday;
+		t.tm_hour = tm->tm_hour;
+		t.tm_min = tm->tm_min;
+		t.tm_isdst = -1;
+		if (t.tm_year == INT_MIN)
+			lj_timefmt_year(&t);
+		if ((base = mktime(&t)) == (time_t)-1)
+			return (-1);
+		tf->key[0] = tm->tm_min;
+		tf->key[1] = tm->tm_hour;
+		tf->key[2] = tm->tm_mday;
+		tf->key[3] = tm->tm_mon;
+		tf->key[4] = tm->tm_year;
+		tf->base = base;
+		tf->havebase = 1;
+	}
+	if (tf->base + tm->tm_sec <= 0)
+		return (-1);
+	*when = (uint64_t)(tf->base + tm->tm_sec) * 1000000 + usec;
+	return (0);
+}
+
+/*
+ * Parse a timestamp at the start of a NUL-terminated string.  Returns a
+ * pointer to the first character following the timestamp, and stores
+ * its value in microseconds since the epoch in the location pointed to
+ * by the last argument.  Returns NULL if the string does not start with
+ * a valid timestamp.
+ */
+const char *
+lj_timefmt_parse(lj_timefmt *tf, const char *str, uint64_t *when)
+{
+	const char *end;
+	struct tm tm;
+	size_t len;
+	long usec;
+
+	/*
+	 * The result depends only on the text we consumed and the first
+	 * character following it, so if those match, so does the result.
+	 * Note that strncmp() stops at the end of the string.
+	 */
+	if (tf->havelast &&
+	    strncmp(str, tf->last, tf->lastlen + 1) == 0) {
+		*when = tf->lastwhen;
+		return (str + tf->lastlen);
+	}
+	memset(&tm, 0, sizeof tm);
+	tm.tm_year = INT_MIN;
+	usec = 0;
+	if (tf->compiled)
+		end = lj_timefmt_match(tf, str, &tm, &usec);
+	else
+		end = lj_strptime(str, tf->fmt, &tm);
+	if (end == NULL)
+		return (NULL);
+	if (lj_timefmt_convert(tf, &tm, usec, when) != 0)
+		return (NULL);
+	if ((len = end - str) < sizeof tf->last) {
+		memcpy(tf->last, str, len);
+		tf->last[len] = str[len];
+		tf->lastlen = len;
+		tf->havelast = 1;
+		tf->lastwhen = *when;
+	}
+	return (end);
+}
+
+/*
+ * The date, hour and minute of the last timestamp formatted by the
+ * calling thread, so that we only need to fill in the seconds.
+ */
+static __thread struct {
+	uint64_t	 minute;	/* plus one, so zero is never valid */
+	char		 prefix[sizeof "YYYY-MM-DDTHH:MM:"];
+} lj_timefmt_last;
+
+/*
+ * Format a time in microseconds since the epoch as an RFC 3339 UTC
+ * timestamp with microsecond precision.  The buffer must have room for
+ * at least LJ_TIMEFMT_RFC3339_LEN characters.  Returns the length of
+ * the result, not counting the terminating NUL.
+ */
+size_t
+lj_timefmt_rfc3339(uint64_t when, char *buf)
+{
+	const size_t plen = sizeof lj_timefmt_last.prefix - 1;
+	uint32_t usec, sec;
+	uint64_t minute;
+	struct tm tm;
+	time_t t;
+	size_t i;
+
+	/* RFC 3339 has no room for years past 9999 */
+	if (when > 253402300799999999ULL)
+		when = 253402300799999999ULL;
+	t = when / 1000000;
+	usec = when - (uint64_t)t * 1000000;
+	minute = t / 60;
+	sec = t - minute * 60;
+	if (lj_timefmt_last.minute != minute + 1) {
+		gmtime_r(&t, &tm);
+		strftime(lj_timefmt_last.prefix, sizeof lj_timefmt_last.prefix,
+		    "%Y-%m-%dT%H:%M:", &tm);
+		lj_timefmt_last.minute = minute + 1;
+	}
+	memcpy(buf, lj_timefmt_last.prefix, plen);
+	buf[plen] = '0' + sec / 10;
+	buf[plen + 1] = '0' + sec % 10;
+	buf[plen + 2] = '.';
+	for (i = plen + 8; i > plen + 2; --i, usec /= 10)
+		buf[i] = '0' + usec % 10;
+	buf[plen + 9] = 'Z';
+	buf[plen + 10] = '\0';
+	return (plen + 10);
+}
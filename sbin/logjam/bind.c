@@ -33,42 +33,26 @@
 
 #include <err.h>
 #include <regex.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <logjam/bindscan.h>
 #include <logjam/logobj.h>
 #include <logjam/parser.h>
-
-const char *bind_re =
-    "^"
-    "queries:"
-    "( [0-9a-z]+:)?"		/* 1: optional severity */
-    " client "
-    "([0-9A-Fa-f:.]+)"		/* 2: client address */
-    "#"
-    "([0-9]+)"			/* 3: client port */
-    ".*"			/*    optional signer, qname */
-    ": query: "
-    "([0-9A-Za-z._-]+)"		/* 4: queried name */
-    " "
-    "([A-Z]+)"			/* 5: class */
-    " "
-    "([0-9A-Z]+)"		/* 6: type */
-    " "
-    "([+-])"			/* 7: recursion and flags */
-    "([A-Z]*)"			/* 8: recursion and flags */
-    " "
-    "\\(([0-9A-Fa-f:.]+)\\)"	/* 9: server address */
-    "$";
-#define NMATCH 10
+#include <logjam/prefilter.h>
 
 typedef struct lj_bind_ctx {
 	struct LJ_PARSER_CTX;
+	lj_prefilter *pf;
+	bool use_re;
 	regex_t re;
 } lj_bind_ctx;
 
 static lj_parser_ctx *lj_bind_init(void);
+static const char *lj_bind_get(lj_parser_ctx *, const char *);
+static int lj_bind_set(lj_parser_ctx *, const char *, const char *);
 static lj_logobj *lj_bind_parse(lj_parser_ctx *, const lj_logline *);
 static void lj_bind_fini(lj_parser_ctx *);
 
@@ -76,43 +60,95 @@ static lj_parser_ctx *
 lj_bind_init(void)
 {
 	lj_bind_ctx *ctx;
-	int ret;
 
 	if ((ctx = calloc(1, sizeof *ctx)) == NULL)
 		return (NULL);
 	ctx->parser = &lj_bind_parser;
-	if ((ret = regcomp(&ctx->re, bind_re, REG_EXTENDED)) != 0)
-		goto fail;
+	if ((ctx->pf = lj_prefilter_compile(lj_bind_re)) == NULL) {
+		free(ctx);
+		return (NULL);
+	}
 	return ((lj_parser_ctx *)ctx);
-fail:
-	lj_bind_fini((lj_parser_ctx *)ctx);
+}
+
+static const char *
+lj_bind_get(lj_parser_ctx *pctx, const char *key)
+{
+	lj_bind_ctx *ctx = (lj_bind_ctx *)pctx;
+
+	if (strcmp(key, "engine") == 0)
+		return (ctx->use_re ? "regex" : "scan");
 	return (NULL);
 }
 
+/*
+ * The "engine" property selects between the hand-written scanner, which
+ * is the default, and the regular expression it replaced.
+ */
+static int
+lj_bind_set(lj_parser_ctx *pctx, const char *key, const char *value)
+{
+	lj_bind_ctx *ctx = (lj_bind_ctx *)pctx;
+
+	if (strcmp(key, "engine") == 0) {
+		if (strcmp(value, "scan") == 0) {
+			if (ctx->use_re)
+				regfree(&ctx->re);
+			ctx->use_re = false;
+			return (0);
+		}
+		if (strcmp(value, "regex") == 0) {
+			if (!ctx->use_re &&
+			    regcomp(&ctx->re, lj_bind_re, REG_EXTENDED) != 0)
+				return (-1);
+			ctx->use_re = true;
+			return (0);
+		}
+	}
+	return (-1);
+}
+
 static lj_logobj *
 lj_bind_parse(lj_parser_ctx *pctx, const lj_logline *ll)
 {
 	lj_bind_ctx *ctx = (lj_bind_ctx *)pctx;
-	regmatch_t pmatch[NMATCH];
+	regmatch_t pmatch[LJ_BIND_RE_NMATCH];
+	lj_bind_field f[LJ_BIND_NFIELDS];
 	lj_logobj *lo;
+	unsigned int i;
 
-	if (regexec(&ctx->re, ll->what, NMATCH, pmatch, 0) != 0)
+	if (lj_prefilter_match(ctx->pf, ll->what, ll->len) != 0) {
+		lj_parser_skip(pctx);
+		return (NULL);
+	}
+	if (ctx->use_re) {
+		if (regexec(&ctx->re, ll->what, LJ_BIND_RE_NMATCH, pmatch,
+		    0) != 0) {
+			lj_parser_miss(pctx);
+			return (NULL);
+		}
+		for (i = 0; i < LJ_BIND_NFIELDS; ++i) {
+			f[i].off = pmatch[i + 2].rm_so;
+			f[i].len = pmatch[i + 2].rm_eo - pmatch[i + 2].rm_so;
+		}
+	} else if (lj_bind_scan(ll->what, f) != 0) {
+		lj_parser_miss(pctx);
 		return (NULL);
+	}
 	if ((lo = lj_logobj_create()) == NULL)
 		return (NULL);
 	if (lj_logobj_settime(lo, ll->when) != 0)
 		goto fail;
 #define LO_SET_STRN(KEY, N)					\
-	lj_logobj_setstrn(lo, KEY, ll->what + pmatch[N].rm_so,	\
-	    pmatch[N].rm_eo - pmatch[N].rm_so)
-	if (LO_SET_STRN("client_addr",   2) != 0 ||
-	    LO_SET_STRN("client_port",   3) != 0 ||
-	    LO_SET_STRN("dnsname",       4) != 0 ||
-	    LO_SET_STRN("class",         5) != 0 ||
-	    LO_SET_STRN("type",          6) != 0 ||
-	    LO_SET_STRN("recurse",       7) != 0 ||
-	    LO_SET_STRN("flags",         8) != 0 ||
-	    LO_SET_STRN("server_addr",   9) != 0)
+	lj_logobj_setstrn(lo, KEY, ll->what + f[N].off, f[N].len)
+	if (LO_SET_STRN("client_addr", LJ_BIND_CLIENT_ADDR) != 0 ||
+	    LO_SET_STRN("client_port", LJ_BIND_CLIENT_PORT) != 0 ||
+	    LO_SET_STRN("dnsname",     LJ_BIND_DNSNAME) != 0 ||
+	    LO_SET_STRN("class",       LJ_BIND_CLASS) != 0 ||
+	    LO_SET_STRN("type",        LJ_BIND_TYPE) != 0 ||
+	    LO_SET_STRN("recurse",     LJ_BIND_RECURSE) != 0 ||
+	    LO_SET_STRN("flags",       LJ_BIND_FLAGS) != 0 ||
+	    LO_SET_STRN("server_addr", LJ_BIND_SERVER_ADDR) != 0)
 		goto fail;
 #undef LO_SET_STRN
 	return (lo);
@@ -126,12 +162,16 @@ lj_bind_fini(lj_parser_ctx *pctx)
 {
 	lj_bind_ctx *ctx = (lj_bind_ctx *)pctx;
 
-	regfree(&ctx->re);
+	lj_prefilter_destroy(ctx->pf);
+	if (ctx->use_re)
+		regfree(&ctx->re);
 	free(ctx);
 }
 
 lj_parser lj_bind_parser = {
 	.init	 = lj_bind_init,
+	.get	 = lj_bind_get,
+	.set	 = lj_bind_set,
 	.parse	 = lj_bind_parse,
 	.fini	 = lj_bind_fini,
 };
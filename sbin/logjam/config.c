@@ -33,15 +33,19 @@
 
 #include <err.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <logjam/cirq.h>
+#include <logjam/clock.h>
 #include <logjam/config.h>
 #include <logjam/flume.h>
 #include <logjam/log.h>
 #include <logjam/parser.h>
 #include <logjam/reader.h>
 #include <logjam/sender.h>
+#include <logjam/strtosize.h>
 
 #include <jansson.h>
 
@@ -90,15 +94,20 @@ lj_config_unpack_reader(const char *cfn, json_t *obj)
 		key = json_object_iter_key(iter);
 		value = json_object_iter_value(iter);
 		if ((str = json_string_value(value)) == NULL) {
-			lj_error("%s: reader property '%s' must be a string", cfn, key);
-			return (NULL);
+			lj_error("%s: reader property '%s' must be a string",
+			    cfn, key);
+			goto fail;
 		}
 		if (rctx->reader->set(rctx, key, str) != 0) {
-			lj_error("%s: failed to set reader property '%s'", cfn, key);
-			return (NULL);
+			lj_error("%s: failed to set reader property '%s'",
+			    cfn, key);
+			goto fail;
 		}
 	}
 	return (rctx);
+fail:
+	lj_reader_fini(rctx);
+	return (NULL);
 }
 
 static lj_parser_ctx *
@@ -106,7 +115,8 @@ lj_config_unpack_parser(const char *cfn, json_t *obj)
 {
 	lj_parser_ctx *pctx;
 	const char *key, *str;
-	json_t *value;
+	json_t *value, *elem;
+	unsigned int i, n;
 	void *iter;
 
 	if (json_typeof(obj) != JSON_OBJECT) {
@@ -131,26 +141,57 @@ lj_config_unpack_parser(const char *cfn, json_t *obj)
 			lj_error("%s: failed to initialize BIND parser", cfn);
 			return (NULL);
 		}
+#if HAVE_LIBPCRE2_8
+	} else if (strcmp(str, "regex") == 0) {
+		if ((pctx = lj_regex_parser.init()) == NULL) {
+			lj_error("%s: failed to initialize regex parser", cfn);
+			return (NULL);
+		}
+#endif
 	} else {
 		lj_error("%s: unrecognized parser class '%s'", cfn, str);
 		return (NULL);
 	}
-	json_object_del(obj, "class");
+	/* keep the class, we may be called again with the same object */
 	for (iter = json_object_iter(obj);
 	     iter != NULL;
 	     iter = json_object_iter_next(obj, iter)) {
 		key = json_object_iter_key(iter);
 		value = json_object_iter_value(iter);
-		if ((str = json_string_value(value)) == NULL) {
-			lj_error("%s: parser property '%s' must be a string", cfn, key);
-			return (NULL);
+		if (strcmp(key, "class") == 0)
+			continue;
+		/* an array sets the same property once for each element */
+		if (json_typeof(value) == JSON_ARRAY) {
+			n = json_array_size(value);
+			elem = n > 0 ? json_array_get(value, 0) : NULL;
+		} else {
+			n = 1;
+			elem = value;
 		}
-		if (pctx->parser->set(pctx, key, str) != 0) {
-			lj_error("%s: failed to set parser property '%s'", cfn, key);
-			return (NULL);
+		for (i = 0; i < n; elem = json_array_get(value, ++i)) {
+			if ((str = json_string_value(elem)) == NULL) {
+				lj_error("%s: parser property '%s' must be a "
+				    "string or an array of strings", cfn, key);
+				goto fail;
+			}
+			if (pctx->parser->set(pctx, key, str) != 0) {
+				lj_error("%s: failed to set parser property "
+				    "'%s'", cfn, key);
+				goto fail;
+			}
 		}
 	}
+#if HAVE_LIBPCRE2_8
+	if (pctx->parser == &lj_regex_parser &&
+	    pctx->parser->get(pctx, "pattern") == NULL) {
+		lj_error("%s: regex parser has no pattern", cfn);
+		goto fail;
+	}
+#endif
 	return (pctx);
+fail:
+	lj_parser_fini(pctx);
+	return (NULL);
 }
 
 static lj_sender_ctx *
@@ -189,20 +230,241 @@ lj_config_unpack_sender(const char *cfn, json_t *obj)
 		key = json_object_iter_key(iter);
 		value = json_object_iter_value(iter);
 		if ((str = json_string_value(value)) == NULL) {
-			lj_error("%s: sender property '%s' must be a string", cfn, key);
-			return (NULL);
+			lj_error("%s: sender property '%s' must be a string",
+			    cfn, key);
+			goto fail;
 		}
 		if (sctx->sender->set(sctx, key, str) != 0) {
-			lj_error("%s: failed to set sender property '%s'", cfn, key);
-			return (NULL);
+			lj_error("%s: failed to set sender property '%s'",
+			    cfn, key);
+			goto fail;
 		}
 	}
+	if (sctx->sender == &lj_elk_sender &&
+	    sctx->sender->get(sctx, "server") == NULL) {
+		lj_error("%s: elk sender has no server", cfn);
+		goto fail;
+	}
 	return (sctx);
+fail:
+	lj_sender_fini(sctx);
+	return (NULL);
+}
+
+/*
+ * Unpack a size, which is either a non-negative integer or a string
+ * consisting of a number optionally followed by k, M or G.
+ */
+static int
+lj_config_unpack_size(json_t *obj, size_t *size)
+{
+	const char *str;
+
+	if (json_is_integer(obj)) {
+		if (json_integer_value(obj) < 0)
+			return (-1);
+		*size = json_integer_value(obj);
+		return (0);
+	}
+	if ((str = json_string_value(obj)) == NULL)
+		return (-1);
+	return (lj_strtosize(str, size));
+}
+
+static int
+lj_config_unpack_queue(const char *cfn, const char *name, json_t *obj,
+    lj_flume_queue *q)
+{
+	const char *key, *str;
+	json_t *value;
+	void *iter;
+
+	if (json_typeof(obj) != JSON_OBJECT) {
+		lj_error("%s: %s queue must be an object", cfn, name);
+		return (-1);
+	}
+	for (iter = json_object_iter(obj);
+	     iter != NULL;
+	     iter = json_object_iter_next(obj, iter)) {
+		key = json_object_iter_key(iter);
+		value = json_object_iter_value(iter);
+		if (strcmp(key, "overflow") == 0) {
+			if ((str = json_string_value(value)) == NULL) {
+				lj_error("%s: %s queue overflow policy must be "
+				    "a string", cfn, name);
+				return (-1);
+			}
+			q->flags &= ~CIRQ_OVERFLOW;
+			if (strcmp(str, "drop-oldest") == 0) {
+				q->flags |= CIRQ_DROP_OLDEST;
+			} else if (strcmp(str, "drop-newest") == 0) {
+				q->flags |= CIRQ_DROP_NEWEST;
+			} else if (strcmp(str, "block") == 0) {
+				q->flags |= CIRQ_BLOCK;
+			} else {
+				lj_error("%s: invalid %s queue overflow policy "
+				    "'%s'", cfn, name, str);
+				return (-1);
+			}
+		} else if (strcmp(key, "records") == 0) {
+			if (lj_config_unpack_size(value, &q->size) != 0 ||
+			    q->size < 2) {
+				lj_error("%s: invalid %s queue capacity",
+				    cfn, name);
+				return (-1);
+			}
+		} else if (strcmp(key, "bytes") == 0) {
+			if (lj_config_unpack_size(value, &q->budget) != 0) {
+				lj_error("%s: invalid %s queue budget",
+				    cfn, name);
+				return (-1);
+			}
+		} else {
+			lj_error("%s: unknown %s queue property %s",
+			    cfn, name, key);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+static int
+lj_config_unpack_queues(const char *cfn, json_t *obj, lj_flume *flume)
+{
+	const char *key;
+	json_t *value;
+	void *iter;
+
+	if (json_typeof(obj) != JSON_OBJECT) {
+		lj_error("%s: queue must be an object", cfn);
+		return (-1);
+	}
+	for (iter = json_object_iter(obj);
+	     iter != NULL;
+	     iter = json_object_iter_next(obj, iter)) {
+		key = json_object_iter_key(iter);
+		value = json_object_iter_value(iter);
+		if (strcmp(key, "input") == 0) {
+			if (lj_config_unpack_queue(cfn, key, value,
+			    &flume->iq) != 0)
+				return (-1);
+		} else if (strcmp(key, "output") == 0) {
+			if (lj_config_unpack_queue(cfn, key, value,
+			    &flume->oq) != 0)
+				return (-1);
+		} else {
+			lj_error("%s: unknown queue %s", cfn, key);
+			return (-1);
+		}
+	}
+	return (0);
+}
+
+static int
+lj_config_unpack_spool(const char *cfn, json_t *obj, lj_flume_spool *sp)
+{
+	const char *key, *str;
+	json_t *value;
+	void *iter;
+
+	if (json_typeof(obj) != JSON_OBJECT) {
+		lj_error("%s: spool must be an object", cfn);
+		return (-1);
+	}
+	for (iter = json_object_iter(obj);
+	     iter != NULL;
+	     iter = json_object_iter_next(obj, iter)) {
+		key = json_object_iter_key(iter);
+		value = json_object_iter_value(iter);
+		if (strcmp(key, "path") == 0) {
+			if ((str = json_string_value(value)) == NULL) {
+				lj_error("%s: spool path must be a string",
+				    cfn);
+				return (-1);
+			}
+			free(sp->path);
+			if ((sp->path = strdup(str)) == NULL)
+				return (-1);
+		} else if (strcmp(key, "segment-size") == 0) {
+			if (lj_config_unpack_size(value, &sp->segsize) != 0) {
+				lj_error("%s: invalid spool segment size", cfn);
+				return (-1);
+			}
+		} else if (strcmp(key, "max-size") == 0) {
+			if (lj_config_unpack_size(value, &sp->maxsize) != 0) {
+				lj_error("%s: invalid spool size", cfn);
+				return (-1);
+			}
+		} else if (strcmp(key, "high-water") == 0) {
+			if (lj_config_unpack_size(value,
+			    &sp->highwater) != 0) {
+				lj_error("%s: invalid spool high-water mark",
+				    cfn);
+				return (-1);
+			}
+		} else {
+			lj_error("%s: unknown spool property %s", cfn, key);
+			return (-1);
+		}
+	}
+	if (sp->path == NULL) {
+		lj_error("%s: spool has no path", cfn);
+		return (-1);
+	}
+	return (0);
+}
+
+static int
+lj_config_unpack_batch(const char *cfn, json_t *obj, lj_flume_batching *bt)
+{
+	const char *key;
+	json_t *value;
+	void *iter;
+
+	if (json_typeof(obj) != JSON_OBJECT) {
+		lj_error("%s: batch must be an object", cfn);
+		return (-1);
+	}
+	for (iter = json_object_iter(obj);
+	     iter != NULL;
+	     iter = json_object_iter_next(obj, iter)) {
+		key = json_object_iter_key(iter);
+		value = json_object_iter_value(iter);
+		if (strcmp(key, "records") == 0) {
+			if (lj_config_unpack_size(value, &bt->records) != 0 ||
+			    bt->records < 1 ||
+			    bt->records > LJ_FLUME_MAX_BATCH) {
+				lj_error("%s: batch size must be between 1 "
+				    "and %d records", cfn, LJ_FLUME_MAX_BATCH);
+				return (-1);
+			}
+		} else if (strcmp(key, "bytes") == 0) {
+			if (lj_config_unpack_size(value, &bt->bytes) != 0) {
+				lj_error("%s: invalid batch size in bytes",
+				    cfn);
+				return (-1);
+			}
+		} else if (strcmp(key, "delay") == 0) {
+			if (!json_is_integer(value) ||
+			    json_integer_value(value) < 0 ||
+			    json_integer_value(value) > 60000) {
+				lj_error("%s: batch delay must be an integer "
+				    "between 0 and 60000", cfn);
+				return (-1);
+			}
+			bt->delay = json_integer_value(value);
+		} else {
+			lj_error("%s: unknown batch property %s", cfn, key);
+			return (-1);
+		}
+	}
+	return (0);
 }
 
 static lj_flume *
 lj_config_unpack_flume(const char *cfn, json_t *obj)
 {
+	unsigned int i, nworkers;
 	lj_flume *flume;
 	const char *key;
 	json_t *value;
@@ -212,27 +474,63 @@ lj_config_unpack_flume(const char *cfn, json_t *obj)
 		return (NULL);
 	if (json_typeof(obj) != JSON_OBJECT) {
 		lj_error("%s: flume must be an object", cfn);
-		return (NULL);
+		goto fail;
 	}
 	/* first, pull the required items */
 	if ((value = json_object_get(obj, "reader")) == NULL) {
 		lj_error("%s: flume has no reader", cfn);
-		return (NULL);
+		goto fail;
 	}
-	flume->rctx = lj_config_unpack_reader(cfn, value);
+	if ((flume->rctx = lj_config_unpack_reader(cfn, value)) == NULL)
+		goto fail;
 	json_object_del(obj, "reader");
+	if ((value = json_object_get(obj, "workers")) == NULL) {
+		nworkers = 1;
+	} else if (!json_is_integer(value) ||
+	    json_integer_value(value) < 1 ||
+	    json_integer_value(value) > LJ_FLUME_MAX_WORKERS) {
+		lj_error("%s: workers must be an integer between 1 and %d",
+		    cfn, LJ_FLUME_MAX_WORKERS);
+		goto fail;
+	} else {
+		nworkers = json_integer_value(value);
+		json_object_del(obj, "workers");
+	}
+	if (lj_flume_set_workers(flume, nworkers) != 0)
+		goto fail;
 	if ((value = json_object_get(obj, "parser")) == NULL) {
 		lj_error("%s: flume has no parser", cfn);
-		return (NULL);
+		goto fail;
 	}
-	flume->pctx = lj_config_unpack_parser(cfn, value);
+	/* each worker gets its own parser context */
+	for (i = 0; i < nworkers; ++i)
+		if ((flume->workers[i].pctx =
+		    lj_config_unpack_parser(cfn, value)) == NULL)
+			goto fail;
 	json_object_del(obj, "parser");
 	if ((value = json_object_get(obj, "sender")) == NULL) {
 		lj_error("%s: flume has no sender", cfn);
-		return (NULL);
+		goto fail;
 	}
-	flume->sctx = lj_config_unpack_sender(cfn, value);
+	if ((flume->sctx = lj_config_unpack_sender(cfn, value)) == NULL)
+		goto fail;
 	json_object_del(obj, "sender");
+	/* then the optional ones */
+	if ((value = json_object_get(obj, "queue")) != NULL) {
+		if (lj_config_unpack_queues(cfn, value, flume) != 0)
+			goto fail;
+		json_object_del(obj, "queue");
+	}
+	if ((value = json_object_get(obj, "spool")) != NULL) {
+		if (lj_config_unpack_spool(cfn, value, &flume->sp) != 0)
+			goto fail;
+		json_object_del(obj, "spool");
+	}
+	if ((value = json_object_get(obj, "batch")) != NULL) {
+		if (lj_config_unpack_batch(cfn, value, &flume->bt) != 0)
+			goto fail;
+		json_object_del(obj, "batch");
+	}
 	/* then iterate over the rest */
 	for (iter = json_object_iter(obj);
 	     iter != NULL;
@@ -241,29 +539,54 @@ lj_config_unpack_flume(const char *cfn, json_t *obj)
 		value = json_object_iter_value(iter);
 		lj_error("%s: unknown flume property %s", cfn, key);
 		/* XXX warn or bail? */
-		return (NULL);
+		goto fail;
 	}
 	return (flume);
+fail:
+	lj_flume_fini(flume);
+	return (NULL);
 }
 
 static lj_flume *
 lj_config_unpack_flumes(const char *cfn, json_t *ary)
 {
-	lj_flume *flume = NULL;
+	lj_flume *flumes = NULL, **next = &flumes, *flume, *fp;
 	unsigned int i, n;
 	json_t *obj;
 
-	if (json_typeof(ary) != JSON_ARRAY)
+	if (json_typeof(ary) != JSON_ARRAY) {
 		lj_error("%s: value of 'flumes' must be an array", cfn);
+		return (NULL);
+	}
+	if (json_array_size(ary) == 0) {
+		lj_error("%s: at least one flume is required", cfn);
+		return (NULL);
+	}
 	for (i = 0, n = json_array_size(ary); i < n; ++i) {
 		obj = json_array_get(ary, i);
-		if (flume != NULL) {
-			lj_error("%s: multiple flumes are not yet supported", cfn);
-			return (NULL);
+		if ((flume = lj_config_unpack_flume(cfn, obj)) == NULL)
+			goto fail;
+		flume->id = i;
+		*next = flume;
+		next = &flume->next;
+		/* two flumes can't share a spool */
+		for (fp = flumes; fp != flume && flume->sp.path != NULL;
+		     fp = fp->next) {
+			if (fp->sp.path != NULL &&
+			    strcmp(fp->sp.path, flume->sp.path) == 0) {
+				lj_error("%s: flumes %u and %u have the same "
+				    "spool", cfn, fp->id, flume->id);
+				goto fail;
+			}
 		}
-		flume = lj_config_unpack_flume(cfn, obj);
 	}
-	return (flume);
+	return (flumes);
+fail:
+	while ((flume = flumes) != NULL) {
+		flumes = flume->next;
+		lj_flume_fini(flume);
+	}
+	return (NULL);
 }
 
 static void
@@ -287,10 +610,26 @@ lj_config_unpack_log_level(const char *cfn, json_t *value)
 		lj_error("%s: invalid log_level", cfn);
 }
 
+static int
+lj_config_unpack_clock(const char *cfn, json_t *value)
+{
+	const char *str;
+
+	if ((str = json_string_value(value)) == NULL) {
+		lj_error("%s: clock must be a string", cfn);
+		return (-1);
+	}
+	if (lj_clock_set_mode(str) != 0) {
+		lj_error("%s: invalid clock mode %s", cfn, str);
+		return (-1);
+	}
+	return (0);
+}
+
 static lj_flume *
 lj_config_unpack_root(const char *cfn, json_t *obj)
 {
-	lj_flume *flume = NULL;
+	lj_flume *flume = NULL, *fp;
 	const char *key;
 	json_t *value;
 	void *iter;
@@ -306,12 +645,17 @@ lj_config_unpack_root(const char *cfn, json_t *obj)
 		value = json_object_iter_value(iter);
 		if (strcmp(key, "flumes") == 0) {
 			if (flume != NULL) {
-				lj_error("%s: multiple flumes are not yet supported", cfn);
+				lj_error("%s: multiple flume arrays", cfn);
 				goto fail;
 			}
-			flume = lj_config_unpack_flumes(cfn, value);
+			if ((flume = lj_config_unpack_flumes(cfn, value)) ==
+			    NULL)
+				goto fail;
 		} else if (strcmp(key, "log_level") == 0) {
 			lj_config_unpack_log_level(cfn, value);
+		} else if (strcmp(key, "clock") == 0) {
+			if (lj_config_unpack_clock(cfn, value) != 0)
+				goto fail;
 		} else {
 			lj_error("%s: unexpected key %s", cfn, key);
 			goto fail;
@@ -321,8 +665,10 @@ lj_config_unpack_root(const char *cfn, json_t *obj)
 		lj_error("%s: at least one flume is required", cfn);
 	return (flume);
 fail:
-	if (flume != NULL)
-		lj_flume_fini(flume);
+	while ((fp = flume) != NULL) {
+		flume = fp->next;
+		lj_flume_fini(fp);
+	}
 	return (NULL);
 }
 
@@ -31,24 +31,147 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <jansson.h>
 
+#include <logjam/json.h>
 #include <logjam/log.h>
 #include <logjam/logobj.h>
 #include <logjam/sender.h>
 #include <logjam/socket.h>
+#include <logjam/strlcpy.h>
+#include <logjam/strtosize.h>
+
+/*
+ * Connections are shared between all senders pointed at the same
+ * server with the same client certificate, if any, so multiple flumes
+ * can use a single TLS session.  Each record is written while holding
+ * the connection's lock, so records sent by different flumes don't
+ * interleave.
+ */
+typedef struct lj_elk_conn {
+	struct lj_elk_conn *next;
+	char		 server[256];
+	char		 cert[PATH_MAX];	/* empty if none */
+	lj_socket	*sock;
+	pthread_mutex_t	 mutex;
+	unsigned int	 refs;
+} lj_elk_conn;
+
+static lj_elk_conn *lj_elk_conns;
+static pthread_mutex_t lj_elk_conns_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The template holds the fields we add to every record.  It is
+ * serialized once, whenever it changes, and the result is tacked on to
+ * the end of each record as it is written out.
+ */
+#define LJ_ELK_MAXTKEYS 2
+
+/*
+ * Records are collected in an output buffer and written out together
+ * once the buffer holds more than a full TLS record's worth, once the
+ * oldest record in it has waited long enough, or when the sender
+ * thread runs out of records to send, whichever comes first.
+ */
+#define LJ_ELK_FLUSHSIZE	16384
+#define LJ_ELK_MAXDELAY		100000	/* microseconds */
+
+/* how long to wait for a connection before giving up for now (ms) */
+#define LJ_ELK_CONNWAIT		100
 
 typedef struct lj_elk_ctx {
 	struct LJ_SENDER_CTX;
 	json_t *template;
-	lj_socket *sock;
+	char *fragment;			/* serialized template */
+	size_t fraglen;
+	int tkeys[LJ_ELK_MAXTKEYS];	/* interned template keys */
+	unsigned int ntkeys;
+	char *buf;			/* output buffer */
+	size_t buflen;
+	size_t bufsize;
+	size_t flushsize;		/* flush when buflen reaches this */
+	uint64_t since;			/* when buf last became non-empty */
+	char cert[PATH_MAX];		/* client certificate, if any */
+	lj_elk_conn *conn;
 } lj_elk_ctx;
 
+/*
+ * Look up or create a connection to the given server using the given
+ * client certificate, or none if cert is empty.
+ */
+static lj_elk_conn *
+lj_elk_conn_get(const char *server, const char *cert)
+{
+	lj_elk_conn *conn;
+
+	pthread_mutex_lock(&lj_elk_conns_mutex);
+	for (conn = lj_elk_conns; conn != NULL; conn = conn->next)
+		if (strcmp(conn->server, server) == 0 &&
+		    strcmp(conn->cert, cert) == 0)
+			break;
+	if (conn != NULL) {
+		conn->refs++;
+		pthread_mutex_unlock(&lj_elk_conns_mutex);
+		return (conn);
+	}
+	if ((conn = calloc(1, sizeof *conn)) == NULL)
+		goto fail;
+	if (strlcpy(conn->server, server, sizeof conn->server) >=
+	    sizeof conn->server ||
+	    strlcpy(conn->cert, cert, sizeof conn->cert) >=
+	    sizeof conn->cert) {
+		errno = EINVAL;
+		goto fail;
+	}
+	if ((conn->sock = sock_create(server)) == NULL ||
+	    sock_use_tls(conn->sock) != 0 ||
+	    (*cert != '\0' && sock_use_cert(conn->sock, cert) != 0))
+		goto fail;
+	if (pthread_mutex_init(&conn->mutex, NULL) != 0)
+		goto fail;
+	conn->refs = 1;
+	conn->next = lj_elk_conns;
+	lj_elk_conns = conn;
+	pthread_mutex_unlock(&lj_elk_conns_mutex);
+	return (conn);
+fail:
+	if (conn != NULL && conn->sock != NULL)
+		sock_destroy(conn->sock);
+	free(conn);
+	pthread_mutex_unlock(&lj_elk_conns_mutex);
+	return (NULL);
+}
+
+/*
+ * Release a connection, and close it if no other sender is using it.
+ */
+static void
+lj_elk_conn_put(lj_elk_conn *conn)
+{
+	lj_elk_conn **cp;
+
+	pthread_mutex_lock(&lj_elk_conns_mutex);
+	if (--conn->refs > 0) {
+		pthread_mutex_unlock(&lj_elk_conns_mutex);
+		return;
+	}
+	for (cp = &lj_elk_conns; *cp != conn; cp = &(*cp)->next)
+		/* nothing */ ;
+	*cp = conn->next;
+	pthread_mutex_unlock(&lj_elk_conns_mutex);
+	sock_destroy(conn->sock);
+	pthread_mutex_destroy(&conn->mutex);
+	free(conn);
+}
+
 static lj_sender_ctx *
 lj_elk_init(void)
 {
@@ -57,6 +180,7 @@ lj_elk_init(void)
 	if ((ctx = calloc(1, sizeof *ctx)) == NULL)
 		return (NULL);
 	ctx->sender = &lj_elk_sender;
+	ctx->flushsize = LJ_ELK_FLUSHSIZE;
 	if ((ctx->template = json_object()) == NULL)
 		goto fail;
 	return ((lj_sender_ctx *)ctx);
@@ -71,6 +195,8 @@ lj_elk_get(lj_sender_ctx *sctx, const char *key)
 {
 	lj_elk_ctx *ctx = (lj_elk_ctx *)sctx;
 
+	if (strcmp(key, "server") == 0)
+		return (ctx->conn != NULL ? ctx->conn->server : NULL);
 	if (strcmp(key, "logowner") == 0 ||
 	    strcmp(key, "application") == 0) {
 		return (json_string_value(json_object_get(ctx->template, key)));
@@ -81,27 +207,102 @@ lj_elk_get(lj_sender_ctx *sctx, const char *key)
 static int
 lj_elk_set_server(lj_elk_ctx *ctx, const char *server)
 {
-	lj_socket *sock;
+	lj_elk_conn *conn;
 
-	if ((sock = sock_create(server)) == NULL)
+	if ((conn = lj_elk_conn_get(server, ctx->cert)) == NULL)
 		return (-1);
-	if (sock_use_tls(sock) != 0) {
-		sock_destroy(sock);
+	if (ctx->conn != NULL)
+		lj_elk_conn_put(ctx->conn);
+	ctx->conn = conn;
+	return (0);
+}
+
+/*
+ * Since the certificate is part of what identifies a connection,
+ * changing it means switching to a different one, so other senders
+ * which share our current connection are not affected.
+ */
+static int
+lj_elk_set_cert(lj_elk_ctx *ctx, const char *cert)
+{
+	char old[sizeof ctx->cert];
+
+	memcpy(old, ctx->cert, sizeof old);
+	if (strlcpy(ctx->cert, cert, sizeof ctx->cert) >= sizeof ctx->cert) {
+		memcpy(ctx->cert, old, sizeof old);
+		errno = EINVAL;
+		return (-1);
+	}
+	if (ctx->conn != NULL &&
+	    lj_elk_set_server(ctx, ctx->conn->server) != 0) {
+		memcpy(ctx->cert, old, sizeof old);
 		return (-1);
 	}
-	if (ctx->sock != NULL)
-		sock_destroy(ctx->sock);
-	ctx->sock = sock;
 	return (0);
 }
 
+/*
+ * Set a template field and serialize the template again.  The fragment
+ * starts with a comma so it can be appended to a record as is.
+ */
 static int
-lj_elk_set_cert(lj_elk_ctx *ctx, const char *cert)
+lj_elk_set_template(lj_elk_ctx *ctx, const char *key, const char *value)
+{
+	int tkeys[LJ_ELK_MAXTKEYS];
+	const char *tkey, *tvalue;
+	unsigned int ntkeys;
+	size_t len, size;
+	char *fragment;
+	void *iter;
+
+	if (json_object_set_new(ctx->template, key, json_string(value)) != 0)
+		return (-1);
+	size = 0;
+	for (iter = json_object_iter(ctx->template);
+	     iter != NULL;
+	     iter = json_object_iter_next(ctx->template, iter)) {
+		tkey = json_object_iter_key(iter);
+		tvalue = json_string_value(json_object_iter_value(iter));
+		size += 2 + LJ_JSON_QUOTE_MAX(strlen(tkey)) +
+		    LJ_JSON_QUOTE_MAX(strlen(tvalue));
+	}
+	if ((fragment = malloc(size)) == NULL)
+		return (-1);
+	len = ntkeys = 0;
+	for (iter = json_object_iter(ctx->template);
+	     iter != NULL;
+	     iter = json_object_iter_next(ctx->template, iter)) {
+		tkey = json_object_iter_key(iter);
+		tvalue = json_string_value(json_object_iter_value(iter));
+		if (ntkeys == LJ_ELK_MAXTKEYS ||
+		    (tkeys[ntkeys++] = lj_logobj_intern(tkey)) < 0) {
+			free(fragment);
+			return (-1);
+		}
+		fragment[len++] = ',';
+		len += lj_json_quote(fragment + len, tkey, strlen(tkey));
+		fragment[len++] = ':';
+		len += lj_json_quote(fragment + len, tvalue, strlen(tvalue));
+	}
+	free(ctx->fragment);
+	ctx->fragment = fragment;
+	ctx->fraglen = len;
+	memcpy(ctx->tkeys, tkeys, sizeof tkeys);
+	ctx->ntkeys = ntkeys;
+	return (0);
+}
+
+static int
+lj_elk_set_bufsize(lj_elk_ctx *ctx, const char *str)
 {
+	size_t size;
 
-	if (ctx->sock == NULL)
+	if (lj_strtosize(str, &size) != 0) {
+		errno = EINVAL;
 		return (-1);
-	return (sock_use_cert(ctx->sock, cert));
+	}
+	ctx->flushsize = size;
+	return (0);
 }
 
 static int
@@ -111,70 +312,226 @@ lj_elk_set(lj_sender_ctx *sctx, const char *key, const char *value)
 
 	if (strcmp(key, "logowner") == 0 ||
 	    strcmp(key, "application") == 0) {
-		if (json_object_set_new(ctx->template, key, json_string(value)) != 0)
-			return (-1);
-		return (0);
+		return (lj_elk_set_template(ctx, key, value));
 	} else if (strcmp(key, "server") == 0) {
 		return (lj_elk_set_server(ctx, value));
 	} else if (strcmp(key, "cert") == 0) {
 		return (lj_elk_set_cert(ctx, value));
+	} else if (strcmp(key, "bufsize") == 0) {
+		return (lj_elk_set_bufsize(ctx, value));
 	}
 	return (-1);
 }
 
 static int
-lj_elk_json_callback(const char *buffer, size_t size, void *data)
+lj_elk_write(lj_elk_ctx *ctx, const char *buffer, size_t size)
 {
-	lj_elk_ctx *ctx = (lj_elk_ctx *)data;
 
 	if (size > SSIZE_MAX)
 		return (-1);
 	if (lj_log_level <= LJ_LOG_LEVEL_DEBUG)
 		fwrite(buffer, size, 1, stderr);
-	if (sock_write(ctx->sock, buffer, size) != (ssize_t)size)
+	if (sock_write(ctx->conn->sock, buffer, size) != (ssize_t)size)
 		return (-1);
 	return (0);
 }
 
+/*
+ * Make sure the output buffer has room for at least size bytes.
+ */
 static int
-lj_elk_send(lj_sender_ctx *sctx, const lj_logobj *lo)
+lj_elk_reserve(lj_elk_ctx *ctx, size_t size)
+{
+	size_t bufsize;
+	char *buf;
+
+	if (size <= ctx->bufsize)
+		return (0);
+	for (bufsize = ctx->bufsize ? ctx->bufsize : 4096;
+	     bufsize < size; bufsize *= 2)
+		/* nothing */ ;
+	if ((buf = realloc(ctx->buf, bufsize)) == NULL)
+		return (-1);
+	ctx->buf = buf;
+	ctx->bufsize = bufsize;
+	return (0);
+}
+
+/*
+ * Serialize a record, followed by the template and a newline, and
+ * append it to the output buffer.  Fields which are also in the
+ * template are left out, as the template takes precedence.
+ */
+static int
+lj_elk_format(lj_elk_ctx *ctx, const lj_logobj *lo)
+{
+	const lj_logobj_field *field;
+	const char *key;
+	unsigned int i, j;
+	size_t keylen, len, start;
+
+	len = start = ctx->buflen;
+	if (lj_elk_reserve(ctx, len + 1) != 0)
+		return (-1);
+	ctx->buf[len++] = '{';
+	for (i = 0, field = lo->fields; i < lo->nfields; ++i, ++field) {
+		for (j = 0; j < ctx->ntkeys; ++j)
+			if (field->key == ctx->tkeys[j])
+				break;
+		if (j < ctx->ntkeys)
+			continue;
+		key = lj_logobj_key(field->key);
+		keylen = strlen(key);
+		if (lj_elk_reserve(ctx, len + 2 + LJ_JSON_QUOTE_MAX(keylen) +
+		    LJ_JSON_QUOTE_MAX(field->len)) != 0)
+			return (-1);
+		if (len > start + 1)
+			ctx->buf[len++] = ',';
+		len += lj_json_quote(ctx->buf + len, key, keylen);
+		ctx->buf[len++] = ':';
+		len += lj_json_quote(ctx->buf + len, lo->buf + field->off,
+		    field->len);
+	}
+	if (lj_elk_reserve(ctx, len + ctx->fraglen + 2) != 0)
+		return (-1);
+	if (ctx->fraglen > 0) {
+		/* skip the leading comma if the record was empty */
+		j = (len == start + 1);
+		memcpy(ctx->buf + len, ctx->fragment + j, ctx->fraglen - j);
+		len += ctx->fraglen - j;
+	}
+	ctx->buf[len++] = '}';
+	ctx->buf[len++] = '\n';
+	ctx->buflen = len;
+	return (0);
+}
+
+static uint64_t
+lj_elk_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*
+ * If we aren't already connected, or our existing connection has
+ * failed, move the connection along.  The socket backs off between
+ * failed attempts on its own; we wait a little for it either way so
+ * the sender thread doesn't spin while the server is unreachable.
+ * Must be called with the connection locked.
+ */
+static int
+lj_elk_connect(lj_elk_ctx *ctx)
+{
+
+	return (sock_advance(ctx->conn->sock, LJ_ELK_CONNWAIT));
+}
+
+/*
+ * Write out the contents of the output buffer.  If that fails, we have
+ * no way of knowing how much of it the server received, so we hold on
+ * to all of it and try again once we have reconnected.  The server may
+ * therefore see some records twice, but it won't miss any.
+ */
+static int
+lj_elk_flush(lj_sender_ctx *sctx)
 {
 	lj_elk_ctx *ctx = (lj_elk_ctx *)sctx;
-	json_t *obj;
 	int ret;
 
-	/*
-	 * If we aren't already connected, or our existing connection has
-	 * failed, attempt to (re)connect.  We should probably have some
-	 * sort of exponential backoff here, and perhaps also move this
-	 * out of lj_elk_send() and into the sender thread's main loop.
-	 */
-	if (!sock_connected(ctx->sock) && sock_reopen(ctx->sock) != 0)
+	if (ctx->buflen == 0)
+		return (0);
+	if (ctx->conn == NULL)
 		return (-1);
+	pthread_mutex_lock(&ctx->conn->mutex);
+	if ((ret = lj_elk_connect(ctx)) == 0 &&
+	    (ret = lj_elk_write(ctx, ctx->buf, ctx->buflen)) == 0)
+		ctx->buflen = ctx->since = 0;
+	pthread_mutex_unlock(&ctx->conn->mutex);
+	return (ret);
+}
+
+/*
+ * Add up to n records to the output buffer, and flush it if it's time.
+ * The whole buffer goes out in a single call to sock_write(), which
+ * GnuTLS splits into as few records as possible.  Once a record has
+ * been accepted, it is our responsibility, so we only reject records if
+ * we have no connection and can't get one back, in which case errno is
+ * EAGAIN, or if we ran out of memory.  Returns the number of records
+ * accepted.
+ */
+static size_t
+lj_elk_send_batch(lj_sender_ctx *sctx, lj_logobj *const *lo, size_t n)
+{
+	lj_elk_ctx *ctx = (lj_elk_ctx *)sctx;
+	uint64_t now;
+	size_t i;
+	int ret;
 
-	/*
-	 * Create and transmit json object
-	 */
-	ret = -1;
-	if ((obj = json_copy(lo->json)) != NULL &&
-	    json_object_update(obj, ctx->template) == 0) {
-		if (json_dump_callback(obj, lj_elk_json_callback,
-		    ctx, JSON_PRESERVE_ORDER | JSON_COMPACT) == 0)
-			ret = 0;
-		/*
-		 * Jansson's error reporting isn't very good, so we don't
-		 * know the exact source of the error.  If it occurred
-		 * within Jansson itself rather than at the connection or
-		 * encryption level, it is probably recoverable, but there
-		 * is a risk that we sent a partial record.  Therefore, we
-		 * always send a newline, even if we failed to send the
-		 * record itself.
-		 */
-		if (lj_elk_json_callback("\n", 1, ctx) != 0)
-			ret = -1;
+	if (ctx->conn == NULL) {
+		errno = EDESTADDRREQ;
+		return (0);
 	}
-	json_decref(obj);
-	return (ret);
+	pthread_mutex_lock(&ctx->conn->mutex);
+	ret = lj_elk_connect(ctx);
+	pthread_mutex_unlock(&ctx->conn->mutex);
+	if (ret != 0) {
+		errno = EAGAIN;
+		return (0);
+	}
+	for (i = 0; i < n; ++i)
+		if (lj_elk_format(ctx, lo[i]) != 0)
+			break;
+	if (ctx->buflen == 0)
+		return (i);
+	now = lj_elk_now();
+	if (ctx->since == 0)
+		ctx->since = now;
+	if (ctx->buflen >= ctx->flushsize ||
+	    now - ctx->since >= LJ_ELK_MAXDELAY)
+		(void)lj_elk_flush(sctx);
+	return (i);
+}
+
+static int
+lj_elk_send(lj_sender_ctx *sctx, const lj_logobj *lo)
+{
+
+	return (lj_elk_send_batch(sctx, (lj_logobj *const *)&lo, 1) == 1 ?
+	    0 : -1);
+}
+
+/*
+ * Take back up to n records from the output buffer, oldest first.  Each
+ * line in the buffer is a JSON object which deserializes into the
+ * record it came from, with the template merged in; the template keys
+ * are left out again if the record is resent.  Lines which can't be
+ * parsed are dropped.
+ */
+static size_t
+lj_elk_reclaim(lj_sender_ctx *sctx, lj_logobj **lo, size_t n)
+{
+	lj_elk_ctx *ctx = (lj_elk_ctx *)sctx;
+	char *eol;
+	size_t i, len, off;
+
+	for (i = off = 0; i < n && off < ctx->buflen; off += len + 1) {
+		eol = memchr(ctx->buf + off, '\n', ctx->buflen - off);
+		len = (eol != NULL ? (size_t)(eol - ctx->buf) : ctx->buflen) -
+		    off;
+		lo[i] = lj_logobj_deserialize(ctx->buf + off, len);
+		if (lo[i] != NULL)
+			i++;
+	}
+	if (off > ctx->buflen)
+		off = ctx->buflen;
+	memmove(ctx->buf, ctx->buf + off, ctx->buflen - off);
+	ctx->buflen -= off;
+	if (ctx->buflen == 0)
+		ctx->since = 0;
+	return (i);
 }
 
 static void
@@ -182,9 +539,14 @@ lj_elk_fini(lj_sender_ctx *sctx)
 {
 	lj_elk_ctx *ctx = (lj_elk_ctx *)sctx;
 
+	if (lj_elk_flush(sctx) != 0 && ctx->buflen > 0)
+		lj_error("%s: failed to send %zu bytes",
+		    ctx->conn->server, ctx->buflen);
 	json_decref(ctx->template);
-	if (ctx->sock != NULL)
-		sock_destroy(ctx->sock);
+	free(ctx->fragment);
+	free(ctx->buf);
+	if (ctx->conn != NULL)
+		lj_elk_conn_put(ctx->conn);
 	free(ctx);
 }
 
@@ -193,5 +555,8 @@ lj_sender lj_elk_sender = {
 	.get	 = lj_elk_get,
 	.set	 = lj_elk_set,
 	.send	 = lj_elk_send,
+	.send_batch = lj_elk_send_batch,
+	.flush	 = lj_elk_flush,
+	.reclaim = lj_elk_reclaim,
 	.fini	 = lj_elk_fini,
 };
@@ -31,13 +31,17 @@
 #include "config.h"
 #endif
 
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include <sys/stat.h>
-#include <sys/time.h>
 
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,24 +49,155 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <logjam/chunk.h>
+#include <logjam/clock.h>
 #include <logjam/ctype.h>
+#include <logjam/eol.h>
 #include <logjam/log.h>
 #include <logjam/logobj.h>
 #include <logjam/reader.h>
+#include <logjam/ring.h>
 #include <logjam/strlcat.h>
 #include <logjam/strlcpy.h>
-#include <logjam/time.h>
+#include <logjam/strtosize.h>
+#include <logjam/timefmt.h>
+
+/* how long to sleep between polls when inotify is not available */
+#define LJ_FILE_POLL_MS		100
+
+/* maximum number of line ends found per scan */
+#define LJ_FILE_MAX_EOL		1024
+
+/* default buffer size, also the maximum line length */
+#define LJ_FILE_BUFSIZE		65536
 
 typedef struct lj_file_ctx {
 	struct LJ_READER_CTX;
 	int		 fd;
 	struct stat	 st;
-	size_t		 pos, endl, len;
-	char		 datefmt[64];
+	bool		 moved;		/* the file may have been rotated */
+#if HAVE_SYS_INOTIFY_H
+	int		 ifd;		/* inotify descriptor or -1 */
+	int		 fwd, dwd;	/* file and directory watches */
+	const char	*base;		/* base name of path */
+#endif
+	size_t		 bufsize;	/* buffer or chunk size */
+	lj_ring		 ring;		/* ring buffer, or... */
+	lj_chunk_pool	*pool;		/* ...chunks loglines refer to */
+	lj_chunk	*chunk;		/* current chunk */
+	uint64_t	 pos;		/* start of next line */
+	uint64_t	 endl;		/* end of data scanned for EOL */
+	uint64_t	 len;		/* end of data */
+	uint64_t	 eoff;		/* start of last scan */
+	size_t		 ieol, neol;	/* next and number of line ends */
+	size_t		 eol[LJ_FILE_MAX_EOL];
+	lj_timefmt	*datefmt;	/* timestamp format, if any */
 	char		 path[1024];
-	char		 buf[65536];
 } lj_file_ctx;
 
+/*
+ * Return a pointer to the byte at the specified offset in the buffer.
+ */
+static inline char *
+lj_file_ptr(lj_file_ctx *ctx, uint64_t off)
+{
+
+	if (ctx->chunk != NULL)
+		return (ctx->chunk->data + off);
+	return (lj_ring_ptr(&ctx->ring, off));
+}
+
+/*
+ * Release the buffer.
+ */
+static void
+lj_file_freebuf(lj_file_ctx *ctx)
+{
+
+	if (ctx->chunk != NULL)
+		lj_chunk_unref(ctx->chunk, 1);
+	lj_chunk_pool_destroy(ctx->pool);
+	lj_ring_fini(&ctx->ring);
+	ctx->chunk = NULL;
+	ctx->pool = NULL;
+}
+
+/*
+ * Replace the buffer with a ring or a pool of chunks of the requested
+ * size.  Anything already read from the file but not yet consumed is
+ * copied over, provided it fits.
+ *
+ * In a ring, lines are copied out as they are read, and space is reused
+ * as soon as they have been.  With chunks, loglines refer directly to
+ * the chunk their text was read into, and each chunk is recycled once
+ * every logline referring to it has been destroyed.  The only copy is
+ * that of a partial line at the end of a chunk, which is moved to the
+ * start of the next.
+ */
+static int
+lj_file_setbuf(lj_file_ctx *ctx, bool chunks, size_t size)
+{
+	lj_chunk_pool *pool;
+	lj_chunk *chunk;
+	lj_ring ring;
+	size_t used;
+	char *buf;
+
+	used = ctx->len - ctx->pos;
+	if (used > size) {
+		errno = ENOBUFS;
+		return (-1);
+	}
+	pool = NULL;
+	chunk = NULL;
+	ring.base = NULL;
+	if (chunks) {
+		if ((pool = lj_chunk_pool_create(size)) == NULL)
+			return (-1);
+		if ((chunk = lj_chunk_get(pool)) == NULL) {
+			lj_chunk_pool_destroy(pool);
+			return (-1);
+		}
+		buf = chunk->data;
+	} else {
+		if (lj_ring_init(&ring, size) != 0)
+			return (-1);
+		size = ring.size;
+		buf = ring.base;
+	}
+	if (used > 0)
+		memcpy(buf, lj_file_ptr(ctx, ctx->pos), used);
+	lj_file_freebuf(ctx);
+	ctx->bufsize = size;
+	ctx->ring = ring;
+	ctx->pool = pool;
+	ctx->chunk = chunk;
+	ctx->pos = ctx->endl = 0;
+	ctx->len = used;
+	ctx->ieol = ctx->neol = 0;
+	return (0);
+}
+
+/*
+ * Move the unconsumed data at the end of the current chunk to the start
+ * of a fresh one.
+ */
+static int
+lj_file_nextchunk(lj_file_ctx *ctx)
+{
+	lj_chunk *chunk;
+
+	if ((chunk = lj_chunk_get(ctx->pool)) == NULL)
+		return (-1);
+	memcpy(chunk->data, ctx->chunk->data + ctx->pos, ctx->len - ctx->pos);
+	lj_chunk_unref(ctx->chunk, 1);
+	ctx->chunk = chunk;
+	ctx->len -= ctx->pos;
+	ctx->endl -= ctx->pos;
+	ctx->pos = 0;
+	return (0);
+}
+
 static lj_reader_ctx *
 lj_file_init(void)
 {
@@ -72,6 +207,13 @@ lj_file_init(void)
 		return (NULL);
 	ctx->reader = &lj_file_reader;
 	ctx->fd = -1;
+#if HAVE_SYS_INOTIFY_H
+	ctx->ifd = ctx->fwd = ctx->dwd = -1;
+#endif
+	if (lj_file_setbuf(ctx, false, LJ_FILE_BUFSIZE) != 0) {
+		free(ctx);
+		return (NULL);
+	}
 	return ((lj_reader_ctx *)ctx);
 }
 
@@ -86,6 +228,57 @@ lj_file_get(lj_reader_ctx *rctx, const char *key)
 	return (NULL);
 }
 
+#if HAVE_SYS_INOTIFY_H
+/*
+ * Stop using inotify and fall back to polling.
+ */
+static void
+lj_file_unwatch(lj_file_ctx *ctx)
+{
+
+	if (ctx->ifd >= 0)
+		close(ctx->ifd);
+	ctx->ifd = ctx->fwd = ctx->dwd = -1;
+}
+
+/*
+ * Watch the file for writes and for being moved or deleted, and its
+ * parent directory for a new file appearing under the same name.
+ */
+static void
+lj_file_watch(lj_file_ctx *ctx)
+{
+	char dir[sizeof ctx->path];
+	char *p;
+
+	if (ctx->ifd < 0 &&
+	    (ctx->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		lj_verbose("%s: inotify: %s, polling instead", ctx->path,
+		    strerror(errno));
+		return;
+	}
+	if (ctx->fwd >= 0)
+		inotify_rm_watch(ctx->ifd, ctx->fwd);
+	ctx->fwd = inotify_add_watch(ctx->ifd, ctx->path,
+	    IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+	strlcpy(dir, ctx->path, sizeof dir);
+	if ((p = strrchr(dir, '/')) == NULL) {
+		strlcpy(dir, ".", sizeof dir);
+		ctx->base = ctx->path;
+	} else {
+		/* "/foo" lives in "/", not "" */
+		p[p == dir] = '\0';
+		ctx->base = ctx->path + (p - dir) + 1;
+	}
+	ctx->dwd = inotify_add_watch(ctx->ifd, dir, IN_CREATE | IN_MOVED_TO);
+	if (ctx->fwd < 0 || ctx->dwd < 0) {
+		lj_verbose("%s: inotify: %s, polling instead", ctx->path,
+		    strerror(errno));
+		lj_file_unwatch(ctx);
+	}
+}
+#endif
+
 static int
 lj_file_reopen(lj_file_ctx *ctx, const char *path)
 {
@@ -95,13 +288,29 @@ lj_file_reopen(lj_file_ctx *ctx, const char *path)
 		path = ctx->path;
 	if ((fd = open(path, O_RDONLY)) == -1)
 		return (-1);
+	/* loglines may still refer to the current chunk */
+	if (ctx->chunk != NULL) {
+		ctx->pos = ctx->endl = ctx->len;
+		if (lj_file_nextchunk(ctx) != 0) {
+			close(fd);
+			return (-1);
+		}
+	}
 	if (path != ctx->path)
 		strlcpy(ctx->path, path, sizeof ctx->path);
 	close(ctx->fd);
 	ctx->fd = fd;
 	fstat(ctx->fd, &ctx->st);
-	memset(ctx->buf, 0, sizeof ctx->buf);
 	ctx->pos = ctx->endl = ctx->len = 0;
+	ctx->ieol = ctx->neol = 0;
+#if HAVE_SYS_INOTIFY_H
+	lj_file_watch(ctx);
+#endif
+	/*
+	 * The file may have been replaced between open() and setting up
+	 * the watch, so check once more when we next reach EOF.
+	 */
+	ctx->moved = true;
 	return (0);
 }
 
@@ -119,15 +328,45 @@ lj_file_set_path(lj_file_ctx *ctx, const char *path)
 static int
 lj_file_set_datefmt(lj_file_ctx *ctx, const char *datefmt)
 {
+	lj_timefmt *tf;
 
-	if (strlen(datefmt) >= sizeof ctx->datefmt) {
-		errno = ENAMETOOLONG;
-		return (-1);
+	tf = NULL;
+	if (*datefmt != '\0') {
+		if ((tf = lj_timefmt_compile(datefmt)) == NULL)
+			return (-1);
+		if (!lj_timefmt_compiled(tf))
+			lj_verbose("%s: no fast path for this date format",
+			    datefmt);
 	}
-	strlcpy(ctx->datefmt, datefmt, sizeof ctx->datefmt);
+	lj_timefmt_destroy(ctx->datefmt);
+	ctx->datefmt = tf;
 	return (0);
 }
 
+static int
+lj_file_set_bufsize(lj_file_ctx *ctx, const char *str)
+{
+	size_t size;
+
+	if (lj_strtosize(str, &size) != 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+	return (lj_file_setbuf(ctx, ctx->chunk != NULL, size));
+}
+
+static int
+lj_file_set_buffer(lj_file_ctx *ctx, const char *str)
+{
+
+	if (strcmp(str, "ring") == 0)
+		return (lj_file_setbuf(ctx, false, ctx->bufsize));
+	if (strcmp(str, "chunks") == 0)
+		return (lj_file_setbuf(ctx, true, ctx->bufsize));
+	errno = EINVAL;
+	return (-1);
+}
+
 static int
 lj_file_set(lj_reader_ctx *rctx, const char *key, const char *value)
 {
@@ -137,6 +376,10 @@ lj_file_set(lj_reader_ctx *rctx, const char *key, const char *value)
 		return (lj_file_set_path(ctx, value));
 	if (strcmp(key, "datefmt") == 0)
 		return (lj_file_set_datefmt(ctx, value));
+	if (strcmp(key, "bufsize") == 0)
+		return (lj_file_set_bufsize(ctx, value));
+	if (strcmp(key, "buffer") == 0)
+		return (lj_file_set_buffer(ctx, value));
 	return (-1);
 }
 
@@ -146,35 +389,50 @@ lj_fillbuf(lj_file_ctx *ctx)
 	struct stat st;
 	ssize_t rlen;
 
-	/* make room at end of buffer */
-	if (ctx->pos > 0) {
-		memmove(ctx->buf, ctx->buf + ctx->pos,
-		    ctx->len - ctx->pos);
-		ctx->len -= ctx->pos;
-		ctx->endl -= ctx->pos;
-		ctx->pos = 0;
-	}
 	/* check if the buffer is full */
-	if (ctx->len >= sizeof ctx->buf) {
+	if (ctx->len - ctx->pos >= ctx->bufsize) {
 		errno = ENOBUFS;
 		return (-1);
 	}
-	/* read more data into the buffer */
-	rlen = sizeof ctx->buf - ctx->len;
-	if ((rlen = read(ctx->fd, ctx->buf + ctx->len, rlen)) < 0) {
+	/*
+	 * Read more data into the buffer, right after what we already
+	 * have.  The ring is mapped twice, so the free space is contiguous
+	 * even if it wraps around.  If we run out of room at the end of a
+	 * chunk, move on to the next.
+	 */
+	if (ctx->chunk != NULL) {
+		if (ctx->len == ctx->bufsize && lj_file_nextchunk(ctx) != 0)
+			return (-1);
+		rlen = ctx->bufsize - ctx->len;
+	} else {
+		rlen = ctx->bufsize - (ctx->len - ctx->pos);
+	}
+	if ((rlen = read(ctx->fd, lj_file_ptr(ctx, ctx->len), rlen)) < 0) {
 		lj_warning("%s: %s", ctx->path, strerror(errno));
 		return (rlen);
 	}
-	/* end of file */
+	/*
+	 * At end of file, check if the file has been rotated.  With
+	 * inotify, we only need to do so if we were told that it was
+	 * moved or deleted or that a new file appeared in its place.
+	 * Otherwise, we have to check every time.
+	 */
 	if (rlen == 0) {
-		/* has the file been rotated? */
-		if (stat(ctx->path, &st) == 0) {
+#if HAVE_SYS_INOTIFY_H
+		if (ctx->ifd < 0)
+			ctx->moved = true;
+#else
+		ctx->moved = true;
+#endif
+		if (ctx->moved && stat(ctx->path, &st) == 0) {
 			if (st.st_dev != ctx->st.st_dev ||
 			    st.st_ino != ctx->st.st_ino) {
 				lj_verbose("%s has been rotated", ctx->path);
 				raise(SIGUSR2);
 				if (lj_file_reopen(ctx, NULL) < 0)
 					return (-1);
+			} else {
+				ctx->moved = false;
 			}
 		}
 		errno = EAGAIN;
@@ -184,23 +442,36 @@ lj_fillbuf(lj_file_ctx *ctx)
 	return (rlen);
 }
 
-static const char *
-lj_getline(lj_file_ctx *ctx)
+static char *
+lj_getline(lj_file_ctx *ctx, size_t *len)
 {
-	const char *ret;
+	char *ret;
 	ssize_t rlen;
+	uint64_t eol;
 
-	ctx->endl = ctx->pos;
 	for (;;) {
-		/* search for EOL in existing data */
-		while (ctx->endl < ctx->len) {
-			if (ctx->buf[ctx->endl] == '\n') {
-				ctx->buf[ctx->endl++] = '\0';
-				ret = ctx->buf + ctx->pos;
-				ctx->pos = ctx->endl;
-				return (ret);
-			}
-			ctx->endl++;
+		/* return the next line found by the previous scan */
+		if (ctx->ieol < ctx->neol) {
+			eol = ctx->eoff + ctx->eol[ctx->ieol++];
+			*lj_file_ptr(ctx, eol) = '\0';
+			ret = lj_file_ptr(ctx, ctx->pos);
+			*len = eol - ctx->pos;
+			ctx->pos = eol + 1;
+			return (ret);
+		}
+		/* find all line ends in data we have not yet looked at */
+		if (ctx->endl < ctx->len) {
+			ctx->eoff = ctx->endl;
+			ctx->ieol = 0;
+			ctx->neol = lj_eol_scan(lj_file_ptr(ctx, ctx->eoff),
+			    0, ctx->len - ctx->eoff, ctx->eol, LJ_FILE_MAX_EOL);
+			if (ctx->neol == LJ_FILE_MAX_EOL)
+				ctx->endl = ctx->eoff +
+				    ctx->eol[ctx->neol - 1] + 1;
+			else
+				ctx->endl = ctx->len;
+			if (ctx->neol > 0)
+				continue;
 		}
 		/*
 		 * If the buffer is full and we still failed to find EOL,
@@ -209,8 +480,8 @@ lj_getline(lj_file_ctx *ctx)
 		 * return its truncated tail, but we don't really care, as
 		 * it will most likely be discarded downstream.
 		 */
-		if (ctx->pos == 0 && ctx->endl == sizeof ctx->buf) {
-			ctx->endl = ctx->len = 0;
+		if (ctx->endl - ctx->pos == ctx->bufsize) {
+			ctx->pos = ctx->endl = ctx->len;
 			errno = EMSGSIZE;
 			lj_warning("%s: %s", ctx->path, strerror(errno));
 			return (NULL);
@@ -225,31 +496,78 @@ static lj_logline *
 lj_file_read(lj_reader_ctx *rctx)
 {
 	lj_file_ctx *ctx = (lj_file_ctx *)rctx;
-	struct tm tm;
-	struct timeval tv;
-	lj_logline *ll;
-	const char *str;
+	const char *p;
 	uint64_t when;
+	size_t len;
+	char *str;
 
-	if ((str = lj_getline(ctx)) == NULL)
+	if ((str = lj_getline(ctx, &len)) == NULL)
 		return (NULL);
 
 	/* try to get the timestamp, fall back to current time */
 	when = 0;
-	if (ctx->datefmt != NULL) {
-		str = lj_strptime(str, ctx->datefmt, &tm);
-		when = timelocal(&tm) * 1000000;
+	if (ctx->datefmt != NULL &&
+	    (p = lj_timefmt_parse(ctx->datefmt, str, &when)) != NULL) {
+		len -= p - str;
+		str += p - str;
 	}
-	if ((ll = calloc(1, sizeof *ll)) == NULL)
-		return (NULL);
-	if (when > 0) {
-		ll->when = when;
-	} else {
-		gettimeofday(&tv, NULL);
-		ll->when = tv.tv_sec * 1000000 + tv.tv_usec;
+	if (when == 0)
+		when = lj_clock_now();
+	if (ctx->chunk != NULL)
+		return (lj_logline_view(when, str, len, ctx->chunk));
+	return (lj_logline_create(when, str, len));
+}
+
+/*
+ * Wait for the file to be written to or replaced.  Without inotify, we
+ * simply sleep for a short while.
+ */
+static int
+lj_file_wait(lj_reader_ctx *rctx, unsigned int timeout_ms)
+{
+	lj_file_ctx *ctx = (lj_file_ctx *)rctx;
+#if HAVE_SYS_INOTIFY_H
+	char buf[4096]
+	    __attribute__((__aligned__(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	struct pollfd pfd;
+	ssize_t rlen;
+	char *p;
+	int ret;
+
+	if (ctx->ifd >= 0) {
+		pfd.fd = ctx->ifd;
+		pfd.events = POLLIN;
+		if ((ret = poll(&pfd, 1, timeout_ms)) <= 0)
+			return (ret < 0 && errno != EINTR ? -1 : 0);
+		while ((rlen = read(ctx->ifd, buf, sizeof buf)) > 0) {
+			for (p = buf; p < buf + rlen;
+			    p += sizeof *ev + ev->len) {
+				ev = (const struct inotify_event *)p;
+				if (ev->mask & IN_Q_OVERFLOW)
+					ctx->moved = true;
+				else if (ev->wd == ctx->fwd && (ev->mask &
+				    (IN_MOVE_SELF | IN_DELETE_SELF)))
+					ctx->moved = true;
+				else if (ev->wd == ctx->dwd && ev->len > 0 &&
+				    strcmp(ev->name, ctx->base) == 0)
+					ctx->moved = true;
+			}
+		}
+		if (rlen < 0 && errno != EAGAIN) {
+			lj_warning("%s: inotify: %s, polling instead",
+			    ctx->path, strerror(errno));
+			lj_file_unwatch(ctx);
+		}
+		return (1);
 	}
-	strlcpy(ll->what, str, sizeof ll->what);
-	return (ll);
+#else
+	(void)ctx;
+#endif
+	if (timeout_ms > LJ_FILE_POLL_MS)
+		timeout_ms = LJ_FILE_POLL_MS;
+	poll(NULL, 0, timeout_ms);
+	return (0);
 }
 
 static void
@@ -257,7 +575,12 @@ lj_file_fini(lj_reader_ctx *rctx)
 {
 	lj_file_ctx *ctx = (lj_file_ctx *)rctx;
 
+#if HAVE_SYS_INOTIFY_H
+	lj_file_unwatch(ctx);
+#endif
 	close(ctx->fd);
+	lj_file_freebuf(ctx);
+	lj_timefmt_destroy(ctx->datefmt);
 	free(ctx);
 }
 
@@ -266,5 +589,6 @@ lj_reader lj_file_reader = {
 	.get	 = lj_file_get,
 	.set	 = lj_file_set,
 	.read	 = lj_file_read,
+	.wait	 = lj_file_wait,
 	.fini	 = lj_file_fini,
 };
@@ -33,10 +33,13 @@
 
 #include <stdlib.h>
 
+#include <logjam/cirq.h>
 #include <logjam/flume.h>
 #include <logjam/parser.h>
+#include <logjam/pool.h>
 #include <logjam/reader.h>
 #include <logjam/sender.h>
+#include <logjam/spool.h>
 
 lj_flume *
 lj_flume_init(void)
@@ -45,18 +48,72 @@ lj_flume_init(void)
 
 	if ((flume = calloc(1, sizeof *flume)) == NULL)
 		return (NULL);
+	flume->iq.size = flume->oq.size = LJ_FLUME_QUEUE_SIZE;
+	flume->sp.segsize = LJ_FLUME_SPOOL_SEGSIZE;
+	flume->sp.maxsize = LJ_FLUME_SPOOL_MAXSIZE;
+	flume->bt.records = LJ_FLUME_BATCH_RECORDS;
+	if (pthread_mutex_init(&flume->claim, NULL) != 0) {
+		free(flume);
+		return (NULL);
+	}
+	if (pthread_mutex_init(&flume->reorder, NULL) != 0) {
+		pthread_mutex_destroy(&flume->claim);
+		free(flume);
+		return (NULL);
+	}
+	if (pthread_cond_init(&flume->reordered, NULL) != 0) {
+		pthread_mutex_destroy(&flume->reorder);
+		pthread_mutex_destroy(&flume->claim);
+		free(flume);
+		return (NULL);
+	}
 	return (flume);
 }
 
+/*
+ * Set the number of parser workers.  The caller is responsible for
+ * creating a parser context for each of them.
+ */
+int
+lj_flume_set_workers(lj_flume *flume, unsigned int n)
+{
+	lj_flume_worker *workers;
+	unsigned int i;
+
+	if (n < 1 || n > LJ_FLUME_MAX_WORKERS || flume->workers != NULL)
+		return (-1);
+	if ((workers = calloc(n, sizeof *workers)) == NULL)
+		return (-1);
+	for (i = 0; i < n; ++i)
+		workers[i].flume = flume;
+	flume->workers = workers;
+	flume->nworkers = n;
+	return (0);
+}
+
 void
 lj_flume_fini(lj_flume *flume)
 {
+	unsigned int i;
 
 	if (flume->rctx != NULL)
 		lj_reader_fini(flume->rctx);
-	if (flume->pctx != NULL)
-		lj_parser_fini(flume->pctx);
+	for (i = 0; i < flume->nworkers; ++i) {
+		if (flume->workers[i].pctx != NULL)
+			lj_parser_fini(flume->workers[i].pctx);
+		lj_pool_destroy(flume->workers[i].logobjs);
+	}
+	free(flume->workers);
 	if (flume->sctx != NULL)
 		lj_sender_fini(flume->sctx);
+	cirq_destroy(flume->iq.cirq);
+	cirq_destroy(flume->oq.cirq);
+	spool_close(flume->sp.spool);
+	free(flume->sp.path);
+	free(flume->window);
+	lj_pool_destroy(flume->slabs);
+	pthread_cond_destroy(&flume->reordered);
+	pthread_mutex_destroy(&flume->reorder);
+	pthread_mutex_destroy(&flume->claim);
 	free(flume);
 }
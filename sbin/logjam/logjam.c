@@ -39,18 +39,27 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <logjam/arena.h>
 #include <logjam/cirq.h>
+#include <logjam/clock.h>
 #include <logjam/config.h>
 #include <logjam/flume.h>
 #include <logjam/log.h>
 #include <logjam/logobj.h>
 #include <logjam/parser.h>
+#include <logjam/pool.h>
 #include <logjam/reader.h>
 #include <logjam/sender.h>
+#include <logjam/spool.h>
 
-#define CIRQ_SIZE 1024
+#define BATCH_SIZE 256
+
+/* upper bound on how long the reader waits for more input (ms) */
+#define READER_WAIT 1000
 
 static volatile sig_atomic_t sigusr1;
 static volatile sig_atomic_t sigusr2;
@@ -58,13 +67,6 @@ static volatile sig_atomic_t sigterm;
 
 static volatile bool quit;
 
-static cirq *li_cirq;
-static cirq *lo_cirq;
-
-static pthread_t rthr;
-static pthread_t pthr;
-static pthread_t sthr;
-
 static void
 sig_handler(int signo)
 {
@@ -83,115 +85,574 @@ sig_handler(int signo)
 	}
 }
 
+static size_t
+logline_size(const void *p)
+{
+
+	return (sizeof(lj_logline) + ((const lj_logline *)p)->len + 1);
+}
+
+static size_t
+logobj_size(const void *p)
+{
+
+	return (((const lj_logobj *)p)->size);
+}
+
+static void
+logline_destroy(void *p)
+{
+
+	lj_logline_destroy(p);
+}
+
+static void
+logobj_destroy(void *p)
+{
+
+	lj_logobj_destroy(p);
+}
+
+/*
+ * Place a batch of objects on one of the flume's queues.  Objects which
+ * were displaced or rejected are destroyed, unless the queue's overflow
+ * policy is to block, in which case whatever did not fit is moved to the
+ * front of the batch and the count is returned so the caller can try
+ * again later.
+ */
+static size_t
+enqueue(lj_flume_queue *q, void **obj, size_t n, void (*destroy)(void *))
+{
+	void *old[BATCH_SIZE];
+	size_t i, nold;
+
+	if (n == 0)
+		return (0);
+	nold = cirq_put_batch(q->cirq, obj, n, old, 100000);
+	if ((q->flags & CIRQ_OVERFLOW) == CIRQ_BLOCK) {
+		for (i = 0; i < nold; ++i)
+			obj[i] = old[i];
+		return (nold);
+	}
+	for (i = 0; i < nold; ++i)
+		destroy(old[i]);
+	return (0);
+}
+
 static void *
 rthr_main(void *arg)
 {
-	lj_reader_ctx *ctx = arg;
-	lj_logline *ll;
+	lj_flume *flume = arg;
+	lj_reader_ctx *ctx = flume->rctx;
+	lj_logline *ll[BATCH_SIZE];
+	size_t n;
+	int eof;
 
+	lj_arena_bind(flume->slabs);
+	n = 0;
 	while (!quit) {
-		if ((ll = ctx->reader->read(ctx)) == NULL) {
-			if (errno != EAGAIN)
-				break;
-			usleep(100000);
-			continue;
-		}
-		if ((ll = cirq_put(li_cirq, ll)) != NULL) {
-			/* destroy displaced entry */
-			free(ll);
+		/*
+		 * Read until we have a full batch or run out of data, unless
+		 * we are still holding on to lines that the input queue was
+		 * too full to accept.  Lines too long for the reader's buffer
+		 * are skipped.
+		 */
+		eof = 0;
+		if (n == 0) {
+			lj_clock_tick();
+			while (n < BATCH_SIZE && !eof) {
+				if ((ll[n] = ctx->reader->read(ctx)) != NULL)
+					n++;
+				else if (errno == EAGAIN)
+					eof = 1;
+				else if (errno != EMSGSIZE)
+					eof = -1;
+			}
 		}
+		n = enqueue(&flume->iq, (void **)ll, n, logline_destroy);
+		if (eof > 0 && n == 0 && lj_reader_wait(ctx, READER_WAIT) < 0)
+			eof = -1;
+		if (eof < 0)
+			break;
 	}
+	lj_logline_destroy_batch(ll, n);
+	lj_arena_bind(NULL);
 	return (NULL);
 }
 
+/*
+ * A parsed batch waiting in a flume's reorder window.
+ */
+struct lj_flume_batch {
+	lj_logobj	*lo[BATCH_SIZE];
+	size_t		 n;
+	bool		 ready;
+};
+
+/*
+ * Deposit a parsed batch in the reorder window, then place every batch
+ * that is now in order on the output queue.
+ */
+static void
+reorder(lj_flume *flume, uint64_t seq, lj_logobj **lo, size_t n)
+{
+	struct lj_flume_batch *b;
+
+	pthread_mutex_lock(&flume->reorder);
+	/* our slot may still belong to a batch which hasn't arrived yet */
+	while (seq - flume->nplaced >= flume->nwindow)
+		pthread_cond_wait(&flume->reordered, &flume->reorder);
+	b = &flume->window[seq % flume->nwindow];
+	memcpy(b->lo, lo, n * sizeof *lo);
+	b->n = n;
+	b->ready = true;
+	while ((b = &flume->window[flume->nplaced % flume->nwindow])->ready) {
+		/* if the output queue blocks, so do we */
+		while ((b->n = enqueue(&flume->oq, (void **)b->lo, b->n,
+		    logobj_destroy)) > 0 && !quit)
+			/* nothing */ ;
+		while (b->n > 0)
+			lj_logobj_destroy(b->lo[--b->n]);
+		b->ready = false;
+		flume->nplaced++;
+	}
+	pthread_cond_broadcast(&flume->reordered);
+	pthread_mutex_unlock(&flume->reorder);
+}
+
+/*
+ * Parser worker.
+ */
 static void *
 pthr_main(void *arg)
 {
-	lj_parser_ctx *ctx = arg;
-	lj_logline *ll;
-	lj_logobj *lo;
+	lj_flume_worker *worker = arg;
+	lj_flume *flume = worker->flume;
+	lj_parser_ctx *ctx = worker->pctx;
+	lj_logline *ll[BATCH_SIZE];
+	lj_logobj *lo[BATCH_SIZE];
+	size_t i, n, nlo;
+	uint64_t seq;
+	int serrno;
 
+	lj_logobj_bind(worker->logobjs);
 	while (!quit) {
-		if ((ll = cirq_get(li_cirq, 100000)) == NULL) {
-			if (errno != ETIMEDOUT)
+		/* claim the next batch; this also keeps iq single-consumer */
+		pthread_mutex_lock(&flume->claim);
+		n = cirq_get_batch(flume->iq.cirq, (void **)ll, BATCH_SIZE,
+		    100000);
+		serrno = errno;
+		seq = flume->nclaimed;
+		if (n > 0)
+			flume->nclaimed++;
+		pthread_mutex_unlock(&flume->claim);
+		if (n == 0) {
+			if (serrno != ETIMEDOUT)
 				break;
 			continue;
 		}
-		if ((lo = ctx->parser->parse(ctx, ll)) != NULL) {
-			if ((lo = cirq_put(lo_cirq, lo)) != NULL) {
-				/* destroy displaced entry */
-				lj_logobj_destroy(lo);
-			}
-		}
-		free(ll);
+		for (i = nlo = 0; i < n; ++i)
+			if ((lo[nlo] = ctx->parser->parse(ctx, ll[i])) != NULL)
+				nlo++;
+		lj_logline_destroy_batch(ll, n);
+		reorder(flume, seq, lo, nlo);
 	}
+	lj_logobj_bind(NULL);
 	return (NULL);
 }
 
+/*
+ * Move records to the spool, oldest first.  Records which cannot be
+ * spooled are dropped.
+ */
+static void
+spill(lj_flume *flume, lj_logobj **lo, size_t n)
+{
+	lj_flume_spool *sp = &flume->sp;
+	size_t i, len;
+	char *buf;
+
+	for (i = 0; i < n; ++i) {
+		if ((buf = lj_logobj_serialize(lo[i], &len)) != NULL &&
+		    spool_append(sp->spool, buf, len) == 0)
+			__atomic_fetch_add(&sp->nspill, 1, __ATOMIC_RELAXED);
+		else
+			__atomic_fetch_add(&sp->ndrop, 1, __ATOMIC_RELAXED);
+		free(buf);
+		lj_logobj_destroy(lo[i]);
+	}
+}
+
+/*
+ * Hand a batch of records to the sender.  A record which the sender
+ * rejects for any other reason than not being able to take records
+ * right now would only be rejected again, so we drop it instead of
+ * retrying.  Without a spool, we keep going until the sender has taken
+ * the whole batch or we are told to quit.  Returns the number of
+ * records, from the start of the batch, which we are done with; the
+ * caller still owns all of them.
+ */
+static size_t
+deliver(lj_flume *flume, lj_logobj *const *lo, size_t n)
+{
+	lj_sender_ctx *ctx = flume->sctx;
+	size_t i;
+
+	for (i = 0; i < n; ) {
+		if ((i += lj_sender_send_batch(ctx, lo + i, n - i)) == n)
+			break;
+		if (errno != EAGAIN) {
+			lj_error("%u: sender rejected a record: %s",
+			    flume->id, strerror(errno));
+			i++;
+		} else if (flume->sp.spool != NULL || quit) {
+			break;
+		}
+	}
+	return (i);
+}
+
+/*
+ * Take back whatever the sender has accepted but not yet flushed and
+ * move it to the spool.
+ */
+static void
+reclaim(lj_flume *flume)
+{
+	lj_logobj *lo[BATCH_SIZE];
+	size_t n;
+
+	while ((n = lj_sender_reclaim(flume->sctx, lo, BATCH_SIZE)) > 0)
+		spill(flume, lo, n);
+}
+
+/*
+ * Flush the sender.  If that fails and we have a spool, the records the
+ * sender was holding on to go into it, so that the sender never keeps
+ * anything across a failure.
+ */
+static int
+flush(lj_flume *flume)
+{
+
+	if (lj_sender_flush(flume->sctx) == 0)
+		return (0);
+	if (flume->sp.spool != NULL)
+		reclaim(flume);
+	return (-1);
+}
+
+/*
+ * Send up to a batch of records from the spool, oldest first.  They are
+ * only read ahead, not consumed, until the sender has flushed them.  If
+ * the sender fails, we take back what it was holding on to and throw it
+ * away, since the spool still has it, and return -1.
+ */
+static int
+replay(lj_flume *flume)
+{
+	lj_sender_ctx *ctx = flume->sctx;
+	lj_flume_spool *sp = &flume->sp;
+	lj_logobj *lo[BATCH_SIZE];
+	const void *buf;
+	ssize_t len;
+	size_t i, n, nbad, nlo;
+
+	len = 0;
+	n = nbad = nlo = 0;
+	while (n < BATCH_SIZE &&
+	    (len = spool_peek_next(sp->spool, &buf)) > 0) {
+		n++;
+		if ((lo[nlo] = lj_logobj_deserialize(buf, len)) != NULL)
+			nlo++;
+		else
+			nbad++; /* unreadable, skip it */
+	}
+	i = deliver(flume, lo, nlo);
+	while (nlo > 0)
+		lj_logobj_destroy(lo[--nlo]);
+	if (i < n - nbad || lj_sender_flush(ctx) != 0) {
+		while ((n = lj_sender_reclaim(ctx, lo, BATCH_SIZE)) > 0)
+			while (n > 0)
+				lj_logobj_destroy(lo[--n]);
+		spool_rewind(sp->spool);
+		return (-1);
+	}
+	spool_commit(sp->spool, n);
+	__atomic_fetch_add(&sp->nreplay, n - nbad, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&sp->ndrop, nbad, __ATOMIC_RELAXED);
+	return (len < 0 ? -1 : 0);
+}
+
+/*
+ * Microseconds on the monotonic clock.
+ */
+static uint64_t
+monotime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+/*
+ * Take a batch of records off the output queue.  Once we have at least
+ * one, keep waiting for more until the batch is full, in records or in
+ * bytes, or the batching policy's delay has passed.  Returns 0 with
+ * errno set if the queue stayed empty or an error occurred.
+ */
+static size_t
+collect(lj_flume *flume, lj_logobj **lo)
+{
+	lj_flume_batching *bt = &flume->bt;
+	uint64_t deadline, now;
+	size_t bytes, i, m, n;
+
+	if ((n = cirq_get_batch(flume->oq.cirq, (void **)lo, bt->records,
+	    100000)) == 0 || bt->delay == 0)
+		return (n);
+	for (i = bytes = 0; i < n; ++i)
+		bytes += lo[i]->size;
+	deadline = monotime() + bt->delay * 1000;
+	while (n < bt->records && (bt->bytes == 0 || bytes < bt->bytes) &&
+	    !quit && (now = monotime()) < deadline) {
+		m = cirq_get_batch(flume->oq.cirq, (void **)lo + n,
+		    bt->records - n, deadline - now);
+		for (i = n; i < n + m; ++i)
+			bytes += lo[i]->size;
+		n += m;
+	}
+	return (n);
+}
+
+/*
+ * Sender thread.  If the flume has a spool, the invariant is that every
+ * record in the spool is older than every record in the output queue.
+ * Spooled records are therefore replayed before anything is taken off
+ * the queue, and when the sender fails, the rest of the batch goes into
+ * the spool, preceded by whatever the sender had accepted but not yet
+ * flushed and followed by anything that piles up in the queue past the
+ * high-water mark until we try again.  Without a spool, we hold on to
+ * records the sender won't take until it does, and the output queue's
+ * overflow policy decides what happens to the rest.  Whenever the
+ * queue runs dry, we tell the sender to flush whatever it has buffered.
+ */
 static void *
 sthr_main(void *arg)
 {
-	lj_sender_ctx *ctx = arg;
-	lj_logobj *lo;
+	lj_flume *flume = arg;
+	lj_flume_spool *sp = &flume->sp;
+	lj_logobj *lo[LJ_FLUME_MAX_BATCH];
+	time_t retry;
+	size_t i, j, n;
 
-	(void)ctx;
+	retry = 0;
 	while (!quit) {
-		if ((lo = cirq_get(lo_cirq, 100000)) == NULL) {
+		if (sp->spool != NULL) {
+			if (retry != 0 && time(NULL) < retry) {
+				if (cirq_len(flume->oq.cirq) < sp->highwater) {
+					usleep(100000);
+					continue;
+				}
+				n = cirq_get_batch(flume->oq.cirq, (void **)lo,
+				    BATCH_SIZE, 0);
+				spill(flume, lo, n);
+				continue;
+			}
+			if (spool_len(sp->spool) > 0) {
+				retry = replay(flume) != 0 ? time(NULL) + 1 : 0;
+				continue;
+			}
+		}
+		if ((n = collect(flume, lo)) == 0) {
 			if (errno != ETIMEDOUT)
 				break;
+			if (flush(flume) != 0)
+				retry = time(NULL) + 1;
 			continue;
 		}
-		ctx->sender->send(ctx, lo);
-		lj_logobj_destroy(lo);
+		i = deliver(flume, lo, n);
+		for (j = 0; j < i; ++j)
+			lj_logobj_destroy(lo[j]);
+		retry = 0;
+		if (i < n && sp->spool != NULL) {
+			/* the server went away, hold on to the rest */
+			retry = time(NULL) + 1;
+			reclaim(flume);
+			spill(flume, lo + i, n - i);
+		} else if (i < n) {
+			/* shutting down with nowhere to put them */
+			for (j = i; j < n; ++j)
+				lj_logobj_destroy(lo[j]);
+		} else if (cirq_len(flume->oq.cirq) == 0) {
+			if (flush(flume) != 0)
+				retry = time(NULL) + 1;
+		}
+	}
+	/* keep whatever is unsent or still queued for the next run */
+	if (sp->spool != NULL) {
+		(void)flush(flume);
+		while ((n = cirq_get_batch(flume->oq.cirq, (void **)lo,
+		    BATCH_SIZE, 0)) > 0)
+			spill(flume, lo, n);
 	}
 	return (NULL);
 }
 
+/*
+ * Read and optionally clear a counter.
+ */
+static size_t
+counter(size_t *p, int clear)
+{
+
+	if (clear)
+		return (__atomic_exchange_n(p, 0, __ATOMIC_RELAXED));
+	return (__atomic_load_n(p, __ATOMIC_RELAXED));
+}
+
 static void
-logstats(int clear)
+logstats(lj_flume *flume, int clear)
 {
 	uintmax_t nput, nget, ndrop;
+	size_t get, alloc, put, tget, talloc, tput, tskip, tmiss;
+	unsigned int i;
 
-	cirq_stat(li_cirq, &nput, &nget, &ndrop, clear);
-	lj_verbose("i: put %zu get %zu drop %zu", nput, nget, ndrop);
-	cirq_stat(lo_cirq, &nput, &nget, &ndrop, clear);
-	lj_verbose("o: put %zu get %zu drop %zu", nput, nget, ndrop);
+	cirq_stat(flume->iq.cirq, &nput, &nget, &ndrop, clear);
+	lj_verbose("%u: i: put %zu get %zu drop %zu bytes %zu", flume->id,
+	    nput, nget, ndrop, cirq_bytes(flume->iq.cirq));
+	cirq_stat(flume->oq.cirq, &nput, &nget, &ndrop, clear);
+	lj_verbose("%u: o: put %zu get %zu drop %zu bytes %zu", flume->id,
+	    nput, nget, ndrop, cirq_bytes(flume->oq.cirq));
+	if (flume->sp.spool != NULL) {
+		lj_verbose("%u: s: spill %zu replay %zu drop %zu", flume->id,
+		    counter(&flume->sp.nspill, clear),
+		    counter(&flume->sp.nreplay, clear),
+		    counter(&flume->sp.ndrop, clear));
+	}
+	lj_pool_stat(flume->slabs, &get, &alloc, &put, clear);
+	lj_verbose("%u: p: slabs get %zu alloc %zu put %zu", flume->id,
+	    get, alloc, put);
+	tget = talloc = tput = 0;
+	for (i = 0; i < flume->nworkers; ++i) {
+		lj_pool_stat(flume->workers[i].logobjs, &get, &alloc, &put,
+		    clear);
+		tget += get;
+		talloc += alloc;
+		tput += put;
+	}
+	lj_verbose("%u: p: logobjs get %zu alloc %zu put %zu", flume->id,
+	    tget, talloc, tput);
+	tskip = tmiss = 0;
+	for (i = 0; i < flume->nworkers; ++i) {
+		tskip += counter(&flume->workers[i].pctx->nskip, clear);
+		tmiss += counter(&flume->workers[i].pctx->nmiss, clear);
+	}
+	lj_verbose("%u: p: reject prefilter %zu parser %zu", flume->id,
+	    tskip, tmiss);
 }
 
-int
-logjam(void)
+/*
+ * Set up a flume's queues and spool and start its threads.
+ */
+static void
+flume_start(lj_flume *flume)
 {
-	lj_flume *flume;
+	unsigned int i;
 	int r;
 
-	signal(SIGPIPE, SIG_IGN);
-	signal(SIGINT, &sig_handler);
-	signal(SIGTERM, &sig_handler);
-	signal(SIGUSR1, &sig_handler);
-	signal(SIGUSR2, &sig_handler);
-
-	if ((flume = lj_configure(lj_config_file)) == NULL)
-		lj_fatal("no configuration");
-
-	if ((li_cirq = cirq_create(CIRQ_SIZE)) == NULL)
+	/*
+	 * Both cirqs are lock-free, which is only safe with a single
+	 * producer and a single consumer at any one time.  The reader is
+	 * the only producer on the input queue and the sender the only
+	 * consumer on the output queue, but there can be many parser
+	 * workers on the other side of each.  They read from the input
+	 * queue only while holding the flume's claim lock, and write to
+	 * the output queue only while holding its reorder lock, so each
+	 * queue still sees one thread at a time at either end.  Don't
+	 * remove either lock without dropping CIRQ_SPSC.
+	 */
+	if ((flume->iq.cirq = cirq_create_flags(flume->iq.size,
+	    CIRQ_SPSC | flume->iq.flags)) == NULL ||
+	    cirq_set_budget(flume->iq.cirq, flume->iq.budget,
+	    logline_size) != 0)
 		lj_fatal("failed to create input cirq");
-	if ((lo_cirq = cirq_create(CIRQ_SIZE)) == NULL)
+	if ((flume->oq.cirq = cirq_create_flags(flume->oq.size,
+	    CIRQ_SPSC | flume->oq.flags)) == NULL ||
+	    cirq_set_budget(flume->oq.cirq, flume->oq.budget,
+	    logobj_size) != 0)
 		lj_fatal("failed to create output cirq");
+	if (flume->sp.path != NULL) {
+		if ((flume->sp.spool = spool_open(flume->sp.path,
+		    flume->sp.segsize, flume->sp.maxsize)) == NULL)
+			lj_fatal("%s: failed to open spool", flume->sp.path);
+		if (flume->sp.highwater == 0)
+			flume->sp.highwater = flume->oq.size * 3 / 4;
+		lj_verbose("%s: %zu records in spool", flume->sp.path,
+		    spool_len(flume->sp.spool));
+	}
+	if ((flume->slabs = lj_arena_pool_create()) == NULL)
+		lj_fatal("failed to create slab pool");
+	for (i = 0; i < flume->nworkers; ++i)
+		if ((flume->workers[i].logobjs = lj_logobj_pool_create()) ==
+		    NULL)
+			lj_fatal("failed to create logobj pool");
+	/* leave some slack so workers rarely wait for a free slot */
+	flume->nwindow = 2 * flume->nworkers;
+	if ((flume->window = calloc(flume->nwindow,
+	    sizeof *flume->window)) == NULL)
+		lj_fatal("failed to allocate reorder window");
 
-	if ((r = pthread_create(&rthr, NULL, rthr_main, flume->rctx)) != 0) {
+	if ((r = pthread_create(&flume->rthr, NULL, rthr_main, flume)) != 0) {
 		errno = r;
 		lj_fatal("failed to start reader thread");
 	}
 
-	if ((r = pthread_create(&pthr, NULL, pthr_main, flume->pctx)) != 0) {
-		errno = r;
-		lj_fatal("failed to start parser thread");
+	for (i = 0; i < flume->nworkers; ++i) {
+		if ((r = pthread_create(&flume->workers[i].thr, NULL,
+		    pthr_main, &flume->workers[i])) != 0) {
+			errno = r;
+			lj_fatal("failed to start parser thread");
+		}
 	}
 
-	if ((r = pthread_create(&sthr, NULL, sthr_main, flume->sctx)) != 0) {
+	if ((r = pthread_create(&flume->sthr, NULL, sthr_main, flume)) != 0) {
 		errno = r;
 		lj_fatal("failed to start sender thread");
 	}
+}
+
+/*
+ * Wait for a flume's threads to finish.
+ */
+static void
+flume_join(lj_flume *flume)
+{
+	unsigned int i;
+
+	pthread_join(flume->rthr, NULL);
+	for (i = 0; i < flume->nworkers; ++i)
+		pthread_join(flume->workers[i].thr, NULL);
+	pthread_join(flume->sthr, NULL);
+}
+
+int
+logjam(void)
+{
+	lj_flume *flumes, *flume;
+
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, &sig_handler);
+	signal(SIGTERM, &sig_handler);
+	signal(SIGUSR1, &sig_handler);
+	signal(SIGUSR2, &sig_handler);
+
+	if ((flumes = lj_configure(lj_config_file)) == NULL)
+		lj_fatal("no configuration");
+
+	for (flume = flumes; flume != NULL; flume = flume->next)
+		flume_start(flume);
 
 	while (!quit) {
 		usleep(100000);
@@ -201,15 +662,18 @@ logjam(void)
 			sigterm = 0;
 		}
 		if (sigusr1 + sigusr2 > 0) {
-			logstats(sigusr2);
+			for (flume = flumes; flume != NULL; flume = flume->next)
+				logstats(flume, sigusr2);
 			sigusr1 = sigusr2 = 0;
 		}
 	}
 
 	lj_verbose("terminated");
-	pthread_join(rthr, NULL);
-	pthread_join(pthr, NULL);
-	pthread_join(sthr, NULL);
-	lj_flume_fini(flume);
+	for (flume = flumes; flume != NULL; flume = flume->next)
+		flume_join(flume);
+	while ((flume = flumes) != NULL) {
+		flumes = flume->next;
+		lj_flume_fini(flume);
+	}
 	return (0);
 }
@@ -31,66 +31,423 @@
 #include "config.h"
 #endif
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <jansson.h>
 
+#include <logjam/arena.h>
+#include <logjam/chunk.h>
 #include <logjam/logobj.h>
+#include <logjam/pool.h>
+#include <logjam/timefmt.h>
 
+/*
+ * Initial size of a logobj's value buffer, which is enough for most.
+ */
+#define LJ_LOGOBJ_BUFSIZE 256
+
+/*
+ * Interned keys.  The table is only ever added to, under the lock, and
+ * each slot is published with a release store once the key it points
+ * to is in place, so lookups need no lock.
+ */
+#define LJ_LOGOBJ_HASHSIZE (2 * LJ_LOGOBJ_MAXKEYS)
+
+static pthread_mutex_t lj_logobj_keylock = PTHREAD_MUTEX_INITIALIZER;
+static const char *lj_logobj_keys[LJ_LOGOBJ_MAXKEYS];
+static unsigned int lj_logobj_nkeys;
+static struct lj_logobj_slot {
+	const char	*key;
+	unsigned int	 id;
+} lj_logobj_hash[LJ_LOGOBJ_HASHSIZE];
+
+/*
+ * Pool from which the calling thread gets its logobjs, if any.
+ */
+static __thread lj_pool *lj_logobj_pool;
+
+/*
+ * Create a logline holding a copy of the specified text.  Loglines are
+ * allocated from the calling thread's arena, so they take up little
+ * more space than the text itself.
+ */
+lj_logline *
+lj_logline_create(uint64_t when, const char *what, size_t len)
+{
+	lj_logline *ll;
+
+	if ((ll = lj_arena_alloc(sizeof *ll + len + 1)) == NULL)
+		return (NULL);
+	ll->when = when;
+	ll->len = len;
+	ll->what = (char *)(ll + 1);
+	ll->chunk = NULL;
+	memcpy(ll->what, what, len);
+	ll->what[len] = '\0';
+	return (ll);
+}
+
+/*
+ * Create a logline which refers to NUL-terminated text in a chunk
+ * instead of holding a copy of it.  The logline holds a reference to
+ * the chunk until it is destroyed.
+ */
+lj_logline *
+lj_logline_view(uint64_t when, char *what, size_t len, lj_chunk *chunk)
+{
+	lj_logline *ll;
+
+	if ((ll = lj_arena_alloc(sizeof *ll)) == NULL)
+		return (NULL);
+	ll->when = when;
+	ll->len = len;
+	ll->what = what;
+	ll->chunk = chunk;
+	lj_chunk_ref(chunk, 1);
+	return (ll);
+}
+
+void
+lj_logline_destroy(lj_logline *ll)
+{
+
+	if (ll->chunk != NULL)
+		lj_chunk_unref(ll->chunk, 1);
+	lj_arena_free(ll);
+}
+
+/*
+ * Destroy an array of loglines at once, which is cheaper than destroying
+ * them one by one.
+ */
+void
+lj_logline_destroy_batch(lj_logline **ll, size_t n)
+{
+	lj_chunk *chunk;
+	size_t i, j;
+
+	/* consecutive lines usually come from the same chunk */
+	for (i = 0; i < n; i = j) {
+		chunk = ll[i]->chunk;
+		for (j = i + 1; j < n && ll[j]->chunk == chunk; ++j)
+			/* nothing */ ;
+		if (chunk != NULL)
+			lj_chunk_unref(chunk, j - i);
+	}
+	lj_arena_free_batch((void **)ll, n);
+}
+
+/*
+ * Return the id of a key, interning it if we haven't seen it before, or
+ * -1 if there are too many keys.
+ */
+int
+lj_logobj_intern(const char *key)
+{
+	struct lj_logobj_slot *slot;
+	const char *str;
+	uint32_t h;
+	char *copy;
+
+	/* FNV-1a */
+	for (h = 2166136261U, str = key; *str != '\0'; ++str)
+		h = (h ^ (uint8_t)*str) * 16777619U;
+	h %= LJ_LOGOBJ_HASHSIZE;
+	for (;;) {
+		slot = &lj_logobj_hash[h];
+		str = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+		if (str == NULL)
+			break;
+		if (strcmp(str, key) == 0)
+			return (slot->id);
+		h = (h + 1) % LJ_LOGOBJ_HASHSIZE;
+	}
+	/* not there; look again under the lock before adding it */
+	pthread_mutex_lock(&lj_logobj_keylock);
+	for (;;) {
+		slot = &lj_logobj_hash[h];
+		if (slot->key == NULL)
+			break;
+		if (strcmp(slot->key, key) == 0) {
+			pthread_mutex_unlock(&lj_logobj_keylock);
+			return (slot->id);
+		}
+		h = (h + 1) % LJ_LOGOBJ_HASHSIZE;
+	}
+	if (lj_logobj_nkeys == LJ_LOGOBJ_MAXKEYS ||
+	    (copy = strdup(key)) == NULL) {
+		pthread_mutex_unlock(&lj_logobj_keylock);
+		errno = ENOSPC;
+		return (-1);
+	}
+	slot->id = lj_logobj_nkeys;
+	lj_logobj_keys[lj_logobj_nkeys++] = copy;
+	__atomic_store_n(&slot->key, copy, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&lj_logobj_keylock);
+	return (slot->id);
+}
+
+/*
+ * Return the name of an interned key.
+ */
+const char *
+lj_logobj_key(unsigned int id)
+{
+
+	return (id < LJ_LOGOBJ_MAXKEYS ?
+	    __atomic_load_n(&lj_logobj_keys[id], __ATOMIC_ACQUIRE) : NULL);
+}
+
+/*
+ * Tear down a pooled logobj when its pool frees it.
+ */
+static void
+lj_logobj_fini(void *p)
+{
+	lj_logobj *lo = p;
+
+	if (lo->fields != lo->ifields)
+		free(lo->fields);
+	free(lo->buf);
+}
+
+/*
+ * Create a pool of logobjs for use with lj_logobj_bind().
+ */
+lj_pool *
+lj_logobj_pool_create(void)
+{
+
+	return (lj_pool_create(sizeof(lj_logobj), 0, lj_logobj_fini));
+}
+
+/*
+ * Make the calling thread get its logobjs from the specified pool, which
+ * it must own, or allocate them directly if it is NULL.
+ */
+void
+lj_logobj_bind(lj_pool *pool)
+{
+
+	lj_logobj_pool = pool;
+}
+
+/*
+ * Create an empty logobj.  Pooled logobjs hang on to their buffers
+ * between uses, so once a pool has warmed up, a logobj costs no
+ * allocations at all.
+ */
 lj_logobj *
 lj_logobj_create(void)
 {
 	lj_logobj *lo;
 
-	if ((lo = calloc(1, sizeof *lo)) == NULL ||
-	    (lo->json = json_object()) == NULL)
-		goto fail;
+	if (lj_logobj_pool != NULL)
+		lo = lj_pool_get(lj_logobj_pool);
+	else if ((lo = calloc(1, sizeof *lo)) != NULL)
+		lo->po.pool = NULL;
+	if (lo == NULL)
+		return (NULL);
+	if (lo->fields == NULL) {
+		lo->fields = lo->ifields;
+		lo->maxfields = LJ_LOGOBJ_NFIELDS;
+	}
+	lo->nfields = 0;
+	lo->buflen = 0;
+	lo->size = sizeof *lo + lo->bufsize;
 	return (lo);
-fail:
-	lj_logobj_destroy(lo);
-	return (NULL);
 }
 
+/*
+ * Destroy a logobj, or return it to its pool.  May be called by any
+ * thread.
+ */
 void
 lj_logobj_destroy(lj_logobj *lo)
 {
 
 	if (lo == NULL)
 		return;
-	json_decref(lo->json);
-	free(lo);
+	if (lo->po.pool == NULL)
+		lj_logobj_fini(lo);
+	lj_pool_put(lo);
 }
 
+/*
+ * Add a field, or replace the value of an existing one, which keeps its
+ * place.  The old value is left in the buffer.
+ */
+static int
+lj_logobj_set(lj_logobj *lo, const char *key, lj_logobj_type type,
+    const char *value, size_t len)
+{
+	lj_logobj_field *field;
+	unsigned int i;
+	size_t size;
+	char *buf;
+	int id;
+
+	if ((id = lj_logobj_intern(key)) < 0)
+		return (-1);
+	if (len > UINT32_MAX - lo->buflen - 1) {
+		errno = E2BIG;
+		return (-1);
+	}
+	for (i = 0; i < lo->nfields; ++i)
+		if (lo->fields[i].key == id)
+			break;
+	if (i == lo->maxfields) {
+		if (lo->fields == lo->ifields) {
+			field = malloc(2 * lo->maxfields * sizeof *field);
+			if (field != NULL)
+				memcpy(field, lo->ifields, sizeof lo->ifields);
+		} else {
+			field = realloc(lo->fields,
+			    2 * lo->maxfields * sizeof *field);
+		}
+		if (field == NULL)
+			return (-1);
+		lo->fields = field;
+		lo->maxfields *= 2;
+		lo->size += lo->maxfields * sizeof *field;
+	}
+	if (lo->buflen + len + 1 > lo->bufsize) {
+		for (size = lo->bufsize ? lo->bufsize : LJ_LOGOBJ_BUFSIZE;
+		     size < lo->buflen + len + 1; size *= 2)
+			/* nothing */ ;
+		if ((buf = realloc(lo->buf, size)) == NULL)
+			return (-1);
+		lo->size += size - lo->bufsize;
+		lo->buf = buf;
+		lo->bufsize = size;
+	}
+	field = &lo->fields[i];
+	field->key = id;
+	field->type = type;
+	field->off = lo->buflen;
+	field->len = len;
+	memcpy(lo->buf + lo->buflen, value, len);
+	lo->buf[lo->buflen + len] = '\0';
+	lo->buflen += len + 1;
+	if (i == lo->nfields)
+		lo->nfields++;
+	return (0);
+}
+
+/*
+ * Set the timestamp, in RFC 3339 format with microsecond precision.
+ */
 int
 lj_logobj_settime(lj_logobj *lo, uint64_t t)
 {
-	json_t *obj;
+	char buf[LJ_TIMEFMT_RFC3339_LEN];
+	size_t len;
 
-	/* for now, convert from microseconds to seconds */
-	obj = json_integer(t / 1000000);
-	return (json_object_set_new(lo->json, "timestamp", obj));
+	len = lj_timefmt_rfc3339(t, buf);
+	return (lj_logobj_set(lo, "timestamp", LJ_LOGOBJ_TIME, buf, len));
 }
 
 int
 lj_logobj_setstr(lj_logobj *lo, const char *key, const char *value)
 {
 
-	return (json_object_set_new(lo->json, key, json_string(value)));
+	return (lj_logobj_set(lo, key, LJ_LOGOBJ_STRING, value,
+	    strlen(value)));
 }
 
 int
 lj_logobj_setstrn(lj_logobj *lo, const char *key, const char *value, size_t len)
 {
-#if JANSSON_VERSION_HEX < 0x020700
-	int ch, ret;
 
-	ch = value[len];
-	*(char *)(value + len) = '\0';
-	ret = json_object_set_new(lo->json, key, json_string(value));
-	*(char *)(value + len) = ch;
-	return (ret);
+	return (lj_logobj_set(lo, key, LJ_LOGOBJ_STRING, value, len));
+}
+
+/*
+ * Build a JSON object with the same fields as a logobj, for senders
+ * which need one.  The caller must release it.
+ */
+json_t *
+lj_logobj_json(const lj_logobj *lo)
+{
+	const lj_logobj_field *field;
+	unsigned int i;
+	json_t *obj;
+
+	if ((obj = json_object()) == NULL)
+		return (NULL);
+	for (i = 0, field = lo->fields; i < lo->nfields; ++i, ++field) {
+#if JANSSON_VERSION_HEX < 0x020700
+		if (json_object_set_new(obj, lj_logobj_key(field->key),
+		    json_string(lo->buf + field->off)) != 0) {
 #else
-	return (json_object_set_new(lo->json, key, json_stringn(value, len)));
+		if (json_object_set_new(obj, lj_logobj_key(field->key),
+		    json_stringn(lo->buf + field->off, field->len)) != 0) {
 #endif
+			json_decref(obj);
+			return (NULL);
+		}
+	}
+	return (obj);
+}
+
+/*
+ * Serialize a logobj into a newly allocated buffer, which the caller
+ * must free, and store its length in the location pointed to by the
+ * second argument.
+ */
+char *
+lj_logobj_serialize(const lj_logobj *lo, size_t *len)
+{
+	json_t *obj;
+	char *buf;
+
+	if ((obj = lj_logobj_json(lo)) == NULL)
+		return (NULL);
+	buf = json_dumps(obj, JSON_PRESERVE_ORDER | JSON_COMPACT);
+	json_decref(obj);
+	if (buf == NULL)
+		return (NULL);
+	*len = strlen(buf);
+	return (buf);
+}
+
+/*
+ * Reconstruct a logobj from a buffer filled by lj_logobj_serialize().
+ */
+lj_logobj *
+lj_logobj_deserialize(const char *buf, size_t len)
+{
+	json_error_t err;
+	const char *key;
+	lj_logobj *lo;
+	json_t *obj, *value;
+	void *iter;
+
+	if ((obj = json_loadb(buf, len, 0, &err)) == NULL)
+		return (NULL);
+	if (!json_is_object(obj) || (lo = lj_logobj_create()) == NULL) {
+		json_decref(obj);
+		return (NULL);
+	}
+	for (iter = json_object_iter(obj);
+	     iter != NULL;
+	     iter = json_object_iter_next(obj, iter)) {
+		key = json_object_iter_key(iter);
+		value = json_object_iter_value(iter);
+		if (!json_is_string(value) ||
+		    lj_logobj_set(lo, key, strcmp(key, "timestamp") == 0 ?
+		    LJ_LOGOBJ_TIME : LJ_LOGOBJ_STRING,
+		    json_string_value(value), strlen(json_string_value(value)))
+		    != 0) {
+			json_decref(obj);
+			lj_logobj_destroy(lo);
+			return (NULL);
+		}
+	}
+	json_decref(obj);
+	return (lo);
 }
@@ -0,0 +1,142 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <logjam/logobj.h>
+#include <logjam/parser.h>
+#include <logjam/pcreset.h>
+
+/*
+ * Generic parser for formats described in the configuration file.  Each
+ * pattern is a Perl-compatible regular expression, and each named
+ * subexpression becomes a field of the same name.  Patterns are tried
+ * in the order in which they were given, and the first which matches
+ * wins.
+ */
+
+typedef struct lj_regex_ctx {
+	struct LJ_PARSER_CTX;
+	lj_pcreset	*ps;
+} lj_regex_ctx;
+
+static lj_parser_ctx *lj_regex_init(void);
+static const char *lj_regex_get(lj_parser_ctx *, const char *);
+static int lj_regex_set(lj_parser_ctx *, const char *, const char *);
+static lj_logobj *lj_regex_parse(lj_parser_ctx *, const lj_logline *);
+static void lj_regex_fini(lj_parser_ctx *);
+
+static lj_parser_ctx *
+lj_regex_init(void)
+{
+	lj_regex_ctx *ctx;
+
+	if ((ctx = calloc(1, sizeof *ctx)) == NULL)
+		return (NULL);
+	ctx->parser = &lj_regex_parser;
+	if ((ctx->ps = lj_pcreset_create()) == NULL) {
+		free(ctx);
+		return (NULL);
+	}
+	return ((lj_parser_ctx *)ctx);
+}
+
+static const char *
+lj_regex_get(lj_parser_ctx *pctx, const char *key)
+{
+	lj_regex_ctx *ctx = (lj_regex_ctx *)pctx;
+	unsigned int n;
+
+	if (strcmp(key, "pattern") == 0 && (n = lj_pcreset_count(ctx->ps)) > 0)
+		return (lj_pcreset_pattern(ctx->ps, n - 1));
+	return (NULL);
+}
+
+/*
+ * Each value of the "pattern" property adds a pattern.
+ */
+static int
+lj_regex_set(lj_parser_ctx *pctx, const char *key, const char *value)
+{
+	lj_regex_ctx *ctx = (lj_regex_ctx *)pctx;
+
+	if (strcmp(key, "pattern") == 0)
+		return (lj_pcreset_add(ctx->ps, value) < 0 ? -1 : 0);
+	return (-1);
+}
+
+static lj_logobj *
+lj_regex_parse(lj_parser_ctx *pctx, const lj_logline *ll)
+{
+	lj_regex_ctx *ctx = (lj_regex_ctx *)pctx;
+	lj_pcreset_field fields[LJ_PCRESET_MAX_FIELDS];
+	unsigned int i, nfields;
+	lj_logobj *lo;
+
+	if (lj_pcreset_match(ctx->ps, ll->what, ll->len, fields,
+	    &nfields) < 0) {
+		lj_parser_miss(pctx);
+		return (NULL);
+	}
+	if ((lo = lj_logobj_create()) == NULL)
+		return (NULL);
+	if (lj_logobj_settime(lo, ll->when) != 0)
+		goto fail;
+	for (i = 0; i < nfields; ++i)
+		if (lj_logobj_setstrn(lo, fields[i].name,
+		    ll->what + fields[i].off, fields[i].len) != 0)
+			goto fail;
+	return (lo);
+fail:
+	lj_logobj_destroy(lo);
+	return (NULL);
+}
+
+static void
+lj_regex_fini(lj_parser_ctx *pctx)
+{
+	lj_regex_ctx *ctx = (lj_regex_ctx *)pctx;
+
+	lj_pcreset_destroy(ctx->ps);
+	free(ctx);
+}
+
+lj_parser lj_regex_parser = {
+	.init	 = lj_regex_init,
+	.get	 = lj_regex_get,
+	.set	 = lj_regex_set,
+	.parse	 = lj_regex_parse,
+	.fini	 = lj_regex_fini,
+};
@@ -31,6 +31,7 @@
 #include "config.h"
 #endif
 
+
 #include <err.h>
 #include <regex.h>
 #include <stdint.h>
@@ -38,27 +39,13 @@
 #include <string.h>
 
 #include <logjam/logobj.h>
+#include <logjam/multire.h>
 #include <logjam/parser.h>
-
-const char *sshd_re =
-    "^"
-    "Failed "
-    "([a-z-]+)"			/* 1: method */
-    " for "
-    "(invalid user |)"		/* 2: ignored */
-    "([0-9a-z-]+)"		/* 3: login */
-    " from "
-    "([0-9A-Fa-f:.]+)"		/* 4: client address */
-    " port "
-    "([0-9]+)"			/* 5: client port */
-    " "
-    "ssh([0-9.]+)"		/* 6: protocol version */
-    "$";
-#define NMATCH 7
+#include <logjam/sshdmsg.h>
 
 typedef struct lj_sshd_ctx {
 	struct LJ_PARSER_CTX;
-	regex_t re;
+	lj_multire *mr;
 } lj_sshd_ctx;
 
 static lj_parser_ctx *lj_sshd_init(void);
@@ -69,42 +56,47 @@ static lj_parser_ctx *
 lj_sshd_init(void)
 {
 	lj_sshd_ctx *ctx;
-	int ret;
 
 	if ((ctx = calloc(1, sizeof *ctx)) == NULL)
 		return (NULL);
 	ctx->parser = &lj_sshd_parser;
-	if ((ret = regcomp(&ctx->re, sshd_re, REG_EXTENDED)) != 0)
-		goto fail;
+	if ((ctx->mr = lj_sshd_compile()) == NULL) {
+		free(ctx);
+		return (NULL);
+	}
 	return ((lj_parser_ctx *)ctx);
-fail:
-	lj_sshd_fini((lj_parser_ctx *)ctx);
-	return (NULL);
 }
 
 static lj_logobj *
 lj_sshd_parse(lj_parser_ctx *pctx, const lj_logline *ll)
 {
 	lj_sshd_ctx *ctx = (lj_sshd_ctx *)pctx;
-	regmatch_t pmatch[NMATCH];
+	const lj_sshd_msg *msg;
+	regmatch_t pmatch[LJ_SSHD_NMATCH];
+	unsigned int i, ncand;
 	lj_logobj *lo;
 
-	if (regexec(&ctx->re, ll->what, NMATCH, pmatch, 0) != 0)
+	if ((msg = lj_sshd_match(ctx->mr, ll->what, ll->len, pmatch,
+	    &ncand)) == NULL) {
+		if (ncand == 0)
+			lj_parser_skip(pctx);
+		else
+			lj_parser_miss(pctx);
 		return (NULL);
+	}
 	if ((lo = lj_logobj_create()) == NULL)
 		return (NULL);
-	if (lj_logobj_settime(lo, ll->when) != 0)
-		goto fail;
-#define LO_SET_STRN(KEY, N)					\
-	lj_logobj_setstrn(lo, KEY, ll->what + pmatch[N].rm_so,	\
-	    pmatch[N].rm_eo - pmatch[N].rm_so)
-	if (LO_SET_STRN("method",        1) != 0 ||
-	    LO_SET_STRN("login",         3) != 0 ||
-	    LO_SET_STRN("client_addr",   4) != 0 ||
-	    LO_SET_STRN("client_port",   5) != 0 ||
-	    LO_SET_STRN("protocol",      6) != 0)
+	if (lj_logobj_settime(lo, ll->when) != 0 ||
+	    lj_logobj_setstr(lo, "event", msg->event) != 0)
 		goto fail;
-#undef LO_SET_STRN
+	for (i = 1; i < LJ_SSHD_NMATCH; ++i) {
+		if (msg->fields[i] == NULL || pmatch[i].rm_so < 0)
+			continue;
+		if (lj_logobj_setstrn(lo, msg->fields[i],
+		    ll->what + pmatch[i].rm_so,
+		    pmatch[i].rm_eo - pmatch[i].rm_so) != 0)
+			goto fail;
+	}
 	return (lo);
 fail:
 	lj_logobj_destroy(lo);
@@ -116,7 +108,7 @@ lj_sshd_fini(lj_parser_ctx *pctx)
 {
 	lj_sshd_ctx *ctx = (lj_sshd_ctx *)pctx;
 
-	regfree(&ctx->re);
+	lj_multire_destroy(ctx->mr);
 	free(ctx);
 }
 
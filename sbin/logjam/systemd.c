@@ -31,10 +31,10 @@
 #include "config.h"
 #endif
 
-#include <sys/time.h>
 
 #include <err.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +42,7 @@
 
 #include <systemd/sd-journal.h>
 
+#include <logjam/clock.h>
 #include <logjam/ctype.h>
 #include <logjam/logobj.h>
 #include <logjam/reader.h>
@@ -125,10 +126,9 @@ static lj_logline *
 lj_systemd_read(lj_reader_ctx *rctx)
 {
 	lj_systemd_ctx *ctx = (lj_systemd_ctx *)rctx;
-	struct timeval tv;
-	lj_logline *ll;
 	const char *str;
 	uintmax_t umax;
+	uint64_t when;
 	size_t len;
 	int r;
 
@@ -140,22 +140,11 @@ lj_systemd_read(lj_reader_ctx *rctx)
 		errno = EAGAIN;
 		return (NULL);
 	}
-	/* get text of message first, no point otherwise */
-	r = sd_journal_get_data(ctx->j, MESSAGE_FIELD,
-	    (const void **)&str, &len);
-	if (r != 0) {
-		errno = -r;
-		return (NULL);
-	}
-	if ((ll = calloc(1, sizeof *ll)) == NULL)
-		return (NULL);
-	str += sizeof MESSAGE_FIELD;
-	len -= sizeof MESSAGE_FIELD;
-	if (len >= sizeof ll->what)
-		len = sizeof ll->what - 1;
-	memcpy(ll->what, str, len);
-	ll->what[len] = '\0';
-	/* try to get the timestamp, fall back to current time */
+	/*
+	 * Try to get the timestamp, fall back to current time.  This must
+	 * come first, as retrieving another field invalidates the data we
+	 * got for the previous one.
+	 */
 	r = sd_journal_get_data(ctx->j, TIMESTAMP_FIELD,
 	    (const void **)&str, &len);
 	if (r == 0) {
@@ -170,13 +159,33 @@ lj_systemd_read(lj_reader_ctx *rctx)
 			break;
 		umax = umax * 10 + *str - '0';
 	}
-	if (len == 0 && umax > 0) {
-		ll->when = umax;
-	} else {
-		gettimeofday(&tv, NULL);
-		ll->when = tv.tv_sec * 1000000 + tv.tv_usec;
+	if (len == 0 && umax > 0)
+		when = umax;
+	else
+		when = lj_clock_now();
+	/* get text of message */
+	r = sd_journal_get_data(ctx->j, MESSAGE_FIELD,
+	    (const void **)&str, &len);
+	if (r != 0) {
+		errno = -r;
+		return (NULL);
+	}
+	str += sizeof MESSAGE_FIELD;
+	len -= sizeof MESSAGE_FIELD;
+	return (lj_logline_create(when, str, len));
+}
+
+static int
+lj_systemd_wait(lj_reader_ctx *rctx, unsigned int timeout_ms)
+{
+	lj_systemd_ctx *ctx = (lj_systemd_ctx *)rctx;
+	int r;
+
+	if ((r = sd_journal_wait(ctx->j, timeout_ms * (uint64_t)1000)) < 0) {
+		errno = -r;
+		return (-1);
 	}
-	return (ll);
+	return (r != SD_JOURNAL_NOP);
 }
 
 static void
@@ -193,5 +202,6 @@ lj_reader lj_systemd_reader = {
 	.get	 = lj_systemd_get,
 	.set	 = lj_systemd_set,
 	.read	 = lj_systemd_read,
+	.wait	 = lj_systemd_wait,
 	.fini	 = lj_systemd_fini,
 };
@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <logjam/bindscan.h>
+
+/*
+ * BIND query log benchmark: parse a corpus of query log lines, first
+ * with the regular expression the BIND parser used to rely on, then
+ * with lj_bind_scan(), check that both find the same fields, and report
+ * the rate at which each is done.
+ *
+ * The corpus is read from the specified file, with the syslog prefix, if
+ * any, already stripped, or generated if none is specified.
+ *
+ * usage: b_bindscan [file]
+ */
+
+#define B_NLINES	100000
+#define B_TOTAL		((size_t)32 * 1024 * 1024)
+
+static double
+b_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+b_report(const char *what, size_t nl, size_t nm, size_t len, double t)
+{
+
+	printf("%-8s %10zu lines (%zu matched) in %7.3f s: "
+	    "%10.0f lines/s %7.1f MB/s\n",
+	    what, nl, nm, t, nl / t, len / t / (1024 * 1024));
+}
+
+/*
+ * Generate a line resembling what BIND 9 logs for a query.
+ */
+static char *
+b_gen(void)
+{
+	static const char *types[] = { "A", "A", "A", "AAAA", "AAAA", "PTR",
+	    "MX", "TXT", "NS", "SRV", "DS", "TYPE65" };
+	static const char *flags[] = { "+", "+", "+E", "+ED", "-", "-E",
+	    "-EDC", "+ETDC" };
+	char *str;
+
+	if (asprintf(&str, "queries: info: client %s#%ld (%s%ld.example.com): "
+	    "query: %s%ld.example.com IN %s %s (%s)",
+	    random() % 2 ? "192.0.2.17" : "2001:db8:4711::17",
+	    1024 + random() % 64511, random() % 4 ? "www" : "_ldap._tcp.dc",
+	    random() % 1000, random() % 4 ? "www" : "_ldap._tcp.dc",
+	    random() % 1000, types[random() % 12], flags[random() % 8],
+	    random() % 2 ? "198.51.100.53" : "2001:db8::53") < 0)
+		err(1, "asprintf()");
+	return (str);
+}
+
+int
+main(int argc, char *argv[])
+{
+	regmatch_t pmatch[LJ_BIND_RE_NMATCH];
+	lj_bind_field f[LJ_BIND_NFIELDS];
+	size_t i, n, nm, nre, len, total;
+	unsigned int r, rounds;
+	char **lines, *line;
+	size_t *sums, sum;
+	ssize_t rlen;
+	regex_t re;
+	double t0;
+	FILE *fp;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: b_bindscan [file]\n");
+		exit(1);
+	}
+	if ((lines = calloc(B_NLINES, sizeof *lines)) == NULL ||
+	    (sums = calloc(B_NLINES, sizeof *sums)) == NULL)
+		err(1, "calloc()");
+	len = 0;
+	if (argc > 1) {
+		if ((fp = fopen(argv[1], "r")) == NULL)
+			err(1, "%s", argv[1]);
+		for (n = 0; n < B_NLINES; ++n) {
+			line = NULL;
+			i = 0;
+			if ((rlen = getline(&line, &i, fp)) < 0) {
+				free(line);
+				break;
+			}
+			if (rlen > 0 && line[rlen - 1] == '\n')
+				line[--rlen] = '\0';
+			lines[n] = line;
+			len += rlen;
+		}
+		fclose(fp);
+		if (n == 0)
+			errx(1, "%s: no lines", argv[1]);
+	} else {
+		srandom(1);
+		for (n = 0; n < B_NLINES; ++n) {
+			lines[n] = b_gen();
+			len += strlen(lines[n]);
+		}
+	}
+	if (regcomp(&re, lj_bind_re, REG_EXTENDED) != 0)
+		errx(1, "regcomp() failed");
+	rounds = B_TOTAL / len + 1;
+
+	/* the regular expression, remembering what it found */
+	t0 = b_now();
+	for (r = 0, total = nre = 0; r < rounds; ++r) {
+		for (i = 0; i < n; ++i, ++total) {
+			if (regexec(&re, lines[i], LJ_BIND_RE_NMATCH, pmatch,
+			    0) != 0) {
+				sums[i] = 0;
+				continue;
+			}
+			++nre;
+			sums[i] = pmatch[2].rm_so + pmatch[9].rm_eo +
+			    pmatch[4].rm_eo - pmatch[4].rm_so;
+		}
+	}
+	b_report("regex", total, nre, len * rounds, b_now() - t0);
+
+	/* the scanner, checking that it agrees */
+	t0 = b_now();
+	for (r = 0, total = nm = 0; r < rounds; ++r) {
+		for (i = 0; i < n; ++i, ++total) {
+			if (lj_bind_scan(lines[i], f) != 0) {
+				sum = 0;
+			} else {
+				++nm;
+				sum = f[LJ_BIND_CLIENT_ADDR].off +
+				    f[LJ_BIND_SERVER_ADDR].off +
+				    f[LJ_BIND_SERVER_ADDR].len +
+				    f[LJ_BIND_DNSNAME].len;
+			}
+			if (sum != sums[i])
+				errx(1, "scan disagrees with regex: %s",
+				    lines[i]);
+		}
+	}
+	b_report("scan", total, nm, len * rounds, b_now() - t0);
+
+	regfree(&re);
+	for (i = 0; i < n; ++i)
+		free(lines[i]);
+	free(sums);
+	free(lines);
+	exit(0);
+}
@@ -0,0 +1,153 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <logjam/eol.h>
+
+/*
+ * Line splitting benchmark: find every line end in a buffer full of
+ * lines of typical length, first with a byte-at-a-time loop like the
+ * one the file reader used to have, then with each available
+ * implementation of lj_eol_scan(), and report the rate at which each
+ * is done.
+ *
+ * The default buffer size matches the file reader's.
+ *
+ * usage: b_eol [kilobytes [average line length]]
+ */
+
+#define B_MAXEOL	1024
+#define B_TOTAL		((size_t)4 * 1024 * 1024 * 1024)
+
+static const char *b_impls[] = { "avx2", "sse2", "scalar" };
+
+static double
+b_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+b_report(const char *what, size_t nl, size_t len, double t)
+{
+
+	printf("%-8s %10zu lines in %7.3f s: %12.0f lines/s %9.1f MB/s\n",
+	    what, nl, t, nl / t, len / t / (1024 * 1024));
+}
+
+/*
+ * The old way: look at each byte in turn.
+ */
+static size_t
+b_bytewise(const char *buf, size_t len)
+{
+	size_t eol[B_MAXEOL];
+	size_t i, n;
+
+	for (i = n = 0; i < len; ++i)
+		if (buf[i] == '\n')
+			eol[n++ % B_MAXEOL] = i;
+	return (n + (eol[0] & 0));
+}
+
+static size_t
+b_scan(const char *buf, size_t len)
+{
+	size_t eol[B_MAXEOL];
+	size_t i, n, nl;
+
+	for (i = nl = 0; i < len; nl += n) {
+		if ((n = lj_eol_scan(buf, i, len, eol, B_MAXEOL)) == 0)
+			break;
+		i = eol[n - 1] + 1;
+	}
+	return (nl);
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t avg, i, j, len, nl, total;
+	unsigned int k, r, rounds;
+	double t0;
+	char *buf;
+
+	if (argc > 3) {
+		fprintf(stderr,
+		    "usage: b_eol [kilobytes [average line length]]\n");
+		exit(1);
+	}
+	len = (argc > 1 ? strtoul(argv[1], NULL, 10) : 64) * 1024;
+	avg = argc > 2 ? strtoul(argv[2], NULL, 10) : 120;
+	if (len == 0 || len > B_TOTAL || avg < 2)
+		errx(1, "invalid arguments");
+	rounds = B_TOTAL / len;
+	if ((buf = malloc(len)) == NULL)
+		err(1, "malloc()");
+	srandom(1);
+	for (i = nl = 0; i < len; i = j + 1, ++nl) {
+		j = i + avg / 2 + random() % avg;
+		if (j >= len)
+			j = len - 1;
+		memset(buf + i, 'x', j - i);
+		buf[j] = '\n';
+	}
+	t0 = b_now();
+	for (r = 0, total = 0; r < rounds; ++r)
+		total += b_bytewise(buf, len);
+	if (total != nl * rounds)
+		errx(1, "bytewise: found %zu lines, expected %zu",
+		    total / rounds, nl);
+	b_report("bytewise", total, len * rounds, b_now() - t0);
+	for (k = 0; k < sizeof b_impls / sizeof b_impls[0]; ++k) {
+		if (lj_eol_select(b_impls[k]) != 0)
+			continue;
+		t0 = b_now();
+		for (r = 0, total = 0; r < rounds; ++r)
+			total += b_scan(buf, len);
+		if (total != nl * rounds)
+			errx(1, "%s: found %zu lines, expected %zu",
+			    b_impls[k], total / rounds, nl);
+		b_report(b_impls[k], total, len * rounds, b_now() - t0);
+	}
+	free(buf);
+	exit(0);
+}
@@ -0,0 +1,149 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <logjam/multire.h>
+
+/*
+ * Multi-pattern benchmark: build catalogues of 1, 10 and 100 messages
+ * which differ in their fixed text, the way sshd's do, and match lines
+ * drawn evenly from each catalogue, first by trying each expression in
+ * turn, then with lj_multire_match(), and report the rate at which each
+ * is done.
+ *
+ * usage: b_multire [lines]
+ */
+
+#define B_MAXPATS	100
+#define B_NMATCH	4
+
+static const char *b_words[] = {
+	"Failed", "Accepted", "Rejected", "Closed", "Opened", "Timeout",
+	"Reset", "Refused", "Dropped", "Started",
+};
+
+static double
+b_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+b_report(const char *what, unsigned int npats, size_t nl, double t)
+{
+
+	printf("%-10s %3u patterns %8zu lines in %7.3f s: %10.0f lines/s\n",
+	    what, npats, nl, t, nl / t);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static unsigned int sizes[] = { 1, 10, 100 };
+	regmatch_t pmatch[B_NMATCH];
+	regex_t re[B_MAXPATS];
+	char src[256], **lines;
+	unsigned int i, j, k, npats;
+	size_t l, nl, nm;
+	lj_multire *mr;
+	double t0;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: b_multire [lines]\n");
+		exit(1);
+	}
+	nl = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+	if (nl == 0 || (lines = calloc(nl, sizeof *lines)) == NULL)
+		errx(1, "invalid arguments");
+	for (k = 0; k < sizeof sizes / sizeof *sizes; ++k) {
+		npats = sizes[k];
+		if ((mr = lj_multire_create()) == NULL)
+			err(1, "lj_multire_create()");
+		for (i = 0; i < npats; ++i) {
+			snprintf(src, sizeof src, "^%s %s for ([a-z]+) from "
+			    "([0-9.]+) port ([0-9]+)$", b_words[i % 10],
+			    b_words[i / 10]);
+			if (regcomp(&re[i], src, REG_EXTENDED) != 0 ||
+			    lj_multire_add(mr, src) != (int)i)
+				errx(1, "failed to compile %s", src);
+		}
+		if (lj_multire_compile(mr) != 0)
+			err(1, "lj_multire_compile()");
+		srandom(1);
+		for (l = 0; l < nl; ++l) {
+			i = random() % npats;
+			if (asprintf(&lines[l], "%s %s for user%c from "
+			    "192.0.2.%ld port %ld", b_words[i % 10],
+			    b_words[i / 10], 'a' + (int)(random() % 26),
+			    random() % 256, random() % 65536) < 0)
+				err(1, "asprintf()");
+		}
+
+		t0 = b_now();
+		for (l = nm = 0; l < nl; ++l) {
+			for (j = 0; j < npats; ++j)
+				if (regexec(&re[j], lines[l], B_NMATCH, pmatch,
+				    0) == 0)
+					break;
+			nm += j < npats;
+		}
+		if (nm != nl)
+			errx(1, "sequential: matched %zu of %zu", nm, nl);
+		b_report("sequential", npats, nl, b_now() - t0);
+
+		t0 = b_now();
+		for (l = nm = 0; l < nl; ++l)
+			nm += lj_multire_match(mr, lines[l], strlen(lines[l]),
+			    B_NMATCH, pmatch, NULL) >= 0;
+		if (nm != nl)
+			errx(1, "multire: matched %zu of %zu", nm, nl);
+		b_report("multire", npats, nl, b_now() - t0);
+
+		for (l = 0; l < nl; ++l)
+			free(lines[l]);
+		for (i = 0; i < npats; ++i)
+			regfree(&re[i]);
+		lj_multire_destroy(mr);
+	}
+	free(lines);
+	exit(0);
+}
@@ -0,0 +1,131 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <logjam/pcreset.h>
+#include <logjam/sshdmsg.h>
+
+/*
+ * Regex engine benchmark: match sshd "Failed password" lines against
+ * the sshd parser's expression with regexec(), and against the same
+ * expression with named subexpressions with lj_pcreset_match(), which
+ * uses the PCRE2 JIT if it is available, and report the rate at which
+ * each is done.
+ *
+ * usage: b_pcreset [lines]
+ */
+
+static const char b_pcre[] =
+    "^Failed (?<method>[a-z-]+) for (invalid user |)(?<login>[0-9a-z-]+) "
+    "from (?<client_addr>[0-9A-Fa-f:.]+) port (?<client_port>[0-9]+) "
+    "ssh(?<protocol>[0-9.]+)$";
+
+static double
+b_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+b_report(const char *what, size_t nl, double t)
+{
+
+	printf("%-8s %8zu lines in %7.3f s: %10.0f lines/s, %8.1f ns/line\n",
+	    what, nl, t, nl / t, t * 1e9 / nl);
+}
+
+int
+main(int argc, char *argv[])
+{
+	lj_pcreset_field fields[LJ_PCRESET_MAX_FIELDS];
+	regmatch_t pmatch[LJ_SSHD_NMATCH];
+	unsigned int nfields;
+	size_t l, nl, nm;
+	lj_pcreset *ps;
+	char **lines;
+	regex_t re;
+	double t0;
+
+	if (argc > 2) {
+		fprintf(stderr, "usage: b_pcreset [lines]\n");
+		exit(1);
+	}
+	nl = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+	if (nl == 0 || (lines = calloc(nl, sizeof *lines)) == NULL)
+		errx(1, "invalid arguments");
+	if (regcomp(&re, lj_sshd_msgs[0].re, REG_EXTENDED) != 0)
+		errx(1, "failed to compile %s", lj_sshd_msgs[0].re);
+	if ((ps = lj_pcreset_create()) == NULL ||
+	    lj_pcreset_add(ps, b_pcre) != 0)
+		errx(1, "failed to compile %s", b_pcre);
+	srandom(1);
+	for (l = 0; l < nl; ++l) {
+		if (asprintf(&lines[l], "Failed password for %suser%c from "
+		    "192.0.2.%ld port %ld ssh2",
+		    random() % 4 ? "" : "invalid user ",
+		    'a' + (int)(random() % 26),
+		    random() % 256, random() % 65536) < 0)
+			err(1, "asprintf()");
+	}
+
+	t0 = b_now();
+	for (l = nm = 0; l < nl; ++l)
+		nm += regexec(&re, lines[l], LJ_SSHD_NMATCH, pmatch, 0) == 0;
+	if (nm != nl)
+		errx(1, "regexec: matched %zu of %zu", nm, nl);
+	b_report("regexec", nl, b_now() - t0);
+
+	t0 = b_now();
+	for (l = nm = 0; l < nl; ++l)
+		nm += lj_pcreset_match(ps, lines[l], strlen(lines[l]), fields,
+		    &nfields) == 0;
+	if (nm != nl)
+		errx(1, "pcreset: matched %zu of %zu", nm, nl);
+	b_report("pcreset", nl, b_now() - t0);
+
+	for (l = 0; l < nl; ++l)
+		free(lines[l]);
+	regfree(&re);
+	lj_pcreset_destroy(ps);
+	free(lines);
+	exit(0);
+}
@@ -0,0 +1,114 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <logjam/spool.h>
+
+/*
+ * Spool benchmark: append a number of records of typical size to a
+ * spool, then replay them, and report the rate at which each is done.
+ *
+ * usage: b_spool directory [records [record size]]
+ */
+
+#define B_SEGSIZE	(16 * 1024 * 1024)
+#define B_MAXSIZE	((size_t)4 * 1024 * 1024 * 1024)
+
+static double
+b_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+b_report(const char *what, unsigned long n, size_t len, double t)
+{
+
+	printf("%-8s %10lu records in %7.3f s: %12.0f rec/s %9.1f MB/s\n",
+	    what, n, t, n / t, n * len / t / (1024 * 1024));
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long i, n;
+	const void *rec;
+	size_t len;
+	double t0;
+	spool *sp;
+	char *buf;
+
+	if (argc < 2 || argc > 4) {
+		fprintf(stderr, "usage: b_spool directory "
+		    "[records [record size]]\n");
+		exit(1);
+	}
+	n = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+	len = argc > 3 ? strtoul(argv[3], NULL, 10) : 256;
+	if (n == 0 || len == 0)
+		errx(1, "invalid arguments");
+	if ((buf = malloc(len)) == NULL)
+		err(1, "malloc()");
+	memset(buf, 'x', len);
+	if ((sp = spool_open(argv[1], B_SEGSIZE, B_MAXSIZE)) == NULL)
+		err(1, "%s", argv[1]);
+	if (spool_len(sp) > 0)
+		errx(1, "%s: spool is not empty", argv[1]);
+	t0 = b_now();
+	for (i = 0; i < n; ++i)
+		if (spool_append(sp, buf, len) != 0)
+			err(1, "spool_append()");
+	b_report("spill", n, len, b_now() - t0);
+	t0 = b_now();
+	for (i = 0; i < n; ++i) {
+		if (spool_peek(sp, &rec) != (ssize_t)len)
+			errx(1, "spool_peek(): short or missing record");
+		spool_consume(sp);
+	}
+	b_report("replay", n, len, b_now() - t0);
+	spool_peek(sp, &rec);
+	spool_close(sp);
+	free(buf);
+	exit(0);
+}
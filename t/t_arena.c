@@ -0,0 +1,252 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/arena.h>
+#include <logjam/cirq.h>
+
+#define T_NOBJ		20000
+#define T_BATCH		64
+
+/*
+ * Object size for a given sequence number: mostly small, with the odd
+ * one too large to share a slab.
+ */
+static size_t
+t_arena_size(unsigned int i)
+{
+
+	return (i % 997 == 0 ? 100000 + i : 1 + i % 250);
+}
+
+/*
+ * Fill an object with a pattern unique to its sequence number.
+ */
+static void
+t_arena_fill(void *p, unsigned int i)
+{
+
+	memset(p, 'a' + i % 26, t_arena_size(i));
+	memcpy(p, &i, t_arena_size(i) < sizeof i ? t_arena_size(i) : sizeof i);
+}
+
+/*
+ * Check that an object still holds its pattern and is aligned.
+ */
+static int
+t_arena_check(const void *p, unsigned int i)
+{
+	char buf[128];
+
+	if ((uintptr_t)p % 8 != 0)
+		return (t_compare_x(0, (uintptr_t)p % 8));
+	memset(buf, 'a' + i % 26, sizeof buf);
+	memcpy(buf, &i, t_arena_size(i) < sizeof i ?
+	    t_arena_size(i) : sizeof i);
+	return (t_compare_mem(buf, p, t_arena_size(i) < sizeof buf ?
+	    t_arena_size(i) : sizeof buf));
+}
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+/*
+ * Allocate a large number of objects of varying size, check that none
+ * of them overlap, then free them in batches.
+ */
+static int
+t_arena_many(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static void *obj[T_NOBJ];
+	unsigned int i;
+	size_t n;
+	int ret;
+
+	for (i = 0; i < T_NOBJ; ++i) {
+		t_assert((obj[i] = lj_arena_alloc(t_arena_size(i))) != NULL);
+		t_arena_fill(obj[i], i);
+	}
+	ret = 1;
+	for (i = 0; i < T_NOBJ; ++i)
+		ret &= t_arena_check(obj[i], i);
+	/* free every other object on its own, then the rest in batches */
+	for (i = 0; i < T_NOBJ; i += 2)
+		lj_arena_free(obj[i]);
+	for (i = 1, n = 0; i < T_NOBJ; i += 2)
+		obj[n++] = obj[i];
+	for (i = 0; i < n; i += T_BATCH)
+		lj_arena_free_batch(obj + i, n - i < T_BATCH ? n - i : T_BATCH);
+	lj_arena_release();
+	return (ret);
+}
+
+/*
+ * Objects freed before the slab they came from is retired.
+ */
+static int
+t_arena_early(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	void *p, *q;
+	int ret;
+
+	t_assert((p = lj_arena_alloc(10)) != NULL);
+	lj_arena_free(p);
+	t_assert((q = lj_arena_alloc(10)) != NULL);
+	ret = t_compare_ptr((char *)p + 16, q);
+	lj_arena_free(q);
+	lj_arena_release();
+	return (ret);
+}
+
+/*
+ * Slabs which have been emptied and retired go back to the pool the
+ * thread is bound to, and are reused.
+ */
+static int
+t_arena_pooled(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static void *obj[T_NOBJ];
+	size_t nget, nalloc, nput;
+	unsigned int i, round;
+	lj_pool *pool;
+	int ret;
+
+	t_assert((pool = lj_arena_pool_create()) != NULL);
+	lj_arena_bind(pool);
+	ret = 1;
+	for (round = 0; round < 2; ++round) {
+		for (i = 0; i < T_NOBJ; ++i) {
+			t_assert((obj[i] = lj_arena_alloc(t_arena_size(i))) !=
+			    NULL);
+			t_arena_fill(obj[i], i);
+		}
+		for (i = 0; i < T_NOBJ; ++i)
+			ret &= t_arena_check(obj[i], i);
+		for (i = 0; i < T_NOBJ; i += T_BATCH)
+			lj_arena_free_batch(obj + i,
+			    T_NOBJ - i < T_BATCH ? T_NOBJ - i : T_BATCH);
+		lj_arena_release();
+		lj_pool_stat(pool, &nget, &nalloc, &nput, 1);
+		ret &= t_compare_sz(nget, nput);
+		if (round > 0)
+			ret &= t_compare_sz(0, nalloc);
+	}
+	lj_arena_bind(NULL);
+	lj_pool_destroy(pool);
+	return (ret);
+}
+
+/*
+ * A producer thread allocates objects and passes them to the consumer,
+ * which checks them and frees them in batches.
+ */
+static void *
+t_arena_producer(void *arg)
+{
+	cirq *q = arg;
+	void *in[T_BATCH], *old[T_BATCH];
+	unsigned int i;
+	size_t n, nold;
+
+	for (i = n = 0; i < T_NOBJ || n > 0; n = nold) {
+		while (n < T_BATCH && i < T_NOBJ) {
+			if ((in[n] = lj_arena_alloc(t_arena_size(i))) == NULL)
+				break;
+			t_arena_fill(in[n++], i++);
+		}
+		nold = cirq_put_batch(q, in, n, old, 100000);
+		memcpy(in, old, nold * sizeof *in);
+	}
+	lj_arena_release();
+	return (NULL);
+}
+
+static int
+t_arena_threads(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	void *out[T_BATCH];
+	pthread_t thr;
+	unsigned int i;
+	size_t j, n;
+	cirq *q;
+	int ret;
+
+	t_assert((q = cirq_create_flags(256, CIRQ_SPSC | CIRQ_BLOCK)) != NULL);
+	t_assert(pthread_create(&thr, NULL, t_arena_producer, q) == 0);
+	ret = 1;
+	for (i = 0; i < T_NOBJ; i += n) {
+		if ((n = cirq_get_batch(q, out, T_BATCH, 1000000)) == 0) {
+			t_printv("timed out after %u objects\n", i);
+			ret = 0;
+			break;
+		}
+		for (j = 0; j < n; ++j)
+			ret &= t_arena_check(out[j], i + j);
+		lj_arena_free_batch(out, n);
+	}
+	pthread_join(thr, NULL);
+	cirq_destroy(q);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+
+	(void)argc;
+	(void)argv;
+	t_add_test(t_arena_many, NULL, "many objects");
+	t_add_test(t_arena_early, NULL, "free before retiring");
+	t_add_test(t_arena_pooled, NULL, "pooled slabs");
+	t_add_test(t_arena_threads, NULL, "cross-thread");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
@@ -0,0 +1,240 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <regex.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/bindscan.h>
+
+#define T_NLINES	50000
+
+static regex_t t_re;
+
+/*
+ * Bits and pieces of query log lines, valid and otherwise.
+ */
+static const char *t_sev[] = {
+	"", "", "", " info:", " debug2:", " client:", " INFO:", " :", "info:",
+};
+static const char *t_addr[] = {
+	"192.0.2.1", "2001:db8::53", "::ffff:198.51.100.7", "fe80::1%eth0",
+	"", "@0x7f2d4c0a8f10 192.0.2.1",
+};
+static const char *t_port[] = {
+	"53", "65535", "4711", "", "5x",
+};
+static const char *t_mid[] = {
+	"", "", " (example.com)", " (b\xe6r.example)", ": view internal",
+	" signer \"key\"", ": query: x.example IN A + (192.0.2.53)",
+	": query: ", ": query: y.example IN A",
+};
+static const char *t_name[] = {
+	"example.com", "_ldap._tcp.dc.example.org", ".", "a-b_c.example",
+	"", "two words", "b\xe6r.example",
+};
+static const char *t_class[] = {
+	"IN", "CH", "HS", "", "in",
+};
+static const char *t_type[] = {
+	"A", "AAAA", "TYPE65", "NS", "", "any",
+};
+static const char *t_flags[] = {
+	"+", "-", "+E", "-EDC", "+ETDC", "+E(0)K", "E", "",
+};
+static const char *t_server[] = {
+	"192.0.2.53", "2001:db8::1", "", "192.0.2.53 ",
+};
+
+/*
+ * Characters we sprinkle over lines to make sure both implementations
+ * reject, or accept, the same garbage.
+ */
+static const char t_noise[] = "0123456789afAZ:.#+-() _\t\xff";
+
+#define T_PICK(a) (a)[random() % (sizeof (a) / sizeof *(a))]
+
+/*
+ * Generate a query log line, mostly from valid pieces.
+ */
+static void
+t_bindscan_gen(char *str, size_t size)
+{
+
+	snprintf(str, size,
+	    "queries:%s client %s#%s%s: query: %s %s %s %s (%s)",
+	    T_PICK(t_sev), random() % 8 ? t_addr[0] : T_PICK(t_addr),
+	    random() % 8 ? t_port[0] : T_PICK(t_port), T_PICK(t_mid),
+	    random() % 8 ? t_name[0] : T_PICK(t_name),
+	    random() % 8 ? t_class[0] : T_PICK(t_class),
+	    random() % 8 ? t_type[0] : T_PICK(t_type), T_PICK(t_flags),
+	    random() % 8 ? t_server[0] : T_PICK(t_server));
+}
+
+/*
+ * Scan a line with both lj_bind_scan() and regexec() and compare the
+ * results.
+ */
+static int
+t_bindscan_compare(const char *str)
+{
+	regmatch_t pmatch[LJ_BIND_RE_NMATCH];
+	lj_bind_field f[LJ_BIND_NFIELDS];
+	unsigned int i;
+	int exp, got;
+
+	exp = regexec(&t_re, str, LJ_BIND_RE_NMATCH, pmatch, 0) == 0;
+	got = lj_bind_scan(str, f) == 0;
+	if (exp != got) {
+		t_printv("[%s] expected %s, got %s\n", str,
+		    exp ? "match" : "no match", got ? "match" : "no match");
+		return (0);
+	}
+	if (!exp)
+		return (1);
+	for (i = 0; i < LJ_BIND_NFIELDS; ++i) {
+		if (f[i].off != (size_t)pmatch[i + 2].rm_so ||
+		    f[i].off + f[i].len != (size_t)pmatch[i + 2].rm_eo) {
+			t_printv("[%s] field %u expected [%zu, %zu), "
+			    "got [%zu, %zu)\n", str, i,
+			    (size_t)pmatch[i + 2].rm_so,
+			    (size_t)pmatch[i + 2].rm_eo,
+			    f[i].off, f[i].off + f[i].len);
+			return (0);
+		}
+	}
+	return (1);
+}
+
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static struct t_case {
+	const char	*str;
+	int		 match;
+} t_cases[] = {
+	{ "queries: client 192.0.2.1#53: query: example.com IN A + "
+	  "(192.0.2.53)", 1 },
+	{ "queries: info: client 2001:db8::53#4711 (example.com): query: "
+	  "example.com IN AAAA -EDC (2001:db8::1)", 1 },
+	{ "queries: client 192.0.2.1#53: query: a IN A + (1.2.3.4): query: "
+	  "b IN A - (5.6.7.8)", 1 },
+	{ "queries: client 192.0.2.1#53: query: example.com IN A +E(0)K "
+	  "(192.0.2.53)", 0 },
+	{ "queries: client @0x7f2d4c0a8f10 192.0.2.1#53 (example.com): "
+	  "query: example.com IN A + (192.0.2.53)", 0 },
+	{ "queries: client 192.0.2.1#53: query: example.com IN A + "
+	  "(192.0.2.53) ", 0 },
+	{ "queries: client 192.0.2.1#53: query: example.com IN A +", 0 },
+	{ "queries: client 192.0.2.1#: query: example.com IN A + "
+	  "(192.0.2.53)", 0 },
+	{ "queries:", 0 },
+	{ "", 0 },
+};
+
+static int
+t_bindscan_case(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_case *tc = arg;
+	lj_bind_field f[LJ_BIND_NFIELDS];
+
+	return (t_compare_i(tc->match, lj_bind_scan(tc->str, f) == 0) &&
+	    t_bindscan_compare(tc->str));
+}
+
+/*
+ * Generate lines, some of them mangled, and check that we get the same
+ * results as regexec().
+ */
+static int
+t_bindscan_random(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	char str[512];
+	unsigned int i, n;
+	size_t len;
+	int ret;
+
+	srandom(1);
+	ret = 1;
+	for (i = 0; i < T_NLINES && ret; ++i) {
+		t_bindscan_gen(str, sizeof str);
+		len = strlen(str);
+		for (n = random() % 4; n > 0 && len > 0; --n)
+			str[random() % len] =
+			    t_noise[random() % (sizeof t_noise - 1)];
+		ret &= t_bindscan_compare(str);
+	}
+	return (ret);
+}
+
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i;
+
+	(void)argc;
+	(void)argv;
+	if (regcomp(&t_re, lj_bind_re, REG_EXTENDED) != 0)
+		return (-1);
+	for (i = 0; i < sizeof t_cases / sizeof *t_cases; ++i)
+		t_add_test(t_bindscan_case, &t_cases[i], "case %u", i);
+	t_add_test(t_bindscan_random, NULL, "random");
+	return (0);
+}
+
+static void
+t_cleanup(void)
+{
+
+	regfree(&t_re);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, t_cleanup, argc, argv);
+}
@@ -0,0 +1,188 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/chunk.h>
+#include <logjam/cirq.h>
+
+#define T_CHUNKSIZE	4096
+#define T_NCHUNK	1000
+#define T_NREF		16
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+/*
+ * A chunk which is released goes back to the pool and is reused.
+ */
+static int
+t_chunk_reuse(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_chunk_pool *pool;
+	lj_chunk *a, *b, *c;
+	int ret;
+
+	t_assert((pool = lj_chunk_pool_create(T_CHUNKSIZE)) != NULL);
+	t_assert((a = lj_chunk_get(pool)) != NULL);
+	t_assert((b = lj_chunk_get(pool)) != NULL);
+	ret = t_compare_sz(T_CHUNKSIZE, a->size);
+	lj_chunk_ref(a, 2);
+	lj_chunk_unref(a, 1);
+	lj_chunk_unref(a, 2);
+	t_assert((c = lj_chunk_get(pool)) != NULL);
+	ret &= t_compare_ptr(a, c);
+	ret &= t_compare_ul(1, c->refs);
+	lj_chunk_unref(b, 1);
+	lj_chunk_unref(c, 1);
+	lj_chunk_pool_destroy(pool);
+	return (ret);
+}
+
+/*
+ * Chunks which are still referenced when the pool is destroyed are
+ * freed when they are released.
+ */
+static int
+t_chunk_outlive(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_chunk_pool *pool;
+	lj_chunk *a, *b;
+
+	t_assert((pool = lj_chunk_pool_create(T_CHUNKSIZE)) != NULL);
+	t_assert((a = lj_chunk_get(pool)) != NULL);
+	t_assert((b = lj_chunk_get(pool)) != NULL);
+	lj_chunk_unref(a, 1);
+	lj_chunk_pool_destroy(pool);
+	memset(b->data, 'x', b->size);
+	lj_chunk_unref(b, 1);
+	return (1);
+}
+
+/*
+ * A producer fills chunks and passes out several references to each,
+ * which a consumer checks and releases.  If a chunk were recycled while
+ * still referenced, the consumer would see it change under its feet.
+ */
+struct t_ref {
+	lj_chunk	*chunk;
+	unsigned int	 n;
+};
+
+static void *
+t_chunk_producer(void *arg)
+{
+	static struct t_ref refs[T_NCHUNK][T_NREF];
+	lj_chunk_pool *pool;
+	lj_chunk *chunk;
+	cirq *q = arg;
+	void *p;
+	unsigned int i, j;
+
+	if ((pool = lj_chunk_pool_create(T_CHUNKSIZE)) == NULL)
+		return (NULL);
+	for (i = 0; i < T_NCHUNK; ++i) {
+		if ((chunk = lj_chunk_get(pool)) == NULL)
+			break;
+		memset(chunk->data, 'a' + i % 26, chunk->size);
+		lj_chunk_ref(chunk, T_NREF);
+		for (j = 0; j < T_NREF; ++j) {
+			refs[i][j].chunk = chunk;
+			refs[i][j].n = i;
+			for (p = &refs[i][j]; cirq_put(q, p) != NULL; )
+				/* full, try again */ ;
+		}
+		lj_chunk_unref(chunk, 1);
+	}
+	lj_chunk_pool_destroy(pool);
+	return (NULL);
+}
+
+static int
+t_chunk_threads(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	char buf[T_CHUNKSIZE];
+	struct t_ref *ref;
+	pthread_t thr;
+	unsigned int i;
+	cirq *q;
+	int ret;
+
+	t_assert((q = cirq_create_flags(T_NREF, CIRQ_SPSC | CIRQ_BLOCK)) !=
+	    NULL);
+	t_assert(pthread_create(&thr, NULL, t_chunk_producer, q) == 0);
+	ret = 1;
+	for (i = 0; i < T_NCHUNK * T_NREF; ++i) {
+		if ((ref = cirq_get(q, 1000000)) == NULL) {
+			t_printv("timed out after %u references\n", i);
+			ret = 0;
+			break;
+		}
+		memset(buf, 'a' + ref->n % 26, sizeof buf);
+		ret &= t_compare_mem(buf, ref->chunk->data, sizeof buf);
+		lj_chunk_unref(ref->chunk, 1);
+	}
+	pthread_join(thr, NULL);
+	cirq_destroy(q);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+
+	(void)argc;
+	(void)argv;
+	t_add_test(t_chunk_reuse, NULL, "reuse");
+	t_add_test(t_chunk_outlive, NULL, "outlive pool");
+	t_add_test(t_chunk_threads, NULL, "cross-thread");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
@@ -33,7 +33,12 @@
 
 #include <sys/types.h>
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <cryb/test.h>
 
@@ -44,19 +49,29 @@ static int numbers[] = {
 	0x8, 0x9, 0xa, 0xb, 0xc, 0xd, 0xe, 0xf,
 };
 
+static unsigned int locked = 0;
+static unsigned int locked_newest = CIRQ_DROP_NEWEST;
+static unsigned int locked_block = CIRQ_BLOCK;
+static unsigned int spsc = CIRQ_SPSC;
+static unsigned int spsc_newest = CIRQ_SPSC | CIRQ_DROP_NEWEST;
+static unsigned int spsc_block = CIRQ_SPSC | CIRQ_BLOCK;
+
+#define T_NOBJ		1000000
+#define T_BATCH		16
+
 
 /***************************************************************************
  * Test cases
  */
 static int
-t_cirq_put_get_simple(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+t_cirq_put_get_simple(char **desc CRYB_UNUSED, void *arg)
 {
 	cirq *q;
 	size_t nput, nget, ndrop;
 	int ret;
 
 	ret = 1;
-	q = cirq_create(7);
+	q = cirq_create_flags(7, *(unsigned int *)arg);
 	t_assert(q != NULL);
 	cirq_put(q, &numbers[9]);
 	ret &= t_compare_sz(1, cirq_len(q));
@@ -71,14 +86,14 @@ t_cirq_put_get_simple(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
 }
 
 static int
-t_cirq_put_get_full(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+t_cirq_put_get_full(char **desc CRYB_UNUSED, void *arg)
 {
 	cirq *q;
 	size_t nput, nget, ndrop;
 	int i, ret;
 
 	ret = 1;
-	q = cirq_create(7);
+	q = cirq_create_flags(7, *(unsigned int *)arg);
 	t_assert(q != NULL);
 	for (i = 0; i < 7; ++i)
 		cirq_put(q, &numbers[i]);
@@ -95,14 +110,14 @@ t_cirq_put_get_full(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
 }
 
 static int
-t_cirq_put_get_overfull(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+t_cirq_put_get_overfull(char **desc CRYB_UNUSED, void *arg)
 {
 	cirq *q;
 	size_t nput, nget, ndrop;
 	int i, ret;
 
 	ret = 1;
-	q = cirq_create(7);
+	q = cirq_create_flags(7, *(unsigned int *)arg);
 	t_assert(q != NULL);
 	for (i = 0; i < 10; ++i)
 		cirq_put(q, &numbers[i]);
@@ -118,6 +133,418 @@ t_cirq_put_get_overfull(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
 	return (ret);
 }
 
+static int
+t_cirq_batch_simple(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[5], *out[16];
+	cirq *q;
+	size_t n, nput, nget, ndrop;
+	int i, ret;
+
+	ret = 1;
+	q = cirq_create_flags(7, *(unsigned int *)arg);
+	t_assert(q != NULL);
+	for (i = 0; i < 5; ++i)
+		in[i] = &numbers[i];
+	ret &= t_compare_sz(0, cirq_put_batch(q, in, 5, out, 0));
+	ret &= t_compare_sz(5, cirq_len(q));
+	n = cirq_get_batch(q, out, 16, 0);
+	ret &= t_compare_sz(5, n);
+	for (i = 0; i < (int)n; ++i)
+		ret &= t_compare_i(numbers[i], *(int *)out[i]);
+	ret &= t_compare_sz(0, cirq_len(q));
+	ret &= t_compare_sz(0, cirq_get_batch(q, out, 16, 0));
+	cirq_stat(q, &nput, &nget, &ndrop, 0);
+	ret &= t_compare_sz(5, nput) &
+	    t_compare_sz(5, nget) &
+	    t_compare_sz(0, ndrop);
+	cirq_destroy(q);
+	return (ret);
+}
+
+static int
+t_cirq_batch_overfull(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[10], *out[16];
+	cirq *q;
+	size_t n, nput, nget, ndrop;
+	int i, ret;
+
+	ret = 1;
+	q = cirq_create_flags(7, *(unsigned int *)arg);
+	t_assert(q != NULL);
+	for (i = 0; i < 4; ++i)
+		cirq_put(q, &numbers[i]);
+	for (i = 0; i < 10; ++i)
+		in[i] = &numbers[4 + i];
+	ret &= t_compare_sz(7, cirq_put_batch(q, in, 10, out, 0));
+	ret &= t_compare_sz(7, cirq_len(q));
+	n = cirq_get_batch(q, out, 3, 0);
+	ret &= t_compare_sz(3, n);
+	for (i = 0; i < (int)n; ++i)
+		ret &= t_compare_i(numbers[7 + i], *(int *)out[i]);
+	n = cirq_get_batch(q, out, 16, 0);
+	ret &= t_compare_sz(4, n);
+	for (i = 0; i < (int)n; ++i)
+		ret &= t_compare_i(numbers[10 + i], *(int *)out[i]);
+	cirq_stat(q, &nput, &nget, &ndrop, 0);
+	ret &= t_compare_sz(14, nput) &
+	    t_compare_sz(7, nget) &
+	    t_compare_sz(7, ndrop);
+	cirq_destroy(q);
+	return (ret);
+}
+
+static int
+t_cirq_drop_newest(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[3], *out[3];
+	cirq *q;
+	size_t nput, nget, ndrop;
+	int i, ret;
+
+	ret = 1;
+	q = cirq_create_flags(7, *(unsigned int *)arg);
+	t_assert(q != NULL);
+	for (i = 0; i < 8; ++i)
+		ret &= t_compare_ptr(i < 7 ? NULL : &numbers[i],
+		    cirq_put(q, &numbers[i]));
+	for (i = 0; i < 3; ++i)
+		in[i] = &numbers[8 + i];
+	ret &= t_compare_sz(3, cirq_put_batch(q, in, 3, out, 0));
+	for (i = 0; i < 3; ++i)
+		ret &= t_compare_ptr(in[i], out[i]);
+	ret &= t_compare_sz(7, cirq_len(q));
+	for (i = 0; i < 7; ++i)
+		ret &= t_compare_i(numbers[i], *(int *)cirq_get(q, 0));
+	cirq_stat(q, &nput, &nget, &ndrop, 0);
+	ret &= t_compare_sz(11, nput) &
+	    t_compare_sz(7, nget) &
+	    t_compare_sz(4, ndrop);
+	cirq_destroy(q);
+	return (ret);
+}
+
+static int
+t_cirq_block_timeout(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[5], *out[5];
+	cirq *q;
+	size_t nput, nget, ndrop;
+	int i, ret;
+
+	ret = 1;
+	q = cirq_create_flags(7, *(unsigned int *)arg);
+	t_assert(q != NULL);
+	for (i = 0; i < 5; ++i)
+		in[i] = &numbers[i];
+	ret &= t_compare_sz(0, cirq_put_batch(q, in, 5, out, 0));
+	for (i = 0; i < 5; ++i)
+		in[i] = &numbers[5 + i];
+	errno = 0;
+	ret &= t_compare_sz(3, cirq_put_batch(q, in, 5, out, 1000));
+	ret &= t_compare_i(ETIMEDOUT, errno);
+	for (i = 0; i < 3; ++i)
+		ret &= t_compare_ptr(in[2 + i], out[i]);
+	ret &= t_compare_sz(7, cirq_len(q));
+	for (i = 0; i < 7; ++i)
+		ret &= t_compare_i(numbers[i], *(int *)cirq_get(q, 0));
+	cirq_stat(q, &nput, &nget, &ndrop, 0);
+	ret &= t_compare_sz(7, nput) &
+	    t_compare_sz(7, nget) &
+	    t_compare_sz(0, ndrop);
+	cirq_destroy(q);
+	return (ret);
+}
+
+/*
+ * Memory budget tests.  Each object counts for as many bytes as the
+ * number it points to.  The cirq is first filled to its budget with
+ * objects of size 4, 3, 2 and 1, then we try to add two of size 3.
+ */
+static size_t
+t_intsize(const void *p)
+{
+
+	return (*(const int *)p);
+}
+
+static cirq *
+t_budget_fill(unsigned int flags)
+{
+	void *in[4], *out[4];
+	cirq *q;
+	int i;
+
+	if ((q = cirq_create_flags(16, flags)) == NULL)
+		return (NULL);
+	if (cirq_set_budget(q, 10, t_intsize) != 0) {
+		cirq_destroy(q);
+		return (NULL);
+	}
+	for (i = 0; i < 4; ++i)
+		in[i] = &numbers[4 - i];
+	if (cirq_put_batch(q, in, 4, out, 0) != 0 || cirq_bytes(q) != 10) {
+		cirq_destroy(q);
+		return (NULL);
+	}
+	return (q);
+}
+
+static int
+t_cirq_budget_oldest(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[2], *out[2];
+	cirq *q;
+	int ret;
+
+	ret = 1;
+	q = t_budget_fill(*(unsigned int *)arg);
+	t_assert(q != NULL);
+	in[0] = in[1] = &numbers[3];
+	ret &= t_compare_sz(2, cirq_put_batch(q, in, 2, out, 0));
+	ret &= t_compare_ptr(&numbers[4], out[0]);
+	ret &= t_compare_ptr(&numbers[3], out[1]);
+	ret &= t_compare_sz(4, cirq_len(q));
+	ret &= t_compare_sz(9, cirq_bytes(q));
+	ret &= t_compare_i(2, *(int *)cirq_get(q, 0));
+	ret &= t_compare_i(1, *(int *)cirq_get(q, 0));
+	ret &= t_compare_sz(6, cirq_bytes(q));
+	/* would displace more than one object, so it is rejected */
+	ret &= t_compare_ptr(&numbers[12], cirq_put(q, &numbers[12]));
+	ret &= t_compare_sz(2, cirq_len(q));
+	cirq_get(q, 0);
+	cirq_get(q, 0);
+	/* an object larger than the budget fits in an empty cirq */
+	ret &= t_compare_ptr(NULL, cirq_put(q, &numbers[12]));
+	ret &= t_compare_sz(12, cirq_bytes(q));
+	ret &= t_compare_ptr(&numbers[12], cirq_put(q, &numbers[3]));
+	ret &= t_compare_sz(3, cirq_bytes(q));
+	cirq_destroy(q);
+	return (ret);
+}
+
+static int
+t_cirq_budget_newest(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[2], *out[2];
+	cirq *q;
+	int ret;
+
+	ret = 1;
+	q = t_budget_fill(*(unsigned int *)arg);
+	t_assert(q != NULL);
+	in[0] = in[1] = &numbers[3];
+	ret &= t_compare_sz(2, cirq_put_batch(q, in, 2, out, 0));
+	ret &= t_compare_ptr(&numbers[3], out[0]);
+	ret &= t_compare_ptr(&numbers[3], out[1]);
+	ret &= t_compare_sz(4, cirq_len(q));
+	ret &= t_compare_sz(10, cirq_bytes(q));
+	ret &= t_compare_i(4, *(int *)cirq_get(q, 0));
+	ret &= t_compare_sz(0, cirq_put_batch(q, in, 1, out, 0));
+	ret &= t_compare_sz(9, cirq_bytes(q));
+	cirq_destroy(q);
+	return (ret);
+}
+
+static int
+t_cirq_budget_block(char **desc CRYB_UNUSED, void *arg)
+{
+	void *in[2], *out[2];
+	cirq *q;
+	int ret;
+
+	ret = 1;
+	q = t_budget_fill(*(unsigned int *)arg);
+	t_assert(q != NULL);
+	in[0] = in[1] = &numbers[3];
+	errno = 0;
+	ret &= t_compare_sz(2, cirq_put_batch(q, in, 2, out, 1000));
+	ret &= t_compare_i(ETIMEDOUT, errno);
+	ret &= t_compare_sz(10, cirq_bytes(q));
+	ret &= t_compare_i(4, *(int *)cirq_get(q, 0));
+	errno = 0;
+	ret &= t_compare_sz(1, cirq_put_batch(q, in, 2, out, 1000));
+	ret &= t_compare_i(ETIMEDOUT, errno);
+	ret &= t_compare_sz(9, cirq_bytes(q));
+	cirq_destroy(q);
+	return (ret);
+}
+
+/*
+ * Concurrency tests.  The producer places the numbers from 1 through
+ * T_NOBJ on the cirq as fast as it can while the consumer retrieves them,
+ * optionally pausing every now and then to let the cirq fill up.  The
+ * consumer must see a strictly increasing sequence, and every object
+ * must be accounted for either as retrieved or as dropped.  A blocking
+ * cirq must not drop anything.
+ */
+struct t_conc {
+	cirq		*q;
+	unsigned int	 flags;
+	unsigned int	 pause;
+	size_t		 batch;
+	size_t		 nseen;
+	size_t		 ndisplaced;
+	int		 ordered;
+	int		 done;
+};
+
+static void *
+t_conc_producer(void *arg)
+{
+	struct t_conc *tc = arg;
+	void *in[T_BATCH], *old[T_BATCH];
+	uintptr_t i;
+	size_t n, nold;
+
+	for (i = 1, n = 0; i <= T_NOBJ || n > 0; ) {
+		if (tc->batch == 0) {
+			if (cirq_put(tc->q, (void *)i++) != NULL)
+				tc->ndisplaced++;
+			continue;
+		}
+		while (n < tc->batch && i <= T_NOBJ)
+			in[n++] = (void *)i++;
+		nold = cirq_put_batch(tc->q, in, n, old, 1000);
+		if (tc->flags & CIRQ_BLOCK) {
+			/* try again with whatever was left over */
+			memcpy(in, old, nold * sizeof *in);
+			n = nold;
+		} else {
+			tc->ndisplaced += nold;
+			n = 0;
+		}
+	}
+	__atomic_store_n(&tc->done, 1, __ATOMIC_RELEASE);
+	return (NULL);
+}
+
+static int
+t_cirq_concurrent(struct t_conc *tc, unsigned int flags, size_t size)
+{
+	pthread_t thr;
+	void *out[T_BATCH];
+	size_t i, n, nput, nget, ndrop;
+	uintptr_t last, obj;
+	int idle, ret;
+
+	ret = 1;
+	tc->flags = flags;
+	tc->q = cirq_create_flags(size, flags);
+	t_assert(tc->q != NULL);
+	t_assert(pthread_create(&thr, NULL, t_conc_producer, tc) == 0);
+	tc->ordered = 1;
+	for (last = 0, idle = 0; ; ) {
+		n = cirq_get_batch(tc->q, out, tc->batch > 0 ? T_BATCH - 3 : 1,
+		    100000);
+		if (n == 0) {
+			if (__atomic_load_n(&tc->done, __ATOMIC_ACQUIRE) &&
+			    cirq_len(tc->q) == 0)
+				break;
+			if (++idle < 10)
+				continue;
+			t_printv("timed out after %zu objects\n", tc->nseen);
+			ret = 0;
+			break;
+		}
+		for (i = 0, idle = 0; i < n; ++i, last = obj) {
+			if ((obj = (uintptr_t)out[i]) <= last)
+				tc->ordered = 0;
+			tc->nseen++;
+			if (tc->pause > 0 && tc->nseen % tc->pause == 0)
+				usleep(100);
+		}
+	}
+	pthread_join(thr, NULL);
+	cirq_stat(tc->q, &nput, &nget, &ndrop, 0);
+	ret &= t_compare_i(1, tc->ordered) &
+	    t_compare_sz(T_NOBJ, nput) &
+	    t_compare_sz(tc->nseen, nget) &
+	    t_compare_sz(tc->ndisplaced, ndrop) &
+	    t_compare_sz(T_NOBJ, nget + ndrop) &
+	    t_compare_sz(0, cirq_len(tc->q));
+	if (flags & CIRQ_BLOCK)
+		ret &= t_compare_sz(0, ndrop);
+	cirq_destroy(tc->q);
+	return (ret);
+}
+
+static int
+t_cirq_concurrent_nodrop(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_conc tc = { .pause = 0 };
+
+	return (t_cirq_concurrent(&tc, *(unsigned int *)arg, T_NOBJ));
+}
+
+static int
+t_cirq_concurrent_drop(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_conc tc = { .pause = 1000 };
+
+	return (t_cirq_concurrent(&tc, *(unsigned int *)arg, 64));
+}
+
+static int
+t_cirq_concurrent_batch(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_conc tc = { .batch = T_BATCH };
+
+	return (t_cirq_concurrent(&tc, *(unsigned int *)arg, T_NOBJ));
+}
+
+static int
+t_cirq_concurrent_batch_drop(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_conc tc = { .batch = T_BATCH, .pause = 1000 };
+
+	return (t_cirq_concurrent(&tc, *(unsigned int *)arg, 64));
+}
+
+/*
+ * Verify that a consumer sleeping on an empty cirq is woken up when an
+ * object arrives rather than waiting for its deadline.
+ */
+static void *
+t_wakeup_producer(void *arg)
+{
+
+	usleep(100000);
+	cirq_put(arg, &numbers[5]);
+	return (NULL);
+}
+
+static int
+t_cirq_wakeup(char **desc CRYB_UNUSED, void *arg)
+{
+	struct timespec t0, t1;
+	pthread_t thr;
+	cirq *q;
+	void *obj;
+	long ms;
+	int ret;
+
+	ret = 1;
+	q = cirq_create_flags(7, *(unsigned int *)arg);
+	t_assert(q != NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	t_assert(pthread_create(&thr, NULL, t_wakeup_producer, q) == 0);
+	obj = cirq_get(q, 10000000);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	pthread_join(thr, NULL);
+	ms = (t1.tv_sec - t0.tv_sec) * 1000 +
+	    (t1.tv_nsec - t0.tv_nsec) / 1000000;
+	ret &= t_compare_ptr(&numbers[5], obj);
+	if (ms >= 5000) {
+		t_printv("woke up after %ld ms\n", ms);
+		ret = 0;
+	}
+	cirq_destroy(q);
+	return (ret);
+}
+
+
 
 /***************************************************************************
  * Boilerplate
@@ -127,9 +554,58 @@ static int
 t_prepare(int argc CRYB_UNUSED, char *argv[] CRYB_UNUSED)
 {
 
-	t_add_test(t_cirq_put_get_simple, NULL, "simple put and get");
-	t_add_test(t_cirq_put_get_full, NULL, "fill to capacity");
-	t_add_test(t_cirq_put_get_overfull, NULL, "fill beyond capacity");
+	t_add_test(t_cirq_put_get_simple, &locked, "simple put and get");
+	t_add_test(t_cirq_put_get_full, &locked, "fill to capacity");
+	t_add_test(t_cirq_put_get_overfull, &locked, "fill beyond capacity");
+	t_add_test(t_cirq_batch_simple, &locked, "batch put and get");
+	t_add_test(t_cirq_batch_overfull, &locked, "batch beyond capacity");
+	t_add_test(t_cirq_concurrent_nodrop, &locked, "concurrent");
+	t_add_test(t_cirq_concurrent_drop, &locked, "concurrent with drops");
+	t_add_test(t_cirq_concurrent_batch, &locked, "concurrent batch");
+	t_add_test(t_cirq_concurrent_batch_drop, &locked,
+	    "concurrent batch with drops");
+	t_add_test(t_cirq_wakeup, &locked, "wake up sleeping consumer");
+	t_add_test(t_cirq_drop_newest, &locked_newest, "drop newest");
+	t_add_test(t_cirq_concurrent_drop, &locked_newest,
+	    "concurrent drop newest");
+	t_add_test(t_cirq_concurrent_batch_drop, &locked_newest,
+	    "concurrent batch drop newest");
+	t_add_test(t_cirq_block_timeout, &locked_block, "block with timeout");
+	t_add_test(t_cirq_concurrent_drop, &locked_block, "concurrent block");
+	t_add_test(t_cirq_concurrent_batch_drop, &locked_block,
+	    "concurrent batch block");
+	t_add_test(t_cirq_budget_oldest, &locked, "budget");
+	t_add_test(t_cirq_budget_newest, &locked_newest, "budget, drop newest");
+	t_add_test(t_cirq_budget_block, &locked_block, "budget, block");
+	t_add_test(t_cirq_put_get_simple, &spsc, "simple put and get (spsc)");
+	t_add_test(t_cirq_put_get_full, &spsc, "fill to capacity (spsc)");
+	t_add_test(t_cirq_put_get_overfull, &spsc,
+	    "fill beyond capacity (spsc)");
+	t_add_test(t_cirq_batch_simple, &spsc, "batch put and get (spsc)");
+	t_add_test(t_cirq_batch_overfull, &spsc,
+	    "batch beyond capacity (spsc)");
+	t_add_test(t_cirq_concurrent_nodrop, &spsc, "concurrent (spsc)");
+	t_add_test(t_cirq_concurrent_drop, &spsc,
+	    "concurrent with drops (spsc)");
+	t_add_test(t_cirq_concurrent_batch, &spsc, "concurrent batch (spsc)");
+	t_add_test(t_cirq_concurrent_batch_drop, &spsc,
+	    "concurrent batch with drops (spsc)");
+	t_add_test(t_cirq_wakeup, &spsc, "wake up sleeping consumer (spsc)");
+	t_add_test(t_cirq_drop_newest, &spsc_newest, "drop newest (spsc)");
+	t_add_test(t_cirq_concurrent_drop, &spsc_newest,
+	    "concurrent drop newest (spsc)");
+	t_add_test(t_cirq_concurrent_batch_drop, &spsc_newest,
+	    "concurrent batch drop newest (spsc)");
+	t_add_test(t_cirq_block_timeout, &spsc_block,
+	    "block with timeout (spsc)");
+	t_add_test(t_cirq_concurrent_drop, &spsc_block,
+	    "concurrent block (spsc)");
+	t_add_test(t_cirq_concurrent_batch_drop, &spsc_block,
+	    "concurrent batch block (spsc)");
+	t_add_test(t_cirq_budget_oldest, &spsc, "budget (spsc)");
+	t_add_test(t_cirq_budget_newest, &spsc_newest,
+	    "budget, drop newest (spsc)");
+	t_add_test(t_cirq_budget_block, &spsc_block, "budget, block (spsc)");
 	return (0);
 }
 
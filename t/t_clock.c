@@ -0,0 +1,139 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <time.h>
+
+#include <cryb/test.h>
+
+#include <logjam/clock.h>
+
+static void
+t_clock_sleep(void)
+{
+	struct timespec ts = { 0, 2000000 };
+
+	nanosleep(&ts, NULL);
+}
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static int
+t_clock_invalid(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	int ret;
+
+	ret = t_compare_i(0, lj_clock_set_mode("precise"));
+	ret &= t_compare_i(-1, lj_clock_set_mode("sundial"));
+	ret &= t_compare_i(LJ_CLOCK_PRECISE, lj_clock_mode);
+	return (ret);
+}
+
+/*
+ * The precise clock moves on between calls.
+ */
+static int
+t_clock_precise(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	uint64_t a, b;
+
+	t_assert(lj_clock_set_mode("precise") == 0);
+	a = lj_clock_now();
+	t_clock_sleep();
+	b = lj_clock_now();
+	return (t_compare_i(1, b - a >= 2000));
+}
+
+/*
+ * The coarse clock is not far off the precise one.
+ */
+static int
+t_clock_coarse(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	uint64_t a, b;
+
+	t_assert(lj_clock_set_mode("precise") == 0);
+	a = lj_clock_now();
+	t_assert(lj_clock_set_mode("coarse") == 0);
+	b = lj_clock_now();
+	return (t_compare_i(1, b + 100000 > a && b < a + 100000));
+}
+
+/*
+ * In batch mode, the clock only moves when we start a new batch.
+ */
+static int
+t_clock_batch(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	uint64_t a, b, c;
+	int ret;
+
+	t_assert(lj_clock_set_mode("batch") == 0);
+	lj_clock_tick();
+	a = lj_clock_now();
+	t_clock_sleep();
+	b = lj_clock_now();
+	ret = t_compare_u64(a, b);
+	lj_clock_tick();
+	c = lj_clock_now();
+	ret &= t_compare_i(1, c - a >= 2000);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+
+	(void)argc;
+	(void)argv;
+	t_add_test(t_clock_invalid, NULL, "invalid mode");
+	t_add_test(t_clock_precise, NULL, "precise");
+	t_add_test(t_clock_coarse, NULL, "coarse");
+	t_add_test(t_clock_batch, NULL, "batch");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
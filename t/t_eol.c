@@ -0,0 +1,184 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/eol.h>
+
+#define T_BUFSIZE	512
+#define T_MAXEOL	T_BUFSIZE
+
+static const char *t_impls[] = { "avx2", "sse2", "scalar" };
+
+/*
+ * Reference implementation.
+ */
+static size_t
+t_eol_ref(const char *buf, size_t off, size_t len, size_t *eol, size_t max)
+{
+	size_t n;
+
+	for (n = 0; off < len && n < max; ++off)
+		if (buf[off] == '\n')
+			eol[n++] = off;
+	return (n);
+}
+
+/*
+ * Scan a buffer with both the selected implementation and the reference
+ * implementation and compare the results.
+ */
+static int
+t_eol_compare(const char *buf, size_t off, size_t len, size_t max)
+{
+	size_t exp[T_MAXEOL], got[T_MAXEOL];
+	size_t nexp, ngot;
+
+	nexp = t_eol_ref(buf, off, len, exp, max);
+	ngot = lj_eol_scan(buf, off, len, got, max);
+	if (!t_compare_sz(nexp, ngot))
+		return (0);
+	return (t_compare_mem(exp, got, nexp * sizeof *exp));
+}
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static int
+t_eol_empty(char **desc CRYB_UNUSED, void *arg)
+{
+	size_t eol[1];
+
+	if (lj_eol_select(arg) != 0)
+		return (0);
+	return (t_compare_sz(0, lj_eol_scan("\n", 0, 0, eol, 1)));
+}
+
+static int
+t_eol_none(char **desc CRYB_UNUSED, void *arg)
+{
+	char buf[T_BUFSIZE];
+	size_t eol[1];
+
+	if (lj_eol_select(arg) != 0)
+		return (0);
+	memset(buf, 'x', sizeof buf);
+	return (t_compare_sz(0, lj_eol_scan(buf, 0, sizeof buf, eol, 1)));
+}
+
+/*
+ * Every byte is a newline, and the caller's array is too small to hold
+ * all of them.
+ */
+static int
+t_eol_max(char **desc CRYB_UNUSED, void *arg)
+{
+	char buf[T_BUFSIZE];
+	size_t max;
+	int ret;
+
+	if (lj_eol_select(arg) != 0)
+		return (0);
+	memset(buf, '\n', sizeof buf);
+	ret = 1;
+	for (max = 0; max <= 100; ++max)
+		ret &= t_eol_compare(buf, 3, sizeof buf, max);
+	return (ret);
+}
+
+/*
+ * Random buffers with varying newline density, scanned from every
+ * starting offset up to and past the width of the widest vector.
+ */
+static int
+t_eol_random(char **desc CRYB_UNUSED, void *arg)
+{
+	char buf[T_BUFSIZE];
+	unsigned int density, i;
+	size_t off, len;
+	int ret;
+
+	if (lj_eol_select(arg) != 0)
+		return (0);
+	srandom(1);
+	ret = 1;
+	for (density = 1; density <= 64; density *= 2) {
+		for (i = 0; i < sizeof buf; ++i)
+			buf[i] = random() % density ? 'x' : '\n';
+		for (off = 0; off < 40; ++off)
+			for (len = off; len < sizeof buf; len += 7)
+				ret &= t_eol_compare(buf, off, len, T_MAXEOL) &
+				    t_eol_compare(buf, off, len, 5);
+	}
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i;
+
+	(void)argc;
+	(void)argv;
+	for (i = 0; i < sizeof t_impls / sizeof t_impls[0]; ++i) {
+		/* skip implementations this CPU or compiler lacks */
+		if (lj_eol_select(t_impls[i]) != 0)
+			continue;
+		t_add_test(t_eol_empty, (void *)t_impls[i],
+		    "empty (%s)", t_impls[i]);
+		t_add_test(t_eol_none, (void *)t_impls[i],
+		    "none (%s)", t_impls[i]);
+		t_add_test(t_eol_max, (void *)t_impls[i],
+		    "max (%s)", t_impls[i]);
+		t_add_test(t_eol_random, (void *)t_impls[i],
+		    "random (%s)", t_impls[i]);
+	}
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
@@ -0,0 +1,181 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <logjam/json.h>
+
+#include <cryb/test.h>
+
+#define T_CANARY	0x7f
+
+struct t_case {
+	const char *desc;
+	const char *in;
+	size_t len;
+	const char *out;
+};
+
+#define T_STR(s)	(s), sizeof(s) - 1
+
+
+/***************************************************************************
+ * Test cases
+ */
+static struct t_case t_cases[] = {
+	{
+		.desc	= "empty",
+		.in	= T_STR(""),
+		.out	= "\"\"",
+	},
+	{
+		.desc	= "plain",
+		.in	= T_STR("Accepted publickey for root"),
+		.out	= "\"Accepted publickey for root\"",
+	},
+	{
+		.desc	= "quote and backslash",
+		.in	= T_STR("say \"C:\\\""),
+		.out	= "\"say \\\"C:\\\\\\\"\"",
+	},
+	{
+		.desc	= "short escapes",
+		.in	= T_STR("\b\f\n\r\t"),
+		.out	= "\"\\b\\f\\n\\r\\t\"",
+	},
+	{
+		.desc	= "control characters",
+		.in	= T_STR("\001x\033\037"),
+		.out	= "\"\\u0001x\\u001B\\u001F\"",
+	},
+	{
+		.desc	= "embedded nul",
+		.in	= T_STR("a\0b"),
+		.out	= "\"a\\u0000b\"",
+	},
+	{
+		.desc	= "slash and delete",
+		.in	= T_STR("/\177"),
+		.out	= "\"/\177\"",
+	},
+	{
+		.desc	= "valid utf-8",
+		.in	= T_STR("bl\303\245b\303\246r "
+		    "\342\202\254 \360\237\220\247"),
+		.out	= "\"bl\303\245b\303\246r "
+		    "\342\202\254 \360\237\220\247\"",
+	},
+	{
+		.desc	= "stray continuation byte",
+		.in	= T_STR("a\200b"),
+		.out	= "\"a\357\277\275b\"",
+	},
+	{
+		.desc	= "truncated sequence",
+		.in	= T_STR("a\342\202"),
+		.out	= "\"a\357\277\275\357\277\275\"",
+	},
+	{
+		.desc	= "overlong encoding",
+		.in	= T_STR("\300\257"),
+		.out	= "\"\357\277\275\357\277\275\"",
+	},
+	{
+		.desc	= "surrogate",
+		.in	= T_STR("\355\240\200"),
+		.out	= "\"\357\277\275\357\277\275\357\277\275\"",
+	},
+	{
+		.desc	= "beyond U+10FFFF",
+		.in	= T_STR("\364\220\200\200"),
+		.out	= "\"\357\277\275\357\277\275"
+		    "\357\277\275\357\277\275\"",
+	},
+};
+
+static int
+t_json_quote(char **desc CRYB_UNUSED, void *arg)
+{
+	const struct t_case *t = arg;
+	char buf[LJ_JSON_QUOTE_MAX(64) + 1];
+	size_t len;
+
+	memset(buf, T_CANARY, sizeof buf);
+	len = lj_json_quote(buf, t->in, t->len);
+	if (len > LJ_JSON_QUOTE_MAX(t->len) || buf[len] != T_CANARY) {
+		t_printv("buffer overflow\n");
+		return (0);
+	}
+	return (t_compare_sz(strlen(t->out), len) &
+	    t_compare_mem(t->out, buf, len));
+}
+
+/*
+ * Every byte escaped, which is the worst case.
+ */
+static int
+t_json_quote_worst(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	char in[16], buf[LJ_JSON_QUOTE_MAX(sizeof in)];
+	size_t len;
+
+	memset(in, '\001', sizeof in);
+	len = lj_json_quote(buf, in, sizeof in);
+	return (t_compare_sz(sizeof buf, len));
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i;
+
+	(void)argc;
+	(void)argv;
+	for (i = 0; i < sizeof t_cases / sizeof t_cases[0]; ++i)
+		t_add_test(t_json_quote, &t_cases[i], "%s", t_cases[i].desc);
+	t_add_test(t_json_quote_worst, NULL, "worst case");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
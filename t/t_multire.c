@@ -0,0 +1,263 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/multire.h>
+
+#define T_NLINES	50000
+#define T_NMATCH	4
+
+/*
+ * Expressions which overlap in various ways: shared prefixes, literals
+ * which are substrings of other literals, the same literal anchored and
+ * floating, and some with no literals at all.
+ */
+static const char *t_res[] = {
+	"^abc ([a-z]+) def$",
+	"^abc ([a-z]+)",
+	"^ab(c|d) xyz ([a-z]+)$",
+	"bcd ([a-z]+) xy",
+	"^([a-z]+) abc$",
+	"abc",
+	"^x+y$",
+	"^[a-z]+ [a-z]+$",
+	"^de(f|g)+ ([a-z]*) c?bc?d$",
+};
+#define T_NRES (sizeof t_res / sizeof *t_res)
+
+/*
+ * Pieces we build lines from.
+ */
+static const char *t_pieces[] = {
+	"abc", "ab", "bc", "bcd", "def", "defg", "xyz", "xy", "x", "y", " ",
+	"a", "q", "zz",
+};
+#define T_NPIECES (sizeof t_pieces / sizeof *t_pieces)
+
+static regex_t t_re[T_NRES];
+
+static lj_multire *
+t_multire_create(void)
+{
+	lj_multire *mr;
+	unsigned int i;
+
+	if ((mr = lj_multire_create()) == NULL)
+		return (NULL);
+	for (i = 0; i < T_NRES; ++i) {
+		if (lj_multire_add(mr, t_res[i]) != (int)i) {
+			lj_multire_destroy(mr);
+			return (NULL);
+		}
+	}
+	if (lj_multire_compile(mr) != 0) {
+		lj_multire_destroy(mr);
+		return (NULL);
+	}
+	return (mr);
+}
+
+/*
+ * Match a line with lj_multire_match() and by trying each expression
+ * in turn, and compare the results.
+ */
+static int
+t_multire_compare(lj_multire *mr, const char *str)
+{
+	regmatch_t exp[T_NMATCH], got[T_NMATCH];
+	unsigned int i, ncand;
+	int iexp, igot;
+
+	for (iexp = 0; iexp < (int)T_NRES; ++iexp)
+		if (regexec(&t_re[iexp], str, T_NMATCH, exp, 0) == 0)
+			break;
+	if (iexp == (int)T_NRES)
+		iexp = -1;
+	igot = lj_multire_match(mr, str, strlen(str), T_NMATCH, got, &ncand);
+	if (iexp != igot) {
+		t_printv("[%s] expected %d, got %d\n", str, iexp, igot);
+		return (0);
+	}
+	if (igot >= 0 && ncand == 0) {
+		t_printv("[%s] matched without candidates\n", str);
+		return (0);
+	}
+	for (i = 0; igot >= 0 && i < T_NMATCH; ++i) {
+		if (exp[i].rm_so != got[i].rm_so ||
+		    exp[i].rm_eo != got[i].rm_eo) {
+			t_printv("[%s] subexpression %u differs\n", str, i);
+			return (0);
+		}
+	}
+	return (1);
+}
+
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+/*
+ * Expected match and number of candidates, which always includes the
+ * one expression with no usable literals.
+ */
+static struct t_case {
+	const char	*str;
+	int		 match;
+	unsigned int	 ncand;
+} t_cases[] = {
+	{ "abc foo def",	0,	4 },
+	{ "abc foo",		1,	3 },
+	{ "abd xyz foo",	2,	2 },
+	{ "foo abc",		4,	3 },
+	{ "xxy",		6,	2 },
+	{ "foo bar",		7,	1 },
+	{ "foo",		-1,	1 },
+	{ "",			-1,	1 },
+};
+
+static int
+t_multire_case(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_case *tc = arg;
+	regmatch_t pmatch[T_NMATCH];
+	unsigned int ncand;
+	lj_multire *mr;
+	int ret;
+
+	t_assert((mr = t_multire_create()) != NULL);
+	ret = t_compare_i(tc->match, lj_multire_match(mr, tc->str,
+	    strlen(tc->str), T_NMATCH, pmatch, &ncand));
+	ret &= t_compare_u(tc->ncand, ncand);
+	ret &= t_multire_compare(mr, tc->str);
+	lj_multire_destroy(mr);
+	return (ret);
+}
+
+/*
+ * Adding an expression after compiling is not allowed, and neither is
+ * adding one which doesn't compile, but the latter leaves the multire
+ * usable.
+ */
+static int
+t_multire_add(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	regmatch_t pmatch[T_NMATCH];
+	lj_multire *mr;
+	int ret;
+
+	t_assert((mr = lj_multire_create()) != NULL);
+	ret = t_compare_i(0, lj_multire_add(mr, "^foo (bar)$"));
+	ret &= t_compare_i(-1, lj_multire_add(mr, "^foo (bar$"));
+	ret &= t_compare_i(1, lj_multire_add(mr, "^foo (baz)$"));
+	ret &= t_compare_i(0, lj_multire_compile(mr));
+	ret &= t_compare_i(-1, lj_multire_add(mr, "^foo$"));
+	ret &= t_compare_i(1, lj_multire_match(mr, "foo baz", 7, T_NMATCH,
+	    pmatch, NULL));
+	ret &= t_compare_i(-1, lj_multire_match(mr, "foo (bar", 8, T_NMATCH,
+	    pmatch, NULL));
+	lj_multire_destroy(mr);
+	return (ret);
+}
+
+/*
+ * Generate lines from pieces which the expressions are made of, and
+ * check that we get the same results as trying each expression in turn.
+ */
+static int
+t_multire_random(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_multire *mr;
+	char str[256];
+	unsigned int i, n;
+	int ret;
+
+	t_assert((mr = t_multire_create()) != NULL);
+	srandom(1);
+	ret = 1;
+	for (i = 0; i < T_NLINES && ret; ++i) {
+		str[0] = '\0';
+		for (n = 1 + random() % 5; n > 0; --n)
+			strcat(str, t_pieces[random() % T_NPIECES]);
+		ret &= t_multire_compare(mr, str);
+	}
+	lj_multire_destroy(mr);
+	return (ret);
+}
+
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i;
+
+	(void)argc;
+	(void)argv;
+	for (i = 0; i < T_NRES; ++i)
+		if (regcomp(&t_re[i], t_res[i], REG_EXTENDED) != 0)
+			return (-1);
+	for (i = 0; i < sizeof t_cases / sizeof *t_cases; ++i)
+		t_add_test(t_multire_case, &t_cases[i], "case \"%s\"",
+		    t_cases[i].str);
+	t_add_test(t_multire_add, NULL, "add");
+	t_add_test(t_multire_random, NULL, "random");
+	return (0);
+}
+
+static void
+t_cleanup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < T_NRES; ++i)
+		regfree(&t_re[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, t_cleanup, argc, argv);
+}
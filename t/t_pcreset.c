@@ -0,0 +1,266 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/pcreset.h>
+
+/*
+ * The first pattern is more specific than the second, and is tried
+ * first.  The name table lists names in alphabetical order, not in the
+ * order in which they appear, so the names were chosen to differ.
+ */
+static const char *t_pats[] = {
+	"^(?<verb>GET|POST) (?<path>\\S+)( (?<proto>HTTP/[0-9.]+))?$",
+	"^(?<zverb>[A-Z]+) (?<apath>\\S+)",
+};
+#define T_NPATS (sizeof t_pats / sizeof t_pats[0])
+
+static lj_pcreset *t_ps;
+
+struct t_field {
+	const char *name;
+	const char *value;
+};
+
+struct t_case {
+	const char *desc;
+	const char *str;
+	int pat;			/* -1 if nothing should match */
+	struct t_field fields[4];
+};
+
+/***************************************************************************
+ * Test cases
+ */
+static struct t_case t_cases[] = {
+	{
+		.desc	= "first pattern, all fields",
+		.str	= "GET /index.html HTTP/1.1",
+		.pat	= 0,
+		.fields	= {
+			{ "verb", "GET" },
+			{ "path", "/index.html" },
+			{ "proto", "HTTP/1.1" },
+		},
+	},
+	{
+		.desc	= "first pattern, unset field",
+		.str	= "POST /form",
+		.pat	= 0,
+		.fields	= {
+			{ "verb", "POST" },
+			{ "path", "/form" },
+		},
+	},
+	{
+		.desc	= "second pattern",
+		.str	= "DELETE /thing HTTP/1.1",
+		.pat	= 1,
+		.fields	= {
+			{ "zverb", "DELETE" },
+			{ "apath", "/thing" },
+		},
+	},
+	{
+		.desc	= "second pattern, trailing garbage",
+		.str	= "GET /index.html HTTP/1.1 extra",
+		.pat	= 1,
+		.fields	= {
+			{ "zverb", "GET" },
+			{ "apath", "/index.html" },
+		},
+	},
+	{
+		.desc	= "no match",
+		.str	= "get /index.html",
+		.pat	= -1,
+	},
+	{
+		.desc	= "empty",
+		.str	= "",
+		.pat	= -1,
+	},
+};
+
+/*
+ * Patterns which must be rejected.
+ */
+static struct t_bad {
+	const char *desc;
+	const char *src;
+} t_bad[] = {
+	{ "no named subexpressions",	"^(x)(y)$" },
+	{ "reserved name",		"^(?<timestamp>.*)$" },
+	{ "syntax error",		"^(?<x>.*$" },
+};
+
+/*
+ * Check that a match produced exactly the expected fields, in any order.
+ */
+static int
+t_check_fields(const char *str, const struct t_field *expect,
+    const lj_pcreset_field *fields, unsigned int nfields)
+{
+	unsigned int i, n;
+	int ret;
+
+	ret = 1;
+	for (n = 0; expect[n].name != NULL; ++n) {
+		for (i = 0; i < nfields; ++i)
+			if (strcmp(fields[i].name, expect[n].name) == 0)
+				break;
+		if (i == nfields) {
+			t_printv("missing field %s\n", expect[n].name);
+			ret = 0;
+			continue;
+		}
+		ret &= t_compare_sz(strlen(expect[n].value), fields[i].len);
+		ret &= t_compare_strn(expect[n].value, str + fields[i].off,
+		    strlen(expect[n].value));
+	}
+	return (ret & t_compare_u(n, nfields));
+}
+
+/***************************************************************************
+ * Test functions
+ */
+static int
+t_pcreset_match(char **desc CRYB_UNUSED, void *arg)
+{
+	const struct t_case *t = arg;
+	lj_pcreset_field fields[LJ_PCRESET_MAX_FIELDS];
+	unsigned int nfields;
+	int m;
+
+	m = lj_pcreset_match(t_ps, t->str, strlen(t->str), fields, &nfields);
+	if (!t_compare_i(t->pat, m))
+		return (0);
+	if (m < 0)
+		return (1);
+	return (t_check_fields(t->str, t->fields, fields, nfields));
+}
+
+/*
+ * Group numbers are stored in two bytes in the name table.
+ */
+static int
+t_pcreset_high_group(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static const struct t_field expect[] = {
+		{ "early", "x" },
+		{ "late", "zzz" },
+		{ NULL, NULL },
+	};
+	lj_pcreset_field fields[LJ_PCRESET_MAX_FIELDS];
+	char src[2048], *p;
+	unsigned int i, nfields;
+	lj_pcreset *ps;
+	int ret;
+
+	p = src + sprintf(src, "^(?<early>x)");
+	for (i = 0; i < 300; ++i)
+		p += sprintf(p, "(y)?");
+	sprintf(p, "(?<late>z+)$");
+	if ((ps = lj_pcreset_create()) == NULL)
+		return (0);
+	ret = t_compare_i(0, lj_pcreset_add(ps, src));
+	if (ret)
+		ret = t_compare_i(0, lj_pcreset_match(ps, "xzzz", 4, fields,
+		    &nfields)) &&
+		    t_check_fields("xzzz", expect, fields, nfields);
+	lj_pcreset_destroy(ps);
+	return (ret);
+}
+
+static int
+t_pcreset_reject(char **desc CRYB_UNUSED, void *arg)
+{
+	const struct t_bad *t = arg;
+	lj_pcreset *ps;
+	int ret;
+
+	if ((ps = lj_pcreset_create()) == NULL)
+		return (0);
+	ret = t_compare_i(-1, lj_pcreset_add(ps, t->src));
+	ret &= t_compare_u(0, lj_pcreset_count(ps));
+	lj_pcreset_destroy(ps);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i, n;
+
+	(void)argc;
+	(void)argv;
+	if ((t_ps = lj_pcreset_create()) == NULL)
+		return (-1);
+	for (i = 0; i < T_NPATS; ++i)
+		if (lj_pcreset_add(t_ps, t_pats[i]) != (int)i)
+			return (-1);
+	n = sizeof t_cases / sizeof t_cases[0];
+	for (i = 0; i < n; ++i)
+		t_add_test(t_pcreset_match, &t_cases[i], "%s",
+		    t_cases[i].desc);
+	t_add_test(t_pcreset_high_group, NULL, "group number above 255");
+	n = sizeof t_bad / sizeof t_bad[0];
+	for (i = 0; i < n; ++i)
+		t_add_test(t_pcreset_reject, &t_bad[i], "reject: %s",
+		    t_bad[i].desc);
+	return (0);
+}
+
+static void
+t_cleanup(void)
+{
+
+	lj_pcreset_destroy(t_ps);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, t_cleanup, argc, argv);
+}
@@ -0,0 +1,167 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cryb/test.h>
+
+#include <logjam/pool.h>
+
+struct t_obj {
+	lj_pool_obj	 po;
+	int		*fini;
+	char		 data[100];
+};
+
+static void
+t_obj_fini(void *p)
+{
+	struct t_obj *obj = p;
+
+	if (obj->fini != NULL)
+		(*obj->fini)++;
+}
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+/*
+ * Returned objects are handed out again, with whatever state they were
+ * returned with, and the counters reflect it.
+ */
+static int
+t_pool_reuse(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_pool *pool;
+	struct t_obj *a, *b, *c;
+	size_t nget, nalloc, nput;
+	int nfini, ret;
+
+	nfini = 0;
+	t_assert((pool = lj_pool_create(sizeof *a, 0, t_obj_fini)) != NULL);
+	t_assert((a = lj_pool_get(pool)) != NULL);
+	t_assert((b = lj_pool_get(pool)) != NULL);
+	ret = t_compare_ptr(NULL, a->fini);
+	a->fini = &nfini;
+	lj_pool_put(a);
+	t_assert((c = lj_pool_get(pool)) != NULL);
+	ret &= t_compare_ptr(a, c);
+	ret &= t_compare_ptr(&nfini, c->fini);
+	b->fini = &nfini;
+	lj_pool_put(b);
+	lj_pool_put(c);
+	lj_pool_stat(pool, &nget, &nalloc, &nput, 1);
+	ret &= t_compare_sz(3, nget);
+	ret &= t_compare_sz(2, nalloc);
+	ret &= t_compare_sz(3, nput);
+	lj_pool_stat(pool, &nget, &nalloc, &nput, 0);
+	ret &= t_compare_sz(0, nget);
+	lj_pool_destroy(pool);
+	ret &= t_compare_i(2, nfini);
+	return (ret);
+}
+
+/*
+ * Objects are aligned as requested.
+ */
+static int
+t_pool_align(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_pool *pool;
+	void *p[4];
+	unsigned int i;
+	int ret;
+
+	t_assert((pool = lj_pool_create(4096, 4096, NULL)) != NULL);
+	ret = 1;
+	for (i = 0; i < 4; ++i) {
+		t_assert((p[i] = lj_pool_get(pool)) != NULL);
+		ret &= t_compare_ul(0, (uintptr_t)p[i] % 4096);
+	}
+	for (i = 0; i < 4; ++i)
+		lj_pool_put(p[i]);
+	lj_pool_destroy(pool);
+	return (ret);
+}
+
+/*
+ * Objects which are still out when the pool is destroyed are freed when
+ * they are returned, and objects which never belonged to a pool are
+ * simply freed.
+ */
+static int
+t_pool_outlive(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_pool *pool;
+	struct t_obj *a, *b;
+	int nfini, ret;
+
+	nfini = 0;
+	t_assert((pool = lj_pool_create(sizeof *a, 0, t_obj_fini)) != NULL);
+	t_assert((a = lj_pool_get(pool)) != NULL);
+	a->fini = &nfini;
+	lj_pool_destroy(pool);
+	ret = t_compare_i(0, nfini);
+	lj_pool_put(a);
+	ret &= t_compare_i(1, nfini);
+	t_assert((b = calloc(1, sizeof *b)) != NULL);
+	lj_pool_put(b);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+
+	(void)argc;
+	(void)argv;
+	t_add_test(t_pool_reuse, NULL, "reuse");
+	t_add_test(t_pool_align, NULL, "alignment");
+	t_add_test(t_pool_outlive, NULL, "outlive pool");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
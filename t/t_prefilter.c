@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/bindscan.h>
+#include <logjam/prefilter.h>
+#include <logjam/strlcat.h>
+#include <logjam/strlcpy.h>
+
+#define T_NLINES	20000
+
+struct t_case {
+	const char	*re;
+	const char	*prefix;	/* expected prefix, if any */
+	const char	*lits;		/* expected literals, separated by | */
+	const char	*line;		/* a line which matches */
+};
+
+static struct t_case t_cases[] = {
+	{ "^Failed ([a-z-]+) for (invalid user |)([0-9a-z-]+) from "
+	  "([0-9A-Fa-f:.]+) port ([0-9]+) ssh([0-9.]+)$",
+	  "Failed ", " from | port | for | ssh",
+	  "Failed password for invalid user admin from 192.0.2.1 port 22 "
+	  "ssh2" },
+	{ lj_bind_re,
+	  "queries:", ": query: | client | (",
+	  "queries: info: client 192.0.2.1#53 (example.com): query: "
+	  "example.com IN A +E (192.0.2.53)" },
+	{ "foo|bar",		NULL,	"",		"bar" },
+	{ "^a*bc",		NULL,	"bc",		"bc" },
+	{ "^ab?cd",		"a",	"cd",		"acd" },
+	{ "x[]a]yz",		NULL,	"yz",		"x]yz" },
+	{ "[[:alpha:]]+abc",	NULL,	"abc",		"zabc" },
+	{ "\\.com$",		NULL,	".com",		"example.com" },
+	{ "^(a|b)cd",		NULL,	"cd",		"bcd" },
+	{ "ab{2,3}cd",		NULL,	"cd",		"abbcd" },
+	{ "^ab+cd",		"ab",	"cd",		"abbbcd" },
+	{ "^\\(x\\) (y|z)",	"(x) ",	"",		"(x) z" },
+};
+
+/*
+ * Characters we sprinkle over lines.
+ */
+static const char t_noise[] = "abcdxyz .:#()";
+
+/*
+ * Describe the literals in a prefilter the same way t_cases does.
+ */
+static void
+t_prefilter_lits(const lj_prefilter *pf, char *buf, size_t size)
+{
+	const char *lit;
+	unsigned int i;
+
+	buf[0] = '\0';
+	for (i = 0; (lit = lj_prefilter_literal(pf, i)) != NULL; ++i) {
+		if (i > 0)
+			strlcat(buf, "|", size);
+		strlcat(buf, lit, size);
+	}
+}
+
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static int
+t_prefilter_compile(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_case *tc = arg;
+	lj_prefilter *pf;
+	char lits[256];
+	int ret;
+
+	t_assert((pf = lj_prefilter_compile(tc->re)) != NULL);
+	t_prefilter_lits(pf, lits, sizeof lits);
+	ret = (tc->prefix == NULL ?
+	    t_compare_ptr(NULL, lj_prefilter_prefix(pf)) :
+	    t_compare_str(tc->prefix, lj_prefilter_prefix(pf))) &
+	    t_compare_str(tc->lits, lits) &
+	    t_compare_i(0, lj_prefilter_match(pf, tc->line,
+	    strlen(tc->line)));
+	lj_prefilter_destroy(pf);
+	return (ret);
+}
+
+/*
+ * Mangle a line which matches in various ways, and check that the
+ * prefilter never rejects a line which the expression matches.
+ */
+static int
+t_prefilter_random(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_case *tc = arg;
+	unsigned int i, n, nre;
+	lj_prefilter *pf;
+	char str[256];
+	size_t len;
+	regex_t re;
+	int ret;
+
+	t_assert(regcomp(&re, tc->re, REG_EXTENDED | REG_NOSUB) == 0);
+	t_assert((pf = lj_prefilter_compile(tc->re)) != NULL);
+	srandom(1);
+	ret = 1;
+	nre = 0;
+	for (i = 0; i < T_NLINES && ret; ++i) {
+		len = strlcpy(str, tc->line, sizeof str);
+		for (n = random() % 3; n > 0; --n)
+			str[random() % len] =
+			    t_noise[random() % (sizeof t_noise - 1)];
+		if (regexec(&re, str, 0, NULL, 0) == 0) {
+			nre++;
+			if (lj_prefilter_match(pf, str, len) != 0) {
+				t_printv("[%s] rejected\n", str);
+				ret = 0;
+			}
+		}
+	}
+	/* make sure we didn't mangle every single line */
+	ret &= t_compare_i(1, nre > 0);
+	lj_prefilter_destroy(pf);
+	regfree(&re);
+	return (ret);
+}
+
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i;
+
+	(void)argc;
+	(void)argv;
+	for (i = 0; i < sizeof t_cases / sizeof *t_cases; ++i)
+		t_add_test(t_prefilter_compile, &t_cases[i], "compile %s",
+		    t_cases[i].re);
+	for (i = 0; i < sizeof t_cases / sizeof *t_cases; ++i)
+		t_add_test(t_prefilter_random, &t_cases[i], "random %s",
+		    t_cases[i].re);
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
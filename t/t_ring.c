@@ -0,0 +1,149 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cryb/test.h>
+
+#include <logjam/ring.h>
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static int
+t_ring_size(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_ring ring;
+	size_t pgsz;
+	int ret;
+
+	pgsz = sysconf(_SC_PAGESIZE);
+	if (!t_compare_i(0, lj_ring_init(&ring, pgsz + 1)))
+		return (0);
+	ret = t_compare_sz(pgsz * 2, ring.size);
+	lj_ring_fini(&ring);
+	return (ret);
+}
+
+static int
+t_ring_zero(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	lj_ring ring;
+	int ret;
+
+	ret = t_compare_i(-1, lj_ring_init(&ring, 0));
+	ret &= t_compare_i(EINVAL, errno);
+	return (ret);
+}
+
+/*
+ * Write across the end of the ring and check that what we wrote shows
+ * up at the start as well.
+ */
+static int
+t_ring_mirror(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static const char str[] = "Squeamish ossifrage";
+	lj_ring ring;
+	int ret;
+
+	if (!t_compare_i(0, lj_ring_init(&ring, 1)))
+		return (0);
+	memcpy(ring.base + ring.size - 9, str, sizeof str);
+	ret = t_compare_mem(str + 9, ring.base, sizeof str - 9);
+	ret &= t_compare_mem(str, lj_ring_ptr(&ring, ring.size * 5 - 9),
+	    sizeof str);
+	lj_ring_fini(&ring);
+	return (ret);
+}
+
+/*
+ * Stream records of an awkward size through the ring many times over,
+ * checking each one as it comes out.
+ */
+static int
+t_ring_stream(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	char buf[1000];
+	uint64_t rd, wr;
+	unsigned int i, j;
+	lj_ring ring;
+	int ret;
+
+	if (!t_compare_i(0, lj_ring_init(&ring, 1)))
+		return (0);
+	ret = 1;
+	for (i = rd = wr = 0; i < 1000; ++i) {
+		/* keep up to three records in the ring */
+		for (j = 0; j < 3 && wr - rd + sizeof buf <= ring.size; ++j) {
+			memset(lj_ring_ptr(&ring, wr),
+			    'a' + (wr / sizeof buf) % 26, sizeof buf);
+			wr += sizeof buf;
+		}
+		memset(buf, 'a' + (rd / sizeof buf) % 26, sizeof buf);
+		ret &= t_compare_mem(buf, lj_ring_ptr(&ring, rd), sizeof buf);
+		rd += sizeof buf;
+	}
+	lj_ring_fini(&ring);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+
+	(void)argc;
+	(void)argv;
+	t_add_test(t_ring_size, NULL, "size rounded up to page size");
+	t_add_test(t_ring_zero, NULL, "zero size");
+	t_add_test(t_ring_mirror, NULL, "mirror");
+	t_add_test(t_ring_stream, NULL, "stream");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
@@ -0,0 +1,351 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cryb/test.h>
+
+#include <logjam/spool.h>
+
+#define T_SEGSIZE	4096
+#define T_RECSIZE	100
+
+static char t_dir[] = "/tmp/t_spool.XXXXXX";
+
+/*
+ * Remove all segments from the test directory.
+ */
+static void
+t_spool_clean(void)
+{
+	char fn[PATH_MAX];
+	struct dirent *ent;
+	DIR *dir;
+
+	if ((dir = opendir(t_dir)) == NULL)
+		return;
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		snprintf(fn, sizeof fn, "%s/%s", t_dir, ent->d_name);
+		unlink(fn);
+	}
+	closedir(dir);
+}
+
+/*
+ * Fill a buffer with a record that can be identified by its number.
+ */
+static void
+t_spool_rec(char *buf, size_t len, unsigned int n)
+{
+
+	memset(buf, 'a' + n % 26, len);
+	snprintf(buf, len, "%08u", n);
+}
+
+/*
+ * Append records numbered from first up to but not including last.
+ */
+static int
+t_spool_fill(spool *sp, unsigned int first, unsigned int last)
+{
+	char buf[T_RECSIZE];
+	unsigned int i;
+
+	for (i = first; i < last; ++i) {
+		t_spool_rec(buf, sizeof buf, i);
+		if (spool_append(sp, buf, sizeof buf) != 0)
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * Read and consume records numbered from first up to but not including
+ * last, and check that they are what we expect.
+ */
+static int
+t_spool_drain(spool *sp, unsigned int first, unsigned int last)
+{
+	char buf[T_RECSIZE];
+	const void *rec;
+	unsigned int i;
+	int ret;
+
+	ret = 1;
+	for (i = first; i < last; ++i) {
+		t_spool_rec(buf, sizeof buf, i);
+		if (spool_peek(sp, &rec) != (ssize_t)sizeof buf)
+			return (0);
+		ret &= t_compare_mem(buf, rec, sizeof buf);
+		spool_consume(sp);
+	}
+	return (ret);
+}
+/*
+ * Read ahead through records numbered from first up to but not including
+ * last without consuming them, and check that they are what we expect.
+ */
+static int
+t_spool_read_ahead(spool *sp, unsigned int first, unsigned int last)
+{
+	char buf[T_RECSIZE];
+	const void *rec;
+	unsigned int i;
+	int ret;
+
+	ret = 1;
+	for (i = first; i < last; ++i) {
+		t_spool_rec(buf, sizeof buf, i);
+		if (spool_peek_next(sp, &rec) != (ssize_t)sizeof buf)
+			return (0);
+		ret &= t_compare_mem(buf, rec, sizeof buf);
+	}
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static int
+t_spool_simple(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static const char *words[] = { "alpha", "beta", "gamma" };
+	const void *rec;
+	spool *sp;
+	int i, ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 16 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_compare_ssz(0, spool_peek(sp, &rec));
+	for (i = 0; i < 3; ++i)
+		ret &= t_compare_i(0, spool_append(sp, words[i],
+		    strlen(words[i])));
+	ret &= t_compare_sz(3, spool_len(sp));
+	for (i = 0; i < 3; ++i) {
+		ret &= t_compare_ssz(strlen(words[i]), spool_peek(sp, &rec));
+		ret &= t_compare_mem(words[i], rec, strlen(words[i]));
+		spool_consume(sp);
+	}
+	ret &= t_compare_ssz(0, spool_peek(sp, &rec));
+	ret &= t_compare_sz(0, spool_len(sp));
+	spool_close(sp);
+	return (ret);
+}
+
+static int
+t_spool_segments(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	const void *rec;
+	spool *sp;
+	int ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 1024 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_spool_fill(sp, 0, 1000);
+	ret &= t_compare_sz(1000, spool_len(sp));
+	ret &= t_compare_i(1, spool_size(sp) > 20 * T_SEGSIZE);
+	ret &= t_spool_drain(sp, 0, 500);
+	ret &= t_spool_fill(sp, 1000, 1500);
+	ret &= t_spool_drain(sp, 500, 1500);
+	ret &= t_compare_ssz(0, spool_peek(sp, &rec));
+	ret &= t_compare_sz(T_SEGSIZE, spool_size(sp));
+	spool_close(sp);
+	return (ret);
+}
+
+static int
+t_spool_full(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	char buf[T_RECSIZE];
+	spool *sp;
+	int ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 4 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	memset(buf, 'x', sizeof buf);
+	while (spool_append(sp, buf, sizeof buf) == 0)
+		/* nothing */ ;
+	ret &= t_compare_i(ENOSPC, errno);
+	ret &= t_compare_sz(4 * T_SEGSIZE, spool_size(sp));
+	ret &= t_compare_i(1, spool_len(sp) > 100);
+	spool_close(sp);
+	return (ret);
+}
+
+static int
+t_spool_too_large(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static char buf[T_SEGSIZE];
+	spool *sp;
+	int ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 4 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_compare_i(-1, spool_append(sp, buf, sizeof buf));
+	ret &= t_compare_i(EMSGSIZE, errno);
+	ret &= t_compare_i(-1, spool_append(sp, buf, 0));
+	ret &= t_compare_sz(0, spool_len(sp));
+	spool_close(sp);
+	return (ret);
+}
+
+static int
+t_spool_reopen(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	const void *rec;
+	spool *sp;
+	int ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 1024 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_spool_fill(sp, 0, 100);
+	ret &= t_spool_drain(sp, 0, 30);
+	spool_close(sp);
+	sp = spool_open(t_dir, T_SEGSIZE, 1024 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_compare_sz(70, spool_len(sp));
+	ret &= t_spool_fill(sp, 100, 150);
+	ret &= t_spool_drain(sp, 30, 150);
+	ret &= t_compare_ssz(0, spool_peek(sp, &rec));
+	spool_close(sp);
+	return (ret);
+}
+static int
+t_spool_commit(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	const void *rec;
+	spool *sp;
+	int ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 1024 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_spool_fill(sp, 0, 100);
+	ret &= t_spool_read_ahead(sp, 0, 60);
+	ret &= t_compare_sz(100, spool_len(sp));
+	spool_commit(sp, 40);
+	ret &= t_compare_sz(60, spool_len(sp));
+	ret &= t_spool_read_ahead(sp, 60, 100);
+	ret &= t_compare_ssz(0, spool_peek_next(sp, &rec));
+	spool_rewind(sp);
+	ret &= t_spool_read_ahead(sp, 40, 100);
+	spool_commit(sp, 60);
+	ret &= t_compare_sz(0, spool_len(sp));
+	ret &= t_compare_ssz(0, spool_peek(sp, &rec));
+	ret &= t_compare_sz(T_SEGSIZE, spool_size(sp));
+	spool_close(sp);
+	return (ret);
+}
+
+static int
+t_spool_commit_reopen(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	const void *rec;
+	spool *sp;
+	int ret;
+
+	ret = 1;
+	t_spool_clean();
+	sp = spool_open(t_dir, T_SEGSIZE, 1024 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_spool_fill(sp, 0, 100);
+	ret &= t_spool_read_ahead(sp, 0, 80);
+	spool_commit(sp, 20);
+	spool_close(sp);
+	sp = spool_open(t_dir, T_SEGSIZE, 1024 * T_SEGSIZE);
+	t_assert(sp != NULL);
+	ret &= t_compare_sz(80, spool_len(sp));
+	ret &= t_spool_drain(sp, 20, 100);
+	ret &= t_compare_ssz(0, spool_peek(sp, &rec));
+	spool_close(sp);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc CRYB_UNUSED, char *argv[] CRYB_UNUSED)
+{
+
+	if (mkdtemp(t_dir) == NULL)
+		return (-1);
+	t_add_test(t_spool_simple, NULL, "simple append and consume");
+	t_add_test(t_spool_segments, NULL, "multiple segments");
+	t_add_test(t_spool_full, NULL, "fill to capacity");
+	t_add_test(t_spool_too_large, NULL, "oversized record");
+	t_add_test(t_spool_reopen, NULL, "reopen");
+	t_add_test(t_spool_commit, NULL, "read ahead and commit");
+	t_add_test(t_spool_commit_reopen, NULL, "reopen after partial commit");
+	return (0);
+}
+
+static void
+t_cleanup(void)
+{
+
+	t_spool_clean();
+	rmdir(t_dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, t_cleanup, argc, argv);
+}
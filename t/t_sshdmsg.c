@@ -0,0 +1,339 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <regex.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cryb/test.h>
+
+#include <logjam/multire.h>
+#include <logjam/sshdmsg.h>
+
+static lj_multire *t_mr;
+
+struct t_field {
+	const char *key;
+	const char *value;
+};
+
+struct t_case {
+	const char *line;
+	const char *event;		/* NULL if it shouldn't match */
+	struct t_field fields[LJ_SSHD_NMATCH];
+};
+
+/***************************************************************************
+ * Test cases
+ *
+ * The expected fields are listed in the order in which they appear in
+ * the message.
+ */
+static struct t_case t_cases[] = {
+	{
+		"Failed password for root from 192.0.2.1 port 52022 ssh2",
+		"failed", {
+			{ "method", "password" },
+			{ "login", "root" },
+			{ "client_addr", "192.0.2.1" },
+			{ "client_port", "52022" },
+			{ "protocol", "2" },
+		},
+	},
+	{
+		"Failed password for invalid user admin from 2001:db8::1 "
+		"port 4711 ssh2",
+		"failed", {
+			{ "method", "password" },
+			{ "login", "admin" },
+			{ "client_addr", "2001:db8::1" },
+			{ "client_port", "4711" },
+			{ "protocol", "2" },
+		},
+	},
+	{
+		"Accepted publickey for alice from 192.0.2.2 port 40000 ssh2: "
+		"RSA SHA256:AAAAB3NzaC1yc2E",
+		"accepted", {
+			{ "method", "publickey" },
+			{ "login", "alice" },
+			{ "client_addr", "192.0.2.2" },
+			{ "client_port", "40000" },
+			{ "protocol", "2" },
+		},
+	},
+	{
+		"Invalid user guest from 198.51.100.3 port 33333",
+		"invalid_user", {
+			{ "login", "guest" },
+			{ "client_addr", "198.51.100.3" },
+			{ "client_port", "33333" },
+		},
+	},
+	{
+		"Invalid user  from 198.51.100.3",
+		"invalid_user", {
+			{ "login", "" },
+			{ "client_addr", "198.51.100.3" },
+		},
+	},
+	{
+		"error: maximum authentication attempts exceeded for root "
+		"from 203.0.113.4 port 2222 ssh2 [preauth]",
+		"max_auth_tries", {
+			{ "login", "root" },
+			{ "client_addr", "203.0.113.4" },
+			{ "client_port", "2222" },
+			{ "protocol", "2" },
+		},
+	},
+	{
+		"Disconnected from authenticating user root 192.0.2.5 "
+		"port 5555 [preauth]",
+		"disconnected", {
+			{ "login", "root" },
+			{ "client_addr", "192.0.2.5" },
+			{ "client_port", "5555" },
+		},
+	},
+	{
+		"Disconnected from 192.0.2.5 port 5555",
+		"disconnected", {
+			{ "client_addr", "192.0.2.5" },
+			{ "client_port", "5555" },
+		},
+	},
+	{
+		"Received disconnect from 192.0.2.6 port 6666:11: Bye Bye "
+		"[preauth]",
+		"received_disconnect", {
+			{ "client_addr", "192.0.2.6" },
+			{ "client_port", "6666" },
+			{ "code", "11" },
+			{ "reason", "Bye Bye" },
+		},
+	},
+	{
+		"Received disconnect from 192.0.2.6 port 6666:11: "
+		"disconnected by user",
+		"received_disconnect", {
+			{ "client_addr", "192.0.2.6" },
+			{ "client_port", "6666" },
+			{ "code", "11" },
+			{ "reason", "disconnected by user" },
+		},
+	},
+	{
+		"Connection closed by invalid user test 192.0.2.7 port 7777 "
+		"[preauth]",
+		"connection_closed", {
+			{ "login", "test" },
+			{ "client_addr", "192.0.2.7" },
+			{ "client_port", "7777" },
+		},
+	},
+	{
+		"Connection reset by 192.0.2.8 port 8888 [preauth]",
+		"connection_reset", {
+			{ "client_addr", "192.0.2.8" },
+			{ "client_port", "8888" },
+		},
+	},
+	{
+		"Connection from 192.0.2.9 port 9999 on 10.0.0.1 port 22 "
+		"rdomain \"\"",
+		"connection", {
+			{ "client_addr", "192.0.2.9" },
+			{ "client_port", "9999" },
+			{ "server_addr", "10.0.0.1" },
+			{ "server_port", "22" },
+		},
+	},
+	{
+		"Did not receive identification string from 192.0.2.10 "
+		"port 10101",
+		"no_identification", {
+			{ "client_addr", "192.0.2.10" },
+			{ "client_port", "10101" },
+		},
+	},
+	{
+		"Timeout before authentication for 192.0.2.11 port 11111",
+		"timeout", {
+			{ "client_addr", "192.0.2.11" },
+			{ "client_port", "11111" },
+		},
+	},
+	{
+		"Unable to negotiate with 192.0.2.12 port 12121: no matching "
+		"key exchange method found. Their offer: "
+		"diffie-hellman-group1-sha1 [preauth]",
+		"negotiation_failed", {
+			{ "client_addr", "192.0.2.12" },
+			{ "client_port", "12121" },
+			{ "reason", "no matching key exchange method found. "
+			  "Their offer: diffie-hellman-group1-sha1" },
+		},
+	},
+	{
+		"banner exchange: Connection from 192.0.2.13 port 13131: "
+		"invalid format",
+		"bad_banner", {
+			{ "client_addr", "192.0.2.13" },
+			{ "client_port", "13131" },
+			{ "reason", "invalid format" },
+		},
+	},
+	{
+		"User bob from 192.0.2.14 not allowed because not listed in "
+		"AllowUsers",
+		"not_allowed", {
+			{ "login", "bob" },
+			{ "client_addr", "192.0.2.14" },
+			{ "reason", "not listed in AllowUsers" },
+		},
+	},
+	{
+		"pam_unix(sshd:session): session opened for user "
+		"alice(uid=1000) by (uid=0)",
+		"session_opened", {
+			{ "login", "alice" },
+		},
+	},
+	{
+		"pam_unix(sshd:session): session closed for user alice",
+		"session_closed", {
+			{ "login", "alice" },
+		},
+	},
+	{
+		"pam_unix(sshd:auth): authentication failure; logname= uid=0 "
+		"euid=0 tty=ssh ruser= rhost=192.0.2.17  user=root",
+		"auth_failure", {
+			{ "client_addr", "192.0.2.17" },
+			{ "login", "root" },
+		},
+	},
+	{
+		"PAM 2 more authentication failures; logname= uid=0 euid=0 "
+		"tty=ssh ruser= rhost=192.0.2.18  user=root",
+		"auth_failures", {
+			{ "count", "2" },
+			{ "client_addr", "192.0.2.18" },
+			{ "login", "root" },
+		},
+	},
+	{
+		"Server listening on 0.0.0.0 port 22.",
+		NULL, { },
+	},
+};
+
+/***************************************************************************
+ * Test function
+ */
+static int
+t_sshdmsg(char **desc CRYB_UNUSED, void *arg)
+{
+	const struct t_case *t = arg;
+	const struct t_field *tf;
+	regmatch_t pmatch[LJ_SSHD_NMATCH];
+	const lj_sshd_msg *msg;
+	unsigned int i, ncand;
+	int ret;
+
+	msg = lj_sshd_match(t_mr, t->line, strlen(t->line), pmatch, &ncand);
+	if (t->event == NULL)
+		return (t_is_null(msg));
+	if (msg == NULL) {
+		t_printv("no match\n");
+		return (0);
+	}
+	if (!t_compare_str(t->event, msg->event))
+		return (0);
+	ret = 1;
+	for (i = 1, tf = t->fields; i < LJ_SSHD_NMATCH; ++i) {
+		if (msg->fields[i] == NULL || pmatch[i].rm_so < 0)
+			continue;
+		if (tf->key == NULL) {
+			t_printv("unexpected field %s\n", msg->fields[i]);
+			return (0);
+		}
+		ret &= t_compare_str(tf->key, msg->fields[i]);
+		ret &= t_compare_sz(strlen(tf->value),
+		    pmatch[i].rm_eo - pmatch[i].rm_so);
+		ret &= t_compare_strn(tf->value, t->line + pmatch[i].rm_so,
+		    strlen(tf->value));
+		tf++;
+	}
+	if (tf->key != NULL) {
+		t_printv("missing field %s\n", tf->key);
+		return (0);
+	}
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	int i, n;
+
+	(void)argc;
+	(void)argv;
+	if ((t_mr = lj_sshd_compile()) == NULL)
+		return (-1);
+	n = sizeof t_cases / sizeof t_cases[0];
+	for (i = 0; i < n; ++i)
+		t_add_test(t_sshdmsg, &t_cases[i], "%s",
+		    t_cases[i].event ? t_cases[i].event : "no match");
+	return (0);
+}
+
+static void
+t_cleanup(void)
+{
+
+	lj_multire_destroy(t_mr);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, t_cleanup, argc, argv);
+}
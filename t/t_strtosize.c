@@ -0,0 +1,228 @@
+/*-
+ * Copyright (c) 2014-2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <logjam/strtosize.h>
+
+#include <cryb/test.h>
+
+struct t_case {
+	const char *desc;
+	const char *in;
+	int ret;
+	size_t size;
+};
+
+/***************************************************************************
+ * Test cases
+ */
+static struct t_case t_cases[] = {
+	{
+		.desc	= "zero",
+		.in	= "0",
+		.ret	= 0,
+		.size	= 0,
+	},
+	{
+		.desc	= "plain",
+		.in	= "12345",
+		.ret	= 0,
+		.size	= 12345,
+	},
+	{
+		.desc	= "kilo",
+		.in	= "4k",
+		.ret	= 0,
+		.size	= 4 * 1024,
+	},
+	{
+		.desc	= "kilo (upper case)",
+		.in	= "4K",
+		.ret	= 0,
+		.size	= 4 * 1024,
+	},
+	{
+		.desc	= "mega",
+		.in	= "16M",
+		.ret	= 0,
+		.size	= 16 * 1024 * 1024,
+	},
+	{
+		.desc	= "giga",
+		.in	= "2g",
+		.ret	= 0,
+		.size	= (size_t)2 * 1024 * 1024 * 1024,
+	},
+	{
+		.desc	= "empty",
+		.in	= "",
+		.ret	= -1,
+	},
+	{
+		.desc	= "no number",
+		.in	= "k",
+		.ret	= -1,
+	},
+	{
+		.desc	= "unknown suffix",
+		.in	= "16T",
+		.ret	= -1,
+	},
+	{
+		.desc	= "trailing garbage",
+		.in	= "16kB",
+		.ret	= -1,
+	},
+	{
+		.desc	= "leading whitespace",
+		.in	= " 16",
+		.ret	= -1,
+	},
+	{
+		.desc	= "trailing whitespace",
+		.in	= "16 ",
+		.ret	= -1,
+	},
+	{
+		.desc	= "plus sign",
+		.in	= "+16",
+		.ret	= -1,
+	},
+	{
+		.desc	= "minus sign",
+		.in	= "-1",
+		.ret	= -1,
+	},
+#if SIZE_MAX == UINT64_MAX
+	{
+		.desc	= "maximum",
+		.in	= "18446744073709551615",
+		.ret	= 0,
+		.size	= SIZE_MAX,
+	},
+	{
+		.desc	= "out of range",
+		.in	= "18446744073709551616",
+		.ret	= -1,
+	},
+	{
+		.desc	= "maximum (giga)",
+		.in	= "17179869183G",
+		.ret	= 0,
+		.size	= (size_t)17179869183 * 1024 * 1024 * 1024,
+	},
+	{
+		.desc	= "overflow (giga)",
+		.in	= "17179869184G",
+		.ret	= -1,
+	},
+	{
+		.desc	= "overflow (kilo)",
+		.in	= "18014398509481984k",
+		.ret	= -1,
+	},
+#elif SIZE_MAX == UINT32_MAX
+	{
+		.desc	= "maximum",
+		.in	= "4294967295",
+		.ret	= 0,
+		.size	= SIZE_MAX,
+	},
+	{
+		.desc	= "out of range",
+		.in	= "4294967296",
+		.ret	= -1,
+	},
+	{
+		.desc	= "maximum (giga)",
+		.in	= "3G",
+		.ret	= 0,
+		.size	= (size_t)3 * 1024 * 1024 * 1024,
+	},
+	{
+		.desc	= "overflow (giga)",
+		.in	= "4G",
+		.ret	= -1,
+	},
+	{
+		.desc	= "overflow (kilo)",
+		.in	= "4194304k",
+		.ret	= -1,
+	},
+#endif
+};
+
+/***************************************************************************
+ * Test function
+ */
+static int
+t_strtosize(char **desc CRYB_UNUSED, void *arg)
+{
+	const struct t_case *t = arg;
+	size_t size;
+	int ret;
+
+	size = 42;
+	ret = lj_strtosize(t->in, &size);
+	if (!t_compare_i(t->ret, ret))
+		return (0);
+	/* on failure, the result must be left alone */
+	return (t_compare_sz(t->ret == 0 ? t->size : 42, size));
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	int i, n;
+
+	(void)argc;
+	(void)argv;
+	n = sizeof t_cases / sizeof t_cases[0];
+	for (i = 0; i < n; ++i)
+		t_add_test(t_strtosize, &t_cases[i], "%s", t_cases[i].desc);
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}
@@ -0,0 +1,351 @@
+/*-
+ * Copyright (c) 2017 The University of Oslo
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cryb/test.h>
+
+#include <logjam/time.h>
+#include <logjam/timefmt.h>
+
+#define T_NLINES	20000
+#define T_RUN		50
+
+/* a time zone with daylight saving time, so we cross the transitions */
+#define T_TZ		"CET-1CEST,M3.5.0,M10.5.0/3"
+
+/*
+ * Characters we sprinkle over timestamps to make sure both parsers
+ * reject, or accept, the same garbage.
+ */
+static const char t_noise[] = "0123456789 \t.:-TJanunMyDec%";
+
+struct t_fmt {
+	const char	*fmt;		/* format to parse */
+	const char	*out;		/* format to generate, if different */
+	int		 compiled;	/* expect a fast path */
+	int		 year;		/* contains a year */
+};
+
+static struct t_fmt t_fmts[] = {
+	{ "%b %e %H:%M:%S ",		NULL,			1, 0 },
+	{ "%b %d %T",			NULL,			1, 0 },
+	{ "%Y-%m-%dT%H:%M:%S",		NULL,			1, 1 },
+	{ "%F %T ",			NULL,			1, 1 },
+	{ "%d-%b-%Y %H:%M:%S.",		"%d-%b-%Y %H:%M:%S.123", 1, 1 },
+	{ "%B %d, %Y %R",		NULL,			1, 1 },
+	{ "%y%m%d %k:%M:%S",		NULL,			1, 1 },
+	{ "%a %b %e %H:%M:%S %Y",	NULL,			0, 1 },
+	{ "%s ",			NULL,			0, 1 },
+};
+
+/*
+ * What lj_file_read() used to do: lj_strptime() followed by mktime(),
+ * except that we fill in the year the same way lj_timefmt does.  This
+ * knows nothing of fractional seconds, so we only compare whole seconds.
+ */
+static const char *
+t_timefmt_ref(const char *fmt, const char *str, uint64_t *when)
+{
+	struct tm tm, now;
+	const char *end;
+	time_t t;
+
+	memset(&tm, 0, sizeof tm);
+	tm.tm_year = INT_MIN;
+	if ((end = lj_strptime(str, fmt, &tm)) == NULL)
+		return (NULL);
+	if (tm.tm_year == INT_MIN) {
+		t = time(NULL);
+		localtime_r(&t, &now);
+		tm.tm_year = now.tm_year;
+		if (tm.tm_mon - now.tm_mon > 6)
+			tm.tm_year--;
+		else if (now.tm_mon - tm.tm_mon > 6)
+			tm.tm_year++;
+	}
+	tm.tm_isdst = -1;
+	if ((t = mktime(&tm)) == (time_t)-1 || t <= 0)
+		return (NULL);
+	*when = (uint64_t)t * 1000000;
+	return (end);
+}
+
+/*
+ * Parse a string with both lj_timefmt and the reference implementation
+ * and compare the results.
+ */
+static int
+t_timefmt_compare(lj_timefmt *tf, const char *fmt, const char *str)
+{
+	const char *exp, *got;
+	uint64_t wexp, wgot;
+
+	exp = t_timefmt_ref(fmt, str, &wexp);
+	got = lj_timefmt_parse(tf, str, &wgot);
+	if (exp == NULL || got == NULL) {
+		if (exp == got)
+			return (1);
+		t_printv("[%s] expected %s, got %s\n", str,
+		    exp ? "success" : "failure", got ? "success" : "failure");
+		return (0);
+	}
+	if (!t_compare_ptr(exp, got) ||
+	    !t_compare_u64(wexp, wgot - wgot % 1000000)) {
+		t_printv("[%s]\n", str);
+		return (0);
+	}
+	return (1);
+}
+
+
+/***************************************************************************
+ * Test cases
+ */
+
+static int
+t_timefmt_compile(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_fmt *tfmt = arg;
+	lj_timefmt *tf;
+	int ret;
+
+	t_assert((tf = lj_timefmt_compile(tfmt->fmt)) != NULL);
+	ret = t_compare_i(tfmt->compiled, lj_timefmt_compiled(tf));
+	lj_timefmt_destroy(tf);
+	return (ret);
+}
+
+/*
+ * Generate runs of timestamps a few seconds apart, some of them mangled,
+ * and check that we get the same results as the reference.
+ */
+static int
+t_timefmt_random(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_fmt *tfmt = arg;
+	char str[128];
+	lj_timefmt *tf;
+	struct tm tm;
+	unsigned int i;
+	size_t len;
+	time_t t;
+	int ret;
+
+	t_assert((tf = lj_timefmt_compile(tfmt->fmt)) != NULL);
+	srandom(1);
+	t = 0;
+	ret = 1;
+	for (i = 0; i < T_NLINES && ret; ++i) {
+		/* within five months of now, or anywhere this century */
+		if (i % T_RUN == 0) {
+			if (tfmt->year)
+				t = 946684800 + random() % (30 * 31556952L);
+			else
+				t = time(NULL) - 150 * 86400 +
+				    random() % (300 * 86400L);
+		}
+		t += random() % 3;
+		localtime_r(&t, &tm);
+		len = strftime(str, sizeof str - 16,
+		    tfmt->out ? tfmt->out : tfmt->fmt, &tm);
+		t_assert(len > 0);
+		strcpy(str + len, "x message");
+		if (random() % 4 == 0)
+			str[random() % (len + 1)] =
+			    t_noise[random() % (sizeof t_noise - 1)];
+		ret &= t_timefmt_compare(tf, tfmt->fmt, str);
+	}
+	lj_timefmt_destroy(tf);
+	return (ret);
+}
+
+/*
+ * Fractional seconds, as %f or following %S.
+ */
+static struct t_frac {
+	const char	*fmt;
+	const char	*str;
+	uint64_t	 when;		/* 2017-11-24 11:00:01 UTC plus this */
+	size_t		 len;		/* length of timestamp */
+} t_fracs[] = {
+	{ "%F %H:%M:%S.",	"2017-11-24 12:00:01.5 x",	500000, 21 },
+	{ "%F %H:%M:%S.",	"2017-11-24 12:00:01.123 x",	123000, 23 },
+	{ "%F %H:%M:%S.",	"2017-11-24 12:00:01.1234 x",	123000, 23 },
+	{ "%F %H:%M:%S.",	"2017-11-24 12:00:01. x",	0,	20 },
+	{ "%F %H:%M:%S.",	"2017-11-24 12:00:01 x",	0,	0 },
+	{ "%FT%T.%f",		"2017-11-24T12:00:01.123456Z",	123456, 26 },
+	{ "%FT%T.%f",		"2017-11-24T12:00:01.1Z",	100000, 21 },
+	{ "%FT%T.%f",		"2017-11-24T12:00:01.1234567Z",	123456, 26 },
+	{ "%FT%T.%f",		"2017-11-24T12:00:01.Z",	0,	0 },
+	{ "%F %H:%M.:%S",	"2017-11-24 12:00.5:01 x",	0,	21 },
+};
+
+static int
+t_timefmt_frac(char **desc CRYB_UNUSED, void *arg)
+{
+	struct t_frac *tfrac = arg;
+	const char *end;
+	lj_timefmt *tf;
+	uint64_t when;
+	int ret;
+
+	t_assert((tf = lj_timefmt_compile(tfrac->fmt)) != NULL);
+	ret = t_compare_i(1, lj_timefmt_compiled(tf));
+	end = lj_timefmt_parse(tf, tfrac->str, &when);
+	if (tfrac->len == 0) {
+		ret &= t_compare_ptr(NULL, end);
+	} else if (t_is_not_null(end)) {
+		ret &= t_compare_sz(tfrac->len, end - tfrac->str);
+		ret &= t_compare_u64(1511521201000000ULL + tfrac->when, when);
+	} else {
+		ret = 0;
+	}
+	lj_timefmt_destroy(tf);
+	return (ret);
+}
+
+/*
+ * Only compiled formats can have %f.
+ */
+static int
+t_timefmt_nofrac(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+
+	return (t_compare_ptr(NULL, lj_timefmt_compile("%a %T.%f")));
+}
+
+/*
+ * A timestamp which matches the previous one up to where that ended is
+ * not necessarily the same timestamp.
+ */
+static int
+t_timefmt_lookahead(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	static const char *fmt = "%Y-%m-%d %H:%M:%S";
+	static const char *strs[] = {
+		"2017-11-24 12:00:1 one digit",
+		"2017-11-24 12:00:1 one digit",
+		"2017-11-24 12:00:12 two digits",
+		"2017-11-24 12:00:12",
+		"2017-11-24 12:00:1",
+		"2017-11-24 12:01:1",
+	};
+	lj_timefmt *tf;
+	unsigned int i;
+	int ret;
+
+	t_assert((tf = lj_timefmt_compile(fmt)) != NULL);
+	ret = 1;
+	for (i = 0; i < sizeof strs / sizeof *strs; ++i)
+		ret &= t_timefmt_compare(tf, fmt, strs[i]);
+	lj_timefmt_destroy(tf);
+	return (ret);
+}
+
+/*
+ * Format runs of times a fraction of a second apart and compare the
+ * results with what strftime() gives us.
+ */
+static int
+t_timefmt_rfc3339(char **desc CRYB_UNUSED, void *arg CRYB_UNUSED)
+{
+	char exp[64], got[LJ_TIMEFMT_RFC3339_LEN];
+	unsigned int i;
+	uint64_t when;
+	struct tm tm;
+	time_t t;
+	size_t len;
+	int ret;
+
+	srandom(1);
+	when = 0;
+	ret = 1;
+	for (i = 0; i < T_NLINES && ret; ++i) {
+		if (i % T_RUN == 0)
+			when = (uint64_t)random() % (4102444800ULL * 1000000);
+		when += random() % 500000;
+		t = when / 1000000;
+		gmtime_r(&t, &tm);
+		len = strftime(exp, sizeof exp, "%Y-%m-%dT%H:%M:%S", &tm);
+		snprintf(exp + len, sizeof exp - len, ".%06luZ",
+		    (unsigned long)(when % 1000000));
+		len = lj_timefmt_rfc3339(when, got);
+		ret &= t_compare_sz(LJ_TIMEFMT_RFC3339_LEN - 1, len);
+		ret &= t_compare_str(exp, got);
+	}
+	lj_timefmt_rfc3339(UINT64_MAX, got);
+	ret &= t_compare_str("9999-12-31T23:59:59.999999Z", got);
+	return (ret);
+}
+
+
+/***************************************************************************
+ * Boilerplate
+ */
+
+static int
+t_prepare(int argc, char *argv[])
+{
+	unsigned int i;
+
+	(void)argc;
+	(void)argv;
+	setenv("TZ", T_TZ, 1);
+	tzset();
+	for (i = 0; i < sizeof t_fmts / sizeof *t_fmts; ++i)
+		t_add_test(t_timefmt_compile, &t_fmts[i], "compile %s",
+		    t_fmts[i].fmt);
+	for (i = 0; i < sizeof t_fmts / sizeof *t_fmts; ++i)
+		t_add_test(t_timefmt_random, &t_fmts[i], "random %s",
+		    t_fmts[i].fmt);
+	for (i = 0; i < sizeof t_fracs / sizeof *t_fracs; ++i)
+		t_add_test(t_timefmt_frac, &t_fracs[i], "fraction %s",
+		    t_fracs[i].str);
+	t_add_test(t_timefmt_nofrac, NULL, "fraction needs fast path");
+	t_add_test(t_timefmt_lookahead, NULL, "lookahead");
+	t_add_test(t_timefmt_rfc3339, NULL, "rfc3339");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+
+	t_main(t_prepare, NULL, argc, argv);
+}